@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "launch.h"
+#include "scatter.h"
+
+// Coalesces many small host to device copies. Messages are gathered into a pinned staging
+// buffer, and a batch goes out as a single transfer of payload plus ScatterEntry table,
+// which the scatter_copy kernel in kernel.co then spreads to the destinations. A batch is
+// flushed once it holds flushBytes or maxEntries messages, or, checked on submit() and
+// poll(), once its oldest message has waited deadlineUs. Two staging buffers alternate
+// so one batch is gathered while the previous one is in flight. Messages too large to
+// stage are copied directly.
+class CoalescingUploader {
+public:
+    struct Policy {
+        size_t flushBytes;
+        size_t maxEntries;
+        long long deadlineUs;
+    };
+
+private:
+    static const size_t ALIGNMENT = 16;
+    static const unsigned THREADS_PER_BLOCK_X = 256;
+
+    struct Staging {
+        unsigned char *host;
+        unsigned char *device;
+        hipEvent_t done;
+        bool busy;
+    };
+
+    hipFunction_t mScatter;
+    hipStream_t mStream;
+    Policy mPolicy;
+    size_t mCapacity;
+    Staging mStaging[2];
+    int mCurrent;
+    size_t mUsed;
+    std::vector<ScatterEntry> mEntries;
+    std::chrono::steady_clock::time_point mOldest;
+    size_t mTransfers;
+    size_t mBatches;
+    size_t mMessages;
+
+    static size_t align(size_t value) {
+        return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    // Payload and table of a full batch
+    size_t capacity() const {
+        return align(mPolicy.flushBytes + ALIGNMENT * mPolicy.maxEntries) + sizeof(ScatterEntry) * mPolicy.maxEntries;
+    }
+
+public:
+    CoalescingUploader(HipDevice &device, hipStream_t stream, const Policy &policy) :
+        mScatter(device.getFunction("kernel.co", "scatter_copy")), mStream(stream), mPolicy(policy),
+        mCapacity(capacity()), mCurrent(0), mUsed(0), mTransfers(0), mBatches(0), mMessages(0) {
+        for (auto &staging : mStaging) {
+            hipCheck(hipHostMalloc((void **)&staging.host, mCapacity, hipHostMallocDefault));
+            hipCheck(hipMalloc((void **)&staging.device, mCapacity));
+            hipCheck(hipEventCreateWithFlags(&staging.done, hipEventDisableTiming));
+            staging.busy = false;
+        }
+        mEntries.reserve(mPolicy.maxEntries);
+    }
+
+    ~CoalescingUploader() {
+        (void)hipStreamSynchronize(mStream);
+        for (auto &staging : mStaging) {
+            (void)hipEventDestroy(staging.done);
+            (void)hipFree(staging.device);
+            (void)hipHostFree(staging.host);
+        }
+    }
+
+    CoalescingUploader(const CoalescingUploader &) = delete;
+    CoalescingUploader &operator=(const CoalescingUploader &) = delete;
+
+    // Queue bytes from src to device address dst; src may be reused once this returns
+    void submit(void *dst, const void *src, size_t bytes) {
+        mMessages++;
+        if (bytes > mPolicy.flushBytes) {
+            // Messages staged before this one go first, the stream keeps them in order
+            flush();
+            hipCheck(hipMemcpyAsync(dst, src, bytes, hipMemcpyHostToDevice, mStream));
+            mTransfers++;
+            return;
+        }
+        if ((mUsed + bytes > mPolicy.flushBytes) || (mEntries.size() == mPolicy.maxEntries))
+            flush();
+
+        Staging &staging = mStaging[mCurrent];
+        if (staging.busy) {
+            // The previous transfer from this buffer has to be out before it is refilled
+            hipCheck(hipEventSynchronize(staging.done));
+            staging.busy = false;
+        }
+        if (mEntries.empty())
+            mOldest = std::chrono::steady_clock::now();
+        std::memcpy(staging.host + mUsed, src, bytes);
+        mEntries.push_back(ScatterEntry{reinterpret_cast<uint64_t>(dst), static_cast<uint32_t>(mUsed),
+                                        static_cast<uint32_t>(bytes)});
+        mUsed = align(mUsed + bytes);
+        poll();
+    }
+
+    // Flush the batch if its oldest message is past the deadline
+    void poll() {
+        if (mEntries.empty())
+            return;
+        const auto age = std::chrono::steady_clock::now() - mOldest;
+        if (std::chrono::duration_cast<std::chrono::microseconds>(age).count() >= mPolicy.deadlineUs)
+            flush();
+    }
+
+    // Send the gathered batch: one copy of payload and table, one scatter launch
+    void flush() {
+        if (mEntries.empty())
+            return;
+        Staging &staging = mStaging[mCurrent];
+        const size_t tableOffset = mUsed;
+        const size_t tableBytes = mEntries.size() * sizeof(ScatterEntry);
+        std::memcpy(staging.host + tableOffset, mEntries.data(), tableBytes);
+        hipCheck(hipMemcpyAsync(staging.device, staging.host, tableOffset + tableBytes, hipMemcpyHostToDevice, mStream));
+
+        PackedArgs args;
+        args.push(staging.device);
+        args.push(staging.device + tableOffset);
+        args.push(static_cast<unsigned>(mEntries.size()));
+        hipCheck(hipModuleLaunchKernel(mScatter,
+                                         mEntries.size(), 1, 1,
+                                         THREADS_PER_BLOCK_X, 1, 1,
+                                         0, mStream, nullptr, args.config()), "scatter_copy");
+        hipCheck(hipEventRecord(staging.done, mStream));
+        staging.busy = true;
+
+        mTransfers++;
+        mBatches++;
+        mEntries.clear();
+        mUsed = 0;
+        mCurrent ^= 1;
+    }
+
+    // Flush and wait until every submitted message has landed
+    void finish() {
+        flush();
+        hipCheck(hipStreamSynchronize(mStream));
+    }
+
+    // Host to device copies issued, batches included
+    size_t transfers() const {
+        return mTransfers;
+    }
+
+    size_t batches() const {
+        return mBatches;
+    }
+
+    size_t messages() const {
+        return mMessages;
+    }
+};
@@ -1,19 +1,29 @@
 /* SPDX-License-Identifier: Apache License 2.0 */
 /* Copyright (C) 2023 Advanced Micro Devices, Inc. */
 
+#pragma once
+
+#include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <system_error>
+#include <thread>
+#include <vector>
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
 #include "hip/hip_runtime_api.h"
 
+#include "embed.h"
+
 class HIPError : public std::system_error
 {
 private:
@@ -57,6 +67,79 @@ public:
     }
 };
 
+// Return the p-th percentile (0 < p <= 100) of the samples; the samples are reordered
+template<typename T> T percentile(std::vector<T> &samples, double p) {
+    if (samples.empty())
+        return T();
+    size_t rank = static_cast<size_t>((p / 100.0) * samples.size());
+    if (rank >= samples.size())
+        rank = samples.size() - 1;
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+// Submission window which bounds the number of launches outstanding on a stream. Each
+// launch records an event into a ring of depth slots; before a slot is reused we block
+// on the event recorded there by the launch depth positions earlier (backpressure).
+// The submit-to-retire latency of every launch is kept in microseconds.
+class LaunchWindow {
+    hipStream_t mStream;
+    std::vector<hipEvent_t> mRing;
+    std::vector<std::chrono::high_resolution_clock::time_point> mSubmitted;
+    std::vector<long long> mLatency;
+    size_t mHead;
+    size_t mTail;
+
+    void retire() {
+        const size_t slot = mTail % mRing.size();
+        hipCheck(hipEventSynchronize(mRing[slot]));
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        mLatency.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - mSubmitted[slot]).count());
+        mTail++;
+    }
+
+public:
+    LaunchWindow(size_t depth, hipStream_t stream = 0) : mStream(stream), mRing(depth, nullptr),
+                                                         mSubmitted(depth), mHead(0), mTail(0) {
+        if (depth == 0)
+            throw std::invalid_argument("launch window depth must be at least 1");
+        for (auto &event : mRing)
+            hipCheck(hipEventCreateWithFlags(&event, hipEventDisableTiming));
+    }
+
+    ~LaunchWindow() noexcept {
+        for (auto event : mRing)
+            (void)hipEventDestroy(event);
+    }
+
+    // Call before each launch, blocks while depth launches are still in flight
+    void acquire() {
+        if (mHead - mTail == mRing.size())
+            retire();
+        mSubmitted[mHead % mRing.size()] = std::chrono::high_resolution_clock::now();
+    }
+
+    // Call right after each launch to mark its completion point in the stream
+    void commit() {
+        hipCheck(hipEventRecord(mRing[mHead % mRing.size()], mStream));
+        mHead++;
+    }
+
+    // Wait for all outstanding launches
+    void drain() {
+        while (mTail != mHead)
+            retire();
+    }
+
+    size_t depth() const {
+        return mRing.size();
+    }
+
+    std::vector<long long> &latencies() {
+        return mLatency;
+    }
+};
+
 // Abstraction of device buffer so we can do automatic buffer dealocation (RAII)
 template<typename T> class DeviceBO {
     T *_buffer;
@@ -82,13 +165,64 @@ private:
     hipDevice_t mDevice;
     int mIndex;
     std::map<std::string, hipModule_t> mModuleTable;
+    std::mutex mModuleMutex;
+    std::thread mPreloader;
+
+    // Load a module once; without an image the code object embedded under this name is
+    // used if there is one (and embedded is set), otherwise the file of that name
+    hipModule_t loadModule(const std::string &key, const void *image, bool embedded = true) {
+        std::lock_guard<std::mutex> lock(mModuleMutex);
+        std::map<std::string, hipModule_t>::iterator it = mModuleTable.find(key);
+        if (it != mModuleTable.end())
+            return it->second;
+        makeCurrent();
+        if (!image && embedded)
+            image = EmbeddedImage::find(key);
+        hipModule_t hmodule;
+        if (image)
+            hipCheck(hipModuleLoadData(&hmodule, image), key.c_str());
+        else
+            hipCheck(hipModuleLoad(&hmodule, key.c_str()), key.c_str());
+        mModuleTable.insert(it, std::pair<std::string, hipModule_t>(key, hmodule));
+        return hmodule;
+    }
 
 public:
     HipDevice(int index = 0) : mIndex(index) {
         hipCheck(hipDeviceGet(&mDevice, index));
     }
 
+    static int count() {
+        int n = 0;
+        hipCheck(hipGetDeviceCount(&n));
+        return n;
+    }
+
+    int index() const {
+        return mIndex;
+    }
+
+    // NUMA node of the PCIe root complex the device is attached to, -1 if unknown
+    int numaNode() const {
+        char busId[32];
+        hipCheck(hipDeviceGetPCIBusId(busId, sizeof(busId), mIndex));
+        std::string path = "/sys/bus/pci/devices/";
+        for (const char *c = busId; *c; c++)
+            path += std::tolower(*c);
+        std::ifstream file(path + "/numa_node");
+        int node = -1;
+        file >> node;
+        return node;
+    }
+
+    // Make this the current device of the calling thread; every thread which talks to a
+    // device other than 0 has to do this first
+    void makeCurrent() const {
+        hipCheck(hipSetDevice(mIndex));
+    }
+
     virtual ~HipDevice() {
+        waitPreload();
         for (auto it : mModuleTable)
             (void)hipModuleUnload(it.second);
     }
@@ -111,16 +245,57 @@ public:
         stream << devProp.maxThreadsPerBlock << " Threads" << std::endl;
     }
 
+    // Target architecture, e.g. gfx90a:sramecc+:xnack-, for runtime compilation
+    std::string arch() const {
+        hipDeviceProp_t devProp;
+        hipCheck(hipGetDeviceProperties(&devProp, mIndex));
+        return devProp.gcnArchName;
+    }
+
+    // Compute units, the granularity of stream CU masks
+    unsigned computeUnits() const {
+        hipDeviceProp_t devProp;
+        hipCheck(hipGetDeviceProperties(&devProp, mIndex));
+        return devProp.multiProcessorCount;
+    }
+
+    hipModule_t getModule(const char *fileName, bool embedded = true) {
+        return loadModule(fileName, nullptr, embedded);
+    }
+
+    // Like getFunction but the code object is already in memory; key names the module
+    hipFunction_t getFunction(const std::string &key, const void *image, const char *funcName) {
+        hipModule_t hmodule = loadModule(key, image);
+        hipFunction_t hfunction;
+        hipCheck(hipModuleGetFunction(&hfunction, hmodule, funcName), funcName);
+        return hfunction;
+    }
+
     hipFunction_t getFunction(const char *fileName, const char *funcName) {
-        std::map<std::string, hipModule_t>::iterator it = mModuleTable.find(fileName);
-        hipModule_t hmodule;
-        hmodule = it->second;
-        if (it == mModuleTable.end()) {
-            hipCheck(hipModuleLoad(&hmodule, fileName), fileName);
-            mModuleTable.insert(it, std::pair<std::string, hipModule_t>(fileName, hmodule));
-        }
+        hipModule_t hmodule = getModule(fileName);
         hipFunction_t hfunction;
         hipCheck(hipModuleGetFunction(&hfunction, hmodule, funcName), funcName);
         return hfunction;
     }
+
+    // Load every embedded code object on a background thread so that getFunction finds
+    // the modules ready, or waits only for the one it needs. A module which fails to
+    // load here is retried, and reports its error, on first use.
+    void preload() {
+        if (mPreloader.joinable())
+            return;
+        mPreloader = std::thread([this]() {
+            for (auto &image : EmbeddedImage::all()) {
+                try {
+                    loadModule(image.first, image.second.first);
+                } catch (std::exception &) {
+                }
+            }
+        });
+    }
+
+    void waitPreload() {
+        if (mPreloader.joinable())
+            mPreloader.join();
+    }
 };
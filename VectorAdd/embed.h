@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+
+// Code objects linked into the executable, looked up by the file name they were built
+// as. The Makefile turns foo.co into foo.co.o with "objcopy -I binary", which defines
+// _binary_foo_co_start/_end around the image, moves it into a read only, page aligned
+// section and marks the stack non executable; EMBED_CODE_OBJECT(foo_co, "foo.co")
+// registers it.
+class EmbeddedImage {
+    typedef std::map<std::string, std::pair<const char *, size_t>> Table;
+
+    static Table &table() {
+        static Table images;
+        return images;
+    }
+
+public:
+    struct Registrar {
+        Registrar(const char *name, const char *begin, const char *end) {
+            table()[name] = std::make_pair(begin, static_cast<size_t>(end - begin));
+        }
+    };
+
+    // Image registered under the name, nullptr if there is none
+    static const char *find(const std::string &name) {
+        Table::const_iterator it = table().find(name);
+        return (it == table().end()) ? nullptr : it->second.first;
+    }
+
+    static const Table &all() {
+        return table();
+    }
+};
+
+#define EMBED_CODE_OBJECT(symbol, name)                                 \
+    extern "C" const char _binary_##symbol##_start[];                   \
+    extern "C" const char _binary_##symbol##_end[];                     \
+    static EmbeddedImage::Registrar embedded_##symbol(name, _binary_##symbol##_start, _binary_##symbol##_end)
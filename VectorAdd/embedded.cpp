@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+// Kernels linked into the drivers so they are loaded from memory instead of the working
+// directory
+
+#include "embed.h"
+
+EMBED_CODE_OBJECT(kernel_co, "kernel.co");
+EMBED_CODE_OBJECT(nop_co, "nop.co");
+EMBED_CODE_OBJECT(stream_co, "stream.co");
@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Expression templates for elementwise float vector arithmetic, e.g.
+//     auto e = b + c * d - relu(e);
+// builds a tree of nodes which can be evaluated fused on the host, one SIMD vector of
+// lanes at a time, or turned into the source of one fused device kernel. The source
+// text of the expression, with the vectors renamed in0, in1... in order of first use,
+// identifies its shape: two trees with the same shape share a kernel.
+
+namespace expr {
+
+// 128-bit lanes are available on every x86-64 host without changing the calling convention
+typedef float vfloat __attribute__((vector_size(16)));
+static const size_t LANES = sizeof(vfloat) / sizeof(float);
+
+// Marks the types which take part in expressions
+struct Expr {};
+
+class Vector;
+
+// Collects the source text of an expression and the distinct vectors it reads. Vectors
+// are copied into the tree by value, so a vector is identified by both of its views:
+// temporaries which only exist on one side stay distinct from each other.
+class Codegen {
+    std::ostringstream mText;
+    std::vector<std::pair<const float *, const float *>> mLeaves;
+    std::vector<const float *> mInputs;
+
+public:
+    void leaf(const float *host, const float *device) {
+        const std::pair<const float *, const float *> views(host, device);
+        auto it = std::find(mLeaves.begin(), mLeaves.end(), views);
+        mText << "in" << (it - mLeaves.begin()) << "[i]";
+        if (it == mLeaves.end()) {
+            mLeaves.push_back(views);
+            mInputs.push_back(device);
+        }
+    }
+
+    void constant(float value) {
+        mText << std::hexfloat << value << std::defaultfloat << 'f';
+    }
+
+    void text(const char *str) {
+        mText << str;
+    }
+
+    std::string shape() const {
+        return mText.str();
+    }
+
+    // Device views of the distinct vectors, in order of first use
+    const std::vector<const float *> &inputs() const {
+        return mInputs;
+    }
+};
+
+// Terminal referring to a vector; host and device are views of the same values, either
+// may be null if the vector is only used on one side
+class Vector : public Expr {
+    const float *mHost;
+    const float *mDevice;
+
+public:
+    Vector(const float *host, const float *device = nullptr) : mHost(host), mDevice(device) {}
+
+    template<typename V> V eval(size_t i) const {
+        V v;
+        std::memcpy(&v, mHost + i, sizeof(V));
+        return v;
+    }
+
+    void source(Codegen &gen) const {
+        gen.leaf(mHost, mDevice);
+    }
+
+    size_t ops() const {
+        return 0;
+    }
+
+    template<typename X> Vector materialize(X &) const {
+        return *this;
+    }
+
+    const float *host() const {
+        return mHost;
+    }
+
+    const float *device() const {
+        return mDevice;
+    }
+};
+
+// Scalar baked into the expression; its exact value becomes part of the shape
+class Constant : public Expr {
+    float mValue;
+
+public:
+    Constant(float value) : mValue(value) {}
+
+    template<typename V> V eval(size_t) const {
+        return V{} + mValue;
+    }
+
+    void source(Codegen &gen) const {
+        gen.constant(mValue);
+    }
+
+    size_t ops() const {
+        return 0;
+    }
+
+    template<typename X> Constant materialize(X &) const {
+        return *this;
+    }
+};
+
+// Each operation provides the host evaluation for both scalars and SIMD vectors and the
+// text placed around its operands in device source
+struct Add {
+    static constexpr const char *prefix = "(", *infix = " + ", *suffix = ")";
+    template<typename V> static V apply(V a, V b) { return a + b; }
+};
+
+struct Sub {
+    static constexpr const char *prefix = "(", *infix = " - ", *suffix = ")";
+    template<typename V> static V apply(V a, V b) { return a - b; }
+};
+
+struct Mul {
+    static constexpr const char *prefix = "(", *infix = " * ", *suffix = ")";
+    template<typename V> static V apply(V a, V b) { return a * b; }
+};
+
+struct Div {
+    static constexpr const char *prefix = "(", *infix = " / ", *suffix = ")";
+    template<typename V> static V apply(V a, V b) { return a / b; }
+};
+
+struct Max {
+    static constexpr const char *prefix = "fmaxf(", *infix = ", ", *suffix = ")";
+    template<typename V> static V apply(V a, V b) { return a > b ? a : b; }
+};
+
+struct Min {
+    static constexpr const char *prefix = "fminf(", *infix = ", ", *suffix = ")";
+    template<typename V> static V apply(V a, V b) { return a < b ? a : b; }
+};
+
+struct Neg {
+    static constexpr const char *prefix = "(-", *suffix = ")";
+    template<typename V> static V apply(V a) { return -a; }
+};
+
+struct Relu {
+    static constexpr const char *prefix = "fmaxf(", *suffix = ", 0.0f)";
+    template<typename V> static V apply(V a) { return a > V{} ? a : V{}; }
+};
+
+template<typename Op, typename L, typename R> class Binary : public Expr {
+    L mLeft;
+    R mRight;
+
+public:
+    Binary(const L &left, const R &right) : mLeft(left), mRight(right) {}
+
+    template<typename V> V eval(size_t i) const {
+        return Op::apply(mLeft.template eval<V>(i), mRight.template eval<V>(i));
+    }
+
+    void source(Codegen &gen) const {
+        gen.text(Op::prefix);
+        mLeft.source(gen);
+        gen.text(Op::infix);
+        mRight.source(gen);
+        gen.text(Op::suffix);
+    }
+
+    size_t ops() const {
+        return 1 + mLeft.ops() + mRight.ops();
+    }
+
+    // Evaluate the operands into temporaries of the executor and then this one operation,
+    // which is how the expression runs when every operation is its own pass over memory
+    template<typename X> Vector materialize(X &executor) const {
+        auto left = mLeft.materialize(executor);
+        auto right = mRight.materialize(executor);
+        return executor.run(Binary<Op, decltype(left), decltype(right)>(left, right));
+    }
+};
+
+template<typename Op, typename E> class Unary : public Expr {
+    E mOperand;
+
+public:
+    Unary(const E &operand) : mOperand(operand) {}
+
+    template<typename V> V eval(size_t i) const {
+        return Op::apply(mOperand.template eval<V>(i));
+    }
+
+    void source(Codegen &gen) const {
+        gen.text(Op::prefix);
+        mOperand.source(gen);
+        gen.text(Op::suffix);
+    }
+
+    size_t ops() const {
+        return 1 + mOperand.ops();
+    }
+
+    template<typename X> Vector materialize(X &executor) const {
+        auto operand = mOperand.materialize(executor);
+        return executor.run(Unary<Op, decltype(operand)>(operand));
+    }
+};
+
+template<typename T> using IsExpr = std::is_base_of<Expr, T>;
+
+// Plain floats on either side of an operator become constants
+template<typename T> using Operand = typename std::conditional<IsExpr<T>::value, T, Constant>::type;
+
+template<typename L, typename R> using EnableBinary =
+    typename std::enable_if<(IsExpr<L>::value && (IsExpr<R>::value || std::is_arithmetic<R>::value)) ||
+                            (std::is_arithmetic<L>::value && IsExpr<R>::value)>::type;
+
+template<typename L, typename R, typename = EnableBinary<L, R>>
+Binary<Add, Operand<L>, Operand<R>> operator+(const L &l, const R &r) {
+    return Binary<Add, Operand<L>, Operand<R>>(Operand<L>(l), Operand<R>(r));
+}
+
+template<typename L, typename R, typename = EnableBinary<L, R>>
+Binary<Sub, Operand<L>, Operand<R>> operator-(const L &l, const R &r) {
+    return Binary<Sub, Operand<L>, Operand<R>>(Operand<L>(l), Operand<R>(r));
+}
+
+template<typename L, typename R, typename = EnableBinary<L, R>>
+Binary<Mul, Operand<L>, Operand<R>> operator*(const L &l, const R &r) {
+    return Binary<Mul, Operand<L>, Operand<R>>(Operand<L>(l), Operand<R>(r));
+}
+
+template<typename L, typename R, typename = EnableBinary<L, R>>
+Binary<Div, Operand<L>, Operand<R>> operator/(const L &l, const R &r) {
+    return Binary<Div, Operand<L>, Operand<R>>(Operand<L>(l), Operand<R>(r));
+}
+
+template<typename L, typename R, typename = EnableBinary<L, R>>
+Binary<Max, Operand<L>, Operand<R>> max(const L &l, const R &r) {
+    return Binary<Max, Operand<L>, Operand<R>>(Operand<L>(l), Operand<R>(r));
+}
+
+template<typename L, typename R, typename = EnableBinary<L, R>>
+Binary<Min, Operand<L>, Operand<R>> min(const L &l, const R &r) {
+    return Binary<Min, Operand<L>, Operand<R>>(Operand<L>(l), Operand<R>(r));
+}
+
+template<typename E, typename = typename std::enable_if<IsExpr<E>::value>::type>
+Unary<Neg, E> operator-(const E &e) {
+    return Unary<Neg, E>(e);
+}
+
+template<typename E, typename = typename std::enable_if<IsExpr<E>::value>::type>
+Unary<Relu, E> relu(const E &e) {
+    return Unary<Relu, E>(e);
+}
+
+template<typename E> std::string shape(const E &e) {
+    Codegen gen;
+    e.source(gen);
+    return gen.shape();
+}
+
+// Fused host evaluation of out[i] = e[i], LANES elements at a time
+template<typename E> void evaluate(float *out, const E &e, size_t begin, size_t end) {
+    size_t i = begin;
+    for (; i + LANES <= end; i += LANES) {
+        vfloat v = e.template eval<vfloat>(i);
+        std::memcpy(out + i, &v, sizeof(v));
+    }
+    for (; i < end; i++)
+        out[i] = e.template eval<float>(i);
+}
+
+// Bytes moved by the fused evaluation: every distinct input read once, output written once
+template<typename E> size_t fusedBytes(const E &e, size_t len) {
+    Codegen gen;
+    e.source(gen);
+    return (gen.inputs().size() + 1) * len * sizeof(float);
+}
+
+// Host executor which runs every operation as its own pass over memory, see materialize().
+// Temporaries are kept and reused after reset() so repeated runs do not allocate.
+class HostUnfused {
+    size_t mLen;
+    std::vector<std::unique_ptr<float[]>> mTemps;
+    size_t mNext;
+    size_t mBytes;
+
+public:
+    HostUnfused(size_t len) : mLen(len), mNext(0), mBytes(0) {}
+
+    template<typename E> Vector run(const E &e) {
+        if (mNext == mTemps.size())
+            mTemps.emplace_back(new float[mLen]);
+        float *temp = mTemps[mNext++].get();
+        evaluate(temp, e, 0, mLen);
+        mBytes += fusedBytes(e, mLen);
+        return Vector(temp);
+    }
+
+    void reset() {
+        mNext = 0;
+        mBytes = 0;
+    }
+
+    // Bytes moved since the last reset
+    size_t bytes() const {
+        return mBytes;
+    }
+};
+
+}
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "expr.h"
+#include "rtc-hip.h"
+
+// Generates, compiles and launches one kernel per distinct expression shape. Code
+// objects come from the on-disk cache when any earlier run built the same shape;
+// loaded kernels are kept for the lifetime of the engine.
+class FusedEngine {
+    static const int THREADS_PER_BLOCK_X = 256;
+
+    HipDevice &mDevice;
+    HiprtcCompiler mCompiler;
+    CodeObjectCache &mCache;
+    std::map<std::string, hipFunction_t> mKernels;
+
+    static std::string kernelSource(const std::string &shape, size_t inputs) {
+        std::string src = "extern \"C\" __global__ void\nfused(float* __restrict__ out";
+        for (size_t i = 0; i < inputs; i++)
+            src += ", const float* __restrict__ in" + std::to_string(i);
+        src += ", unsigned len)\n{\n"
+               "    const unsigned i = blockDim.x * blockIdx.x + threadIdx.x;\n"
+               "    if (i < len)\n"
+               "        out[i] = " + shape + ";\n}\n";
+        return src;
+    }
+
+public:
+    FusedEngine(HipDevice &device, CodeObjectCache &cache) : mDevice(device), mCompiler(device.arch()),
+                                                             mCache(cache) {}
+
+    hipFunction_t kernel(const std::string &shape, size_t inputs) {
+        auto it = mKernels.find(shape);
+        if (it != mKernels.end())
+            return it->second;
+        std::vector<char> code = mCache.get(mCompiler, kernelSource(shape, inputs), "fused.cpp", {"-O3"});
+        hipFunction_t function = mDevice.getFunction("fused:" + shape, code.data(), "fused");
+        mKernels.insert(std::make_pair(shape, function));
+        return function;
+    }
+
+    // out[i] = e[i] for i in [0, len) on the device, in one launch
+    template<typename E> void run(float *out, const E &e, size_t len, hipStream_t stream = 0) {
+        expr::Codegen gen;
+        e.source(gen);
+        const std::vector<const float *> &inputs = gen.inputs();
+        hipFunction_t function = kernel(gen.shape(), inputs.size());
+
+        std::vector<const void *> pointers(1, out);
+        pointers.insert(pointers.end(), inputs.begin(), inputs.end());
+        unsigned count = len;
+        std::vector<void *> args;
+        for (auto &p : pointers)
+            args.push_back(&p);
+        args.push_back(&count);
+
+        hipCheck(hipModuleLaunchKernel(function,
+                                         (len + THREADS_PER_BLOCK_X - 1)/THREADS_PER_BLOCK_X, 1, 1,
+                                         THREADS_PER_BLOCK_X, 1, 1,
+                                         0, stream, args.data(), nullptr), "fused");
+    }
+
+    size_t size() const {
+        return mKernels.size();
+    }
+};
+
+// Device executor which runs every operation as its own launch; it owns the device
+// temporaries, reused after reset(), and counts the bytes each pass moves
+class DeviceUnfused {
+    FusedEngine &mEngine;
+    size_t mLen;
+    hipStream_t mStream;
+    std::vector<std::unique_ptr<DeviceBO<float>>> mTemps;
+    size_t mNext;
+    size_t mBytes;
+
+public:
+    DeviceUnfused(FusedEngine &engine, size_t len, hipStream_t stream = 0) : mEngine(engine), mLen(len),
+                                                                           mStream(stream), mNext(0), mBytes(0) {}
+
+    template<typename E> expr::Vector run(const E &e) {
+        if (mNext == mTemps.size())
+            mTemps.emplace_back(new DeviceBO<float>(mLen));
+        float *temp = mTemps[mNext++]->get();
+        mEngine.run(temp, e, mLen, mStream);
+        mBytes += expr::fusedBytes(e, mLen);
+        return expr::Vector(nullptr, temp);
+    }
+
+    void reset() {
+        mNext = 0;
+        mBytes = 0;
+    }
+
+    // Bytes moved since the last reset
+    size_t bytes() const {
+        return mBytes;
+    }
+};
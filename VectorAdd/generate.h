@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "hostexec.h"
+#include "launch.h"
+#include "philox.h"
+
+// Reproducible benchmark inputs: input k of a kernel is Philox stream k of the run's
+// seed. Inputs are generated where they live, device memory by philox_fill in kernel.co
+// and host (or host mapped) memory by pinned host threads, and never need a host copy
+// for upload or validation.
+
+static const uint64_t DEFAULT_SEED = 0x2023;
+
+// dst[j] = element first + j of the stream for j < count
+inline void fillHost(float *dst, size_t first, size_t count, uint64_t seed, uint32_t stream)
+{
+    const size_t end = first + count;
+    size_t i = first;
+    for (; (i < end) && (i & 3); i++)
+        dst[i - first] = philoxUniform(seed, stream, i);
+    for (; i + 4 <= end; i += 4) {
+        const Philox4x32 bits = philoxBlock(seed, stream, i >> 2);
+        for (int j = 0; j < 4; j++)
+            dst[i - first + j] = philoxFloat(bits.v[j]);
+    }
+    for (; i < end; i++)
+        dst[i - first] = philoxUniform(seed, stream, i);
+}
+
+// Fill len elements from threads pinned to cpus
+inline void fillHost(const std::vector<int> &cpus, float *dst, size_t len, uint64_t seed, uint32_t stream)
+{
+    parallelFor(cpus, len, [&](size_t begin, size_t end) {
+        fillHost(dst + begin, begin, end - begin, seed, stream);
+    });
+}
+
+class DeviceGenerator {
+    hipFunction_t mFunction;
+
+public:
+    DeviceGenerator(HipDevice &device) : mFunction(device.getFunction("kernel.co", "philox_fill")) {}
+
+    void fill(float *dst, size_t len, uint64_t seed, uint32_t stream, hipStream_t hstream = 0) {
+        static const unsigned THREADS_PER_BLOCK_X = 256;
+        const size_t blocks = (len + 3) / 4;
+        PackedArgs args;
+        args.push(dst);
+        args.push(static_cast<unsigned>(len));
+        args.push(static_cast<unsigned>(seed));
+        args.push(static_cast<unsigned>(seed >> 32));
+        args.push(stream);
+        hipCheck(hipModuleLaunchKernel(mFunction,
+                                         (blocks + THREADS_PER_BLOCK_X - 1)/THREADS_PER_BLOCK_X, 1, 1,
+                                         THREADS_PER_BLOCK_X, 1, 1,
+                                         0, hstream, nullptr, args.config()), "philox_fill");
+    }
+};
@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+// Stand-in libamdhip64.so for machines without a GPU, enough to run the drivers'
+// host side and to exercise libhiptrace.so. There is one device whose memory is host
+// memory: allocations, copies and memsets work, modules load (a file must exist),
+// but kernels launched are not executed, so drivers which check kernel output fail.
+// Graph capture and IPC handles are not supported.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "hip/hip_runtime_api.h"
+
+namespace {
+
+static const size_t ALIGNMENT = 4096;
+static const size_t MEMORY = 0x100000000;
+
+static char stubModule;
+static char stubFunction;
+
+uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void *allocate(size_t size)
+{
+    return std::aligned_alloc(ALIGNMENT, std::max(ALIGNMENT, (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT));
+}
+}
+
+extern "C" {
+
+const char *hipGetErrorName(hipError_t hip_error)
+{
+    switch (hip_error) {
+    case hipSuccess:
+        return "hipSuccess";
+    case hipErrorInvalidValue:
+        return "hipErrorInvalidValue";
+    case hipErrorOutOfMemory:
+        return "hipErrorOutOfMemory";
+    case hipErrorInvalidDevice:
+        return "hipErrorInvalidDevice";
+    case hipErrorFileNotFound:
+        return "hipErrorFileNotFound";
+    case hipErrorNotSupported:
+        return "hipErrorNotSupported";
+    default:
+        return "hipErrorUnknown";
+    }
+}
+
+const char *hipGetErrorString(hipError_t hipError)
+{
+    switch (hipError) {
+    case hipSuccess:
+        return "no error";
+    case hipErrorNotSupported:
+        return "operation not supported by the stub runtime";
+    default:
+        return hipGetErrorName(hipError);
+    }
+}
+
+hipError_t hipDrvGetErrorString(hipError_t hipError, const char **errorString)
+{
+    *errorString = hipGetErrorString(hipError);
+    return hipSuccess;
+}
+
+hipError_t hipInit(unsigned int)
+{
+    return hipSuccess;
+}
+
+hipError_t hipGetDeviceCount(int *count)
+{
+    *count = 1;
+    return hipSuccess;
+}
+
+hipError_t hipSetDevice(int deviceId)
+{
+    return deviceId ? hipErrorInvalidDevice : hipSuccess;
+}
+
+hipError_t hipDeviceGet(hipDevice_t *device, int ordinal)
+{
+    if (ordinal)
+        return hipErrorInvalidDevice;
+    *device = 0;
+    return hipSuccess;
+}
+
+hipError_t hipDeviceGetName(char *name, int len, hipDevice_t)
+{
+    std::strncpy(name, "HIP stub device", len);
+    name[len - 1] = '\0';
+    return hipSuccess;
+}
+
+hipError_t hipDeviceGetUuid(hipUUID_t *uuid, hipDevice_t)
+{
+    std::memset(uuid, 0, sizeof(*uuid));
+    return hipSuccess;
+}
+
+hipError_t hipDeviceGetPCIBusId(char *pciBusId, int len, int device)
+{
+    if (device)
+        return hipErrorInvalidDevice;
+    std::strncpy(pciBusId, "0000:00:00.0", len);
+    pciBusId[len - 1] = '\0';
+    return hipSuccess;
+}
+
+hipError_t hipGetDeviceProperties(hipDeviceProp_t *prop, int deviceId)
+{
+    if (deviceId)
+        return hipErrorInvalidDevice;
+    std::memset(prop, 0, sizeof(*prop));
+    std::strcpy(prop->name, "HIP stub device");
+    std::strcpy(prop->gcnArchName, "gfx000");
+    prop->totalGlobalMem = MEMORY;
+    prop->maxThreadsPerBlock = 1024;
+    prop->multiProcessorCount = 8;
+    return hipSuccess;
+}
+
+hipError_t hipDeviceGetStreamPriorityRange(int *leastPriority, int *greatestPriority)
+{
+    *leastPriority = 0;
+    *greatestPriority = -1;
+    return hipSuccess;
+}
+
+hipError_t hipDeviceSynchronize()
+{
+    return hipSuccess;
+}
+
+hipError_t hipMalloc(void **ptr, size_t size)
+{
+    *ptr = allocate(size);
+    return *ptr ? hipSuccess : hipErrorOutOfMemory;
+}
+
+hipError_t hipFree(void *ptr)
+{
+    std::free(ptr);
+    return hipSuccess;
+}
+
+hipError_t hipHostMalloc(void **ptr, size_t size, unsigned int)
+{
+    return hipMalloc(ptr, size);
+}
+
+hipError_t hipHostFree(void *ptr)
+{
+    return hipFree(ptr);
+}
+
+hipError_t hipHostRegister(void *hostPtr, size_t, unsigned int)
+{
+    return hostPtr ? hipSuccess : hipErrorInvalidValue;
+}
+
+hipError_t hipHostUnregister(void *hostPtr)
+{
+    return hostPtr ? hipSuccess : hipErrorInvalidValue;
+}
+
+// Device and host share the address space
+hipError_t hipHostGetDevicePointer(void **devPtr, void *hostPtr, unsigned int)
+{
+    *devPtr = hostPtr;
+    return hipSuccess;
+}
+
+hipError_t hipMemcpy(void *dst, const void *src, size_t sizeBytes, hipMemcpyKind)
+{
+    std::memmove(dst, src, sizeBytes);
+    return hipSuccess;
+}
+
+hipError_t hipMemcpyAsync(void *dst, const void *src, size_t sizeBytes, hipMemcpyKind kind, hipStream_t)
+{
+    return hipMemcpy(dst, src, sizeBytes, kind);
+}
+
+hipError_t hipMemcpyWithStream(void *dst, const void *src, size_t sizeBytes, hipMemcpyKind kind, hipStream_t)
+{
+    return hipMemcpy(dst, src, sizeBytes, kind);
+}
+
+hipError_t hipMemset(void *dst, int value, size_t sizeBytes)
+{
+    std::memset(dst, value, sizeBytes);
+    return hipSuccess;
+}
+
+hipError_t hipModuleLoad(hipModule_t *module, const char *fname)
+{
+    if (!std::ifstream(fname))
+        return hipErrorFileNotFound;
+    *module = reinterpret_cast<hipModule_t>(&stubModule);
+    return hipSuccess;
+}
+
+hipError_t hipModuleLoadData(hipModule_t *module, const void *image)
+{
+    if (!image)
+        return hipErrorInvalidValue;
+    *module = reinterpret_cast<hipModule_t>(&stubModule);
+    return hipSuccess;
+}
+
+hipError_t hipModuleUnload(hipModule_t)
+{
+    return hipSuccess;
+}
+
+hipError_t hipModuleGetFunction(hipFunction_t *function, hipModule_t, const char *)
+{
+    *function = reinterpret_cast<hipFunction_t>(&stubFunction);
+    return hipSuccess;
+}
+
+const char *hipKernelNameRef(const hipFunction_t)
+{
+    return "stub";
+}
+
+// Accepted and dropped
+hipError_t hipModuleLaunchKernel(hipFunction_t f, unsigned int, unsigned int, unsigned int, unsigned int,
+                                 unsigned int, unsigned int, unsigned int, hipStream_t, void **kernelParams,
+                                 void **extra)
+{
+    return (f && (kernelParams || extra)) ? hipSuccess : hipErrorInvalidValue;
+}
+
+hipError_t hipStreamCreateWithFlags(hipStream_t *stream, unsigned int)
+{
+    *stream = reinterpret_cast<hipStream_t>(new char);
+    return hipSuccess;
+}
+
+hipError_t hipStreamCreateWithPriority(hipStream_t *stream, unsigned int flags, int)
+{
+    return hipStreamCreateWithFlags(stream, flags);
+}
+
+hipError_t hipExtStreamCreateWithCUMask(hipStream_t *stream, uint32_t, const uint32_t *)
+{
+    return hipStreamCreateWithFlags(stream, 0);
+}
+
+hipError_t hipStreamDestroy(hipStream_t stream)
+{
+    delete reinterpret_cast<char *>(stream);
+    return hipSuccess;
+}
+
+hipError_t hipStreamSynchronize(hipStream_t)
+{
+    return hipSuccess;
+}
+
+// An event is the time it was last recorded at, in ns
+hipError_t hipEventCreate(hipEvent_t *event)
+{
+    *event = reinterpret_cast<hipEvent_t>(new uint64_t(0));
+    return hipSuccess;
+}
+
+hipError_t hipEventCreateWithFlags(hipEvent_t *event, unsigned)
+{
+    return hipEventCreate(event);
+}
+
+hipError_t hipEventDestroy(hipEvent_t event)
+{
+    delete reinterpret_cast<uint64_t *>(event);
+    return hipSuccess;
+}
+
+hipError_t hipEventRecord(hipEvent_t event, hipStream_t)
+{
+    *reinterpret_cast<uint64_t *>(event) = now();
+    return hipSuccess;
+}
+
+hipError_t hipEventSynchronize(hipEvent_t)
+{
+    return hipSuccess;
+}
+
+hipError_t hipEventQuery(hipEvent_t)
+{
+    return hipSuccess;
+}
+
+hipError_t hipEventElapsedTime(float *ms, hipEvent_t start, hipEvent_t stop)
+{
+    *ms = (*reinterpret_cast<uint64_t *>(stop) - *reinterpret_cast<uint64_t *>(start)) / 1000000.0f;
+    return hipSuccess;
+}
+
+hipError_t hipStreamBeginCapture(hipStream_t, hipStreamCaptureMode)
+{
+    return hipErrorNotSupported;
+}
+
+hipError_t hipStreamEndCapture(hipStream_t, hipGraph_t *)
+{
+    return hipErrorNotSupported;
+}
+
+hipError_t hipGraphInstantiate(hipGraphExec_t *, hipGraph_t, hipGraphNode_t *, char *, size_t)
+{
+    return hipErrorNotSupported;
+}
+
+hipError_t hipGraphLaunch(hipGraphExec_t, hipStream_t)
+{
+    return hipErrorNotSupported;
+}
+
+hipError_t hipGraphExecDestroy(hipGraphExec_t)
+{
+    return hipErrorNotSupported;
+}
+
+hipError_t hipGraphDestroy(hipGraph_t)
+{
+    return hipErrorNotSupported;
+}
+
+hipError_t hipIpcGetMemHandle(hipIpcMemHandle_t *, void *)
+{
+    return hipErrorNotSupported;
+}
+
+hipError_t hipIpcOpenMemHandle(void **, hipIpcMemHandle_t, unsigned int)
+{
+    return hipErrorNotSupported;
+}
+
+hipError_t hipIpcCloseMemHandle(void *)
+{
+    return hipErrorNotSupported;
+}
+}
@@ -0,0 +1,519 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+// Call counts and latency histograms of the HIP entry points the drivers use, without
+// rocprof. Build libhiptrace.so and preload it:
+//
+//     LD_PRELOAD=./libhiptrace.so ./main
+//
+// Every wrapper times the call into the runtime and adds it to a table owned by the
+// calling thread, so recording takes no lock and no atomic read-modify-write. The
+// tables are merged and written to stderr, or to $HIPTRACE_OUTPUT, when the process
+// exits; a process which leaves with _exit() writes nothing.
+//
+// With HIPTRACE_RECORD=<file> the calls which allocate, load, launch, copy and sync
+// are also recorded for main-replay, see record.h. Arguments of launches which pass
+// kernelParams rather than a packed buffer are packed by the registered layout of the
+// kernel; launches of unregistered kernels that way are recorded without arguments.
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "record.h"
+#include "registry.h"
+
+namespace {
+
+// The traced entry points: name, parameter list, arguments forwarded
+#define HIP_TRACED(X)                                                   \
+    X(hipInit, (unsigned int flags), (flags))                           \
+    X(hipSetDevice, (int deviceId), (deviceId))                         \
+    X(hipMalloc, (void **ptr, size_t size), (ptr, size))                \
+    X(hipFree, (void *ptr), (ptr))                                      \
+    X(hipHostMalloc, (void **ptr, size_t size, unsigned int flags), (ptr, size, flags)) \
+    X(hipHostFree, (void *ptr), (ptr))                                  \
+    X(hipHostRegister, (void *hostPtr, size_t sizeBytes, unsigned int flags), (hostPtr, sizeBytes, flags)) \
+    X(hipHostUnregister, (void *hostPtr), (hostPtr))                    \
+    X(hipHostGetDevicePointer, (void **devPtr, void *hostPtr, unsigned int flags), (devPtr, hostPtr, flags)) \
+    X(hipMemcpy, (void *dst, const void *src, size_t sizeBytes, hipMemcpyKind kind), (dst, src, sizeBytes, kind)) \
+    X(hipMemcpyAsync, (void *dst, const void *src, size_t sizeBytes, hipMemcpyKind kind, hipStream_t stream), \
+      (dst, src, sizeBytes, kind, stream))                              \
+    X(hipMemcpyWithStream, (void *dst, const void *src, size_t sizeBytes, hipMemcpyKind kind, hipStream_t stream), \
+      (dst, src, sizeBytes, kind, stream))                              \
+    X(hipMemset, (void *dst, int value, size_t sizeBytes), (dst, value, sizeBytes)) \
+    X(hipModuleLoad, (hipModule_t *module, const char *fname), (module, fname)) \
+    X(hipModuleLoadData, (hipModule_t *module, const void *image), (module, image)) \
+    X(hipModuleGetFunction, (hipFunction_t *function, hipModule_t module, const char *kname), \
+      (function, module, kname))                                        \
+    X(hipModuleLaunchKernel, (hipFunction_t f, unsigned int gridDimX, unsigned int gridDimY, \
+                              unsigned int gridDimZ, unsigned int blockDimX, unsigned int blockDimY, \
+                              unsigned int blockDimZ, unsigned int sharedMemBytes, hipStream_t stream, \
+                              void **kernelParams, void **extra),       \
+      (f, gridDimX, gridDimY, gridDimZ, blockDimX, blockDimY, blockDimZ, sharedMemBytes, stream, \
+       kernelParams, extra))                                            \
+    X(hipDeviceSynchronize, (), ())                                     \
+    X(hipStreamCreateWithFlags, (hipStream_t *stream, unsigned int flags), (stream, flags)) \
+    X(hipStreamDestroy, (hipStream_t stream), (stream))                 \
+    X(hipStreamSynchronize, (hipStream_t stream), (stream))             \
+    X(hipEventCreateWithFlags, (hipEvent_t *event, unsigned flags), (event, flags)) \
+    X(hipEventDestroy, (hipEvent_t event), (event))                     \
+    X(hipEventRecord, (hipEvent_t event, hipStream_t stream), (event, stream)) \
+    X(hipEventSynchronize, (hipEvent_t event), (event))                 \
+    X(hipEventQuery, (hipEvent_t event), (event))                       \
+    X(hipGraphLaunch, (hipGraphExec_t graphExec, hipStream_t stream), (graphExec, stream)) \
+    X(hipIpcOpenMemHandle, (void **devPtr, hipIpcMemHandle_t handle, unsigned int flags), (devPtr, handle, flags)) \
+    X(hipIpcCloseMemHandle, (void *devPtr), (devPtr))
+
+#define TRACE_ENUM(name, params, args) API_##name,
+#define TRACE_NAME(name, params, args) #name,
+
+enum Api {
+    HIP_TRACED(TRACE_ENUM)
+    API_COUNT
+};
+
+static const char *NAMES[] = {
+    HIP_TRACED(TRACE_NAME)
+};
+
+// Bucket b counts calls which took [2^(b-1), 2^b) ns, bucket 0 those under 1 ns
+static const size_t BUCKETS = 40;
+
+uint64_t now()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+// Counters of one thread. Only the owner writes them, with plain loads and stores of
+// relaxed atomics, so the dump may read them while the thread keeps going.
+class ThreadTable {
+    struct Entry {
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> maximum;
+        std::atomic<uint64_t> histogram[BUCKETS];
+    };
+
+    Entry mEntries[API_COUNT];
+
+    static void add(std::atomic<uint64_t> &counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static std::atomic<ThreadTable *> &head() {
+        static std::atomic<ThreadTable *> tables(nullptr);
+        return tables;
+    }
+
+public:
+    ThreadTable *next;
+
+    ThreadTable() : next(nullptr) {
+        for (auto &entry : mEntries) {
+            entry.calls.store(0, std::memory_order_relaxed);
+            entry.total.store(0, std::memory_order_relaxed);
+            entry.maximum.store(0, std::memory_order_relaxed);
+            for (auto &bucket : entry.histogram)
+                bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Table of the calling thread, created on its first call; tables outlive their
+    // threads so that the dump still sees them
+    static ThreadTable &local() {
+        thread_local ThreadTable *table = nullptr;
+        if (!table) {
+            table = new ThreadTable();
+            table->next = head().load();
+            while (!head().compare_exchange_weak(table->next, table));
+        }
+        return *table;
+    }
+
+    static ThreadTable *first() {
+        return head().load();
+    }
+
+    void record(Api api, uint64_t ns) {
+        Entry &entry = mEntries[api];
+        add(entry.calls, 1);
+        add(entry.total, ns);
+        if (ns > entry.maximum.load(std::memory_order_relaxed))
+            entry.maximum.store(ns, std::memory_order_relaxed);
+        const size_t bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+        add(entry.histogram[bucket < BUCKETS ? bucket : BUCKETS - 1], 1);
+    }
+
+    // Add this thread's counts of api into the merged ones
+    void merge(Api api, uint64_t &calls, uint64_t &total, uint64_t &maximum, uint64_t *histogram) const {
+        const Entry &entry = mEntries[api];
+        calls += entry.calls.load(std::memory_order_relaxed);
+        total += entry.total.load(std::memory_order_relaxed);
+        const uint64_t longest = entry.maximum.load(std::memory_order_relaxed);
+        if (longest > maximum)
+            maximum = longest;
+        for (size_t b = 0; b < BUCKETS; b++)
+            histogram[b] += entry.histogram[b].load(std::memory_order_relaxed);
+    }
+};
+
+// Upper bound in us of the bucket holding the p-th percentile call
+double percentile(const uint64_t *histogram, uint64_t calls, double p)
+{
+    const uint64_t rank = static_cast<uint64_t>((p / 100.0) * (calls - 1));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; b++) {
+        seen += histogram[b];
+        if (seen > rank)
+            return (1ull << b) / 1000.0;
+    }
+    return (1ull << (BUCKETS - 1)) / 1000.0;
+}
+
+void dump()
+{
+    size_t threads = 0;
+    for (ThreadTable *table = ThreadTable::first(); table; table = table->next)
+        threads++;
+    if (!threads)
+        return;
+
+    const char *path = std::getenv("HIPTRACE_OUTPUT");
+    FILE *out = path ? std::fopen(path, "a") : nullptr;
+    if (!out)
+        out = stderr;
+    std::fprintf(out, "hiptrace: pid %d, %zu threads\n", getpid(), threads);
+    std::fprintf(out, "%-26s %10s %12s %10s %10s %10s %10s\n", "api", "calls", "total us", "mean us",
+                 "p50 us <", "p99 us <", "max us");
+    for (size_t a = 0; a < API_COUNT; a++) {
+        uint64_t calls = 0;
+        uint64_t total = 0;
+        uint64_t maximum = 0;
+        uint64_t histogram[BUCKETS] = {};
+        for (ThreadTable *table = ThreadTable::first(); table; table = table->next)
+            table->merge(static_cast<Api>(a), calls, total, maximum, histogram);
+        if (!calls)
+            continue;
+        std::fprintf(out, "%-26s %10llu %12.1f %10.3f %10.3f %10.3f %10.3f\n", NAMES[a],
+                     static_cast<unsigned long long>(calls), total / 1000.0, total / (1000.0 * calls),
+                     percentile(histogram, calls, 50.0), percentile(histogram, calls, 99.0), maximum / 1000.0);
+        // Latency histogram, one bucket per power of two ns
+        std::fprintf(out, "%-26s", "");
+        for (size_t b = 0; b < BUCKETS; b++) {
+            if (histogram[b])
+                std::fprintf(out, " <%gus:%llu", (1ull << b) / 1000.0, static_cast<unsigned long long>(histogram[b]));
+        }
+        std::fprintf(out, "\n");
+    }
+    if (out != stderr)
+        std::fclose(out);
+}
+
+RecordWriter *openRecording()
+{
+    const char *path = std::getenv("HIPTRACE_RECORD");
+    if (!path)
+        return nullptr;
+    try {
+        return new RecordWriter(path, now());
+    } catch (std::exception &e) {
+        std::fprintf(stderr, "hiptrace: not recording, %s\n", e.what());
+        return nullptr;
+    }
+}
+
+static RecordWriter *recorder = openRecording();
+
+// Registered layout of the functions looked up, nullptr for unregistered kernels
+static std::mutex functionMutex;
+static std::map<hipFunction_t, const KernelDesc *> functions;
+
+struct Dumper {
+    ~Dumper() {
+        delete recorder;
+        recorder = nullptr;
+        dump();
+    }
+};
+
+static Dumper dumper;
+
+// What capture() gets besides the arguments of the call
+struct Call {
+    uint64_t start;
+    uint64_t end;
+    hipError_t status;
+
+    template<typename T> void append(RecordType type, const T &payload, const void *extra = nullptr,
+                                     size_t extraBytes = 0) const {
+        recorder->append(type, start, end, status, payload, extra, extraBytes);
+    }
+};
+
+template<Api A> struct Tag {};
+
+uint64_t handle(const void *pointer)
+{
+    return reinterpret_cast<uintptr_t>(pointer);
+}
+
+// Calls which are not recorded
+template<Api A, typename... T> void capture(Tag<A>, const Call &, T...) {}
+
+// Out-parameters are only read back from calls which succeeded, a failed call may have
+// left them unset; the replay skips failed calls anyway
+template<typename T> uint64_t result(const Call &call, T *out)
+{
+    return (call.status == hipSuccess) ? handle(*out) : 0;
+}
+
+void alloc(const Call &call, uint64_t address, size_t bytes, MemoryKind kind)
+{
+    call.append(RecordType::Alloc, AllocPayload{address, bytes, static_cast<uint32_t>(kind), 0});
+}
+
+void release(const Call &call, const void *address, MemoryKind kind)
+{
+    call.append(RecordType::Free, FreePayload{handle(address), static_cast<uint32_t>(kind), 0});
+}
+
+void capture(Tag<API_hipMalloc>, const Call &call, void **ptr, size_t size)
+{
+    alloc(call, result(call, ptr), size, MemoryKind::Device);
+}
+
+void capture(Tag<API_hipFree>, const Call &call, void *ptr)
+{
+    release(call, ptr, MemoryKind::Device);
+}
+
+void capture(Tag<API_hipHostMalloc>, const Call &call, void **ptr, size_t size, unsigned int)
+{
+    alloc(call, result(call, ptr), size, MemoryKind::Host);
+}
+
+void capture(Tag<API_hipHostFree>, const Call &call, void *ptr)
+{
+    release(call, ptr, MemoryKind::Host);
+}
+
+void capture(Tag<API_hipHostRegister>, const Call &call, void *hostPtr, size_t sizeBytes, unsigned int)
+{
+    alloc(call, handle(hostPtr), sizeBytes, MemoryKind::Registered);
+}
+
+void capture(Tag<API_hipHostUnregister>, const Call &call, void *hostPtr)
+{
+    release(call, hostPtr, MemoryKind::Registered);
+}
+
+void capture(Tag<API_hipHostGetDevicePointer>, const Call &call, void **devPtr, void *hostPtr, unsigned int)
+{
+    call.append(RecordType::Map, MapPayload{handle(hostPtr), result(call, devPtr)});
+}
+
+void copy(const Call &call, void *dst, const void *src, size_t sizeBytes, hipMemcpyKind kind, hipStream_t stream,
+          CopyCall how)
+{
+    call.append(RecordType::Copy, CopyPayload{handle(dst), handle(src), sizeBytes, handle(stream),
+                                              static_cast<uint32_t>(kind), static_cast<uint32_t>(how)});
+}
+
+void capture(Tag<API_hipMemcpy>, const Call &call, void *dst, const void *src, size_t sizeBytes, hipMemcpyKind kind)
+{
+    copy(call, dst, src, sizeBytes, kind, nullptr, CopyCall::Memcpy);
+}
+
+void capture(Tag<API_hipMemcpyAsync>, const Call &call, void *dst, const void *src, size_t sizeBytes,
+             hipMemcpyKind kind, hipStream_t stream)
+{
+    copy(call, dst, src, sizeBytes, kind, stream, CopyCall::Async);
+}
+
+void capture(Tag<API_hipMemcpyWithStream>, const Call &call, void *dst, const void *src, size_t sizeBytes,
+             hipMemcpyKind kind, hipStream_t stream)
+{
+    copy(call, dst, src, sizeBytes, kind, stream, CopyCall::WithStream);
+}
+
+void capture(Tag<API_hipMemset>, const Call &call, void *dst, int value, size_t sizeBytes)
+{
+    call.append(RecordType::Memset, MemsetPayload{handle(dst), sizeBytes, value, 0});
+}
+
+// The code object goes into the recording so that the replay does not depend on files
+void capture(Tag<API_hipModuleLoad>, const Call &call, hipModule_t *module, const char *fname)
+{
+    if (call.status != hipSuccess) {
+        call.append(RecordType::Module, ModulePayload{0, 0});
+        return;
+    }
+    std::ifstream file(fname, std::ios::binary);
+    const std::vector<char> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    call.append(RecordType::Module, ModulePayload{handle(*module), image.size()}, image.data(), image.size());
+}
+
+void capture(Tag<API_hipModuleLoadData>, const Call &call, hipModule_t *module, const void *image)
+{
+    const size_t bytes = ((call.status == hipSuccess) && image) ? elfSize(image) : 0;
+    call.append(RecordType::Module, ModulePayload{result(call, module), bytes}, image, bytes);
+}
+
+void capture(Tag<API_hipModuleGetFunction>, const Call &call, hipFunction_t *function, hipModule_t module,
+             const char *kname)
+{
+    FunctionPayload payload = {result(call, function), handle(module), {}};
+    if (kname)
+        std::strncpy(payload.name, kname, sizeof(payload.name) - 1);
+    call.append(RecordType::Function, payload);
+    if (call.status != hipSuccess)
+        return;
+
+    const KernelDesc *desc = nullptr;
+    for (auto &registered : KernelRegistry::all()) {
+        if (!std::strcmp(registered.symbol, kname))
+            desc = &registered;
+    }
+    std::lock_guard<std::mutex> lock(functionMutex);
+    functions[*function] = desc;
+}
+
+void capture(Tag<API_hipModuleLaunchKernel>, const Call &call, hipFunction_t f, unsigned int gridDimX,
+             unsigned int gridDimY, unsigned int gridDimZ, unsigned int blockDimX, unsigned int blockDimY,
+             unsigned int blockDimZ, unsigned int sharedMemBytes, hipStream_t stream, void **kernelParams,
+             void **extra)
+{
+    LaunchPayload payload = {handle(f), handle(stream), {gridDimX, gridDimY, gridDimZ},
+                             {blockDimX, blockDimY, blockDimZ}, sharedMemBytes, 0, 0, 0};
+    const void *args = nullptr;
+    PackedArgs packed;
+    if (extra) {
+        for (size_t i = 0; extra[i] != HIP_LAUNCH_PARAM_END; i += 2) {
+            if (extra[i] == HIP_LAUNCH_PARAM_BUFFER_POINTER)
+                args = extra[i + 1];
+            else if (extra[i] == HIP_LAUNCH_PARAM_BUFFER_SIZE)
+                payload.argBytes = static_cast<uint32_t>(*static_cast<size_t *>(extra[i + 1]));
+        }
+    }
+    else if (kernelParams) {
+        const KernelDesc *desc = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(functionMutex);
+            auto it = functions.find(f);
+            if (it != functions.end())
+                desc = it->second;
+        }
+        if (desc) {
+            for (size_t i = 0; i < desc->args.size(); i++) {
+                switch (desc->args[i]) {
+                case ArgKind::Output:
+                case ArgKind::Input:
+                    packed.push(*static_cast<void **>(kernelParams[i]));
+                    break;
+                case ArgKind::Length:
+                    packed.push(*static_cast<unsigned *>(kernelParams[i]));
+                    break;
+                case ArgKind::Scalar:
+                    packed.push(*static_cast<float *>(kernelParams[i]));
+                    break;
+                }
+            }
+            args = packed.config()[1];
+            payload.argBytes = static_cast<uint32_t>(packed.size());
+        }
+    }
+    if (!args) {
+        payload.argBytes = 0;
+        payload.flags |= LaunchPayload::ARGS_MISSING;
+    }
+    call.append(RecordType::Launch, payload, args, payload.argBytes);
+}
+
+void capture(Tag<API_hipDeviceSynchronize>, const Call &call)
+{
+    call.append(RecordType::Sync, SyncPayload{0, static_cast<uint32_t>(SyncKind::Device), 0});
+}
+
+void capture(Tag<API_hipStreamSynchronize>, const Call &call, hipStream_t stream)
+{
+    call.append(RecordType::Sync, SyncPayload{handle(stream), static_cast<uint32_t>(SyncKind::Stream), 0});
+}
+
+void capture(Tag<API_hipEventSynchronize>, const Call &call, hipEvent_t event)
+{
+    call.append(RecordType::Sync, SyncPayload{handle(event), static_cast<uint32_t>(SyncKind::Event), 0});
+}
+
+void capture(Tag<API_hipEventRecord>, const Call &call, hipEvent_t event, hipStream_t stream)
+{
+    call.append(RecordType::EventRecord, HandlePayload{handle(event), handle(stream)});
+}
+
+void capture(Tag<API_hipGraphLaunch>, const Call &call, hipGraphExec_t graphExec, hipStream_t stream)
+{
+    call.append(RecordType::GraphLaunch, HandlePayload{handle(graphExec), handle(stream)});
+}
+
+// Memory of another process is replayed as a device allocation of the same size, found
+// with hipMemGetAddressRange; without the size it is left out and launches reading it
+// are skipped
+void capture(Tag<API_hipIpcOpenMemHandle>, const Call &call, void **devPtr, hipIpcMemHandle_t, unsigned int)
+{
+    typedef hipError_t (*AddressRange)(void **base, size_t *size, void *ptr);
+    static const AddressRange range = reinterpret_cast<AddressRange>(dlsym(RTLD_NEXT, "hipMemGetAddressRange"));
+    if ((call.status != hipSuccess) || !range)
+        return;
+    void *base = nullptr;
+    size_t bytes = 0;
+    if ((range(&base, &bytes, *devPtr) != hipSuccess) || (base != *devPtr) || !bytes)
+        return;
+    alloc(call, handle(*devPtr), bytes, MemoryKind::Device);
+}
+
+void capture(Tag<API_hipIpcCloseMemHandle>, const Call &call, void *devPtr)
+{
+    release(call, devPtr, MemoryKind::Device);
+}
+}
+
+// The library is built with hidden visibility so that its copy of the kernel registry
+// never merges with the executable's; only the wrappers are exported
+#define TRACE_WRAPPER(name, params, args)                               \
+    __attribute__((visibility("default"))) hipError_t name params       \
+    {                                                                   \
+        typedef hipError_t (*Next) params;                              \
+        static const Next next = reinterpret_cast<Next>(dlsym(RTLD_NEXT, #name)); \
+        if (!next)                                                      \
+            return hipErrorNotInitialized;                              \
+        const uint64_t start = now();                                   \
+        const hipError_t status = next args;                            \
+        const uint64_t end = now();                                     \
+        ThreadTable::local().record(API_##name, end - start);           \
+        if (recorder) {                                                 \
+            const Call call = {start, end, status};                     \
+            std::apply([&call](auto... values) {                        \
+                capture(Tag<API_##name>(), call, values...);            \
+            }, std::make_tuple args);                                   \
+        }                                                               \
+        return status;                                                  \
+    }
+
+extern "C" {
+HIP_TRACED(TRACE_WRAPPER)
+}
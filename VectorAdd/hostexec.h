@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+// Helpers for running kernels on host cores: CPU topology discovery, thread pinning and
+// host reference implementations of the device kernels
+
+// Parse a Linux cpulist such as "0-3,8,10-11"
+inline std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        const size_t dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+inline std::string readSysfsLine(const std::string &path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+inline std::vector<int> onlineCpus() {
+    std::vector<int> cpus = parseCpuList(readSysfsLine("/sys/devices/system/cpu/online"));
+    if (cpus.empty())
+        throw std::runtime_error("Unable to discover online CPUs");
+    return cpus;
+}
+
+// Online NUMA nodes, a machine without NUMA support is reported as node 0
+inline std::vector<int> numaNodes() {
+    std::vector<int> nodes = parseCpuList(readSysfsLine("/sys/devices/system/node/online"));
+    if (nodes.empty())
+        nodes.push_back(0);
+    return nodes;
+}
+
+// CPUs of a NUMA node; all online CPUs if the node is unknown (-1) or has no CPUs
+inline std::vector<int> nodeCpus(int node) {
+    std::vector<int> cpus;
+    if (node >= 0)
+        cpus = parseCpuList(readSysfsLine("/sys/devices/system/node/node" +
+                                          std::to_string(node) + "/cpulist"));
+    if (cpus.empty())
+        cpus = onlineCpus();
+    return cpus;
+}
+
+// CPUs of each NUMA node which has any
+inline std::vector<std::vector<int>> numaCpuGroups() {
+    std::vector<std::vector<int>> groups;
+    for (auto node : numaNodes()) {
+        std::vector<int> cpus = nodeCpus(node);
+        if (std::find(groups.begin(), groups.end(), cpus) == groups.end())
+            groups.push_back(cpus);
+    }
+    return groups;
+}
+
+// Split the online CPUs into count groups of (nearly) equal size
+inline std::vector<std::vector<int>> splitCpuGroups(size_t count) {
+    std::vector<int> cpus = onlineCpus();
+    if (count == 0 || count > cpus.size())
+        throw std::invalid_argument("Cannot split " + std::to_string(cpus.size()) +
+                                    " CPUs into " + std::to_string(count) + " groups");
+    std::vector<std::vector<int>> groups(count);
+    for (size_t i = 0; i < cpus.size(); i++)
+        groups[i * count / cpus.size()].push_back(cpus[i]);
+    return groups;
+}
+
+// Restrict the calling thread to the given CPUs
+inline void pinThread(const std::vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+        CPU_SET(cpu, &set);
+    const int ec = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ec)
+        throw std::system_error(ec, std::system_category(), "pthread_setaffinity_np");
+}
+
+// Run fn(begin, end) over [0, len) split across one thread pinned to each of the CPUs.
+// Used to first touch host buffers from the node they are meant to live on.
+template<typename F> void parallelFor(const std::vector<int> &cpus, size_t len, F fn) {
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < cpus.size(); t++) {
+        threads.push_back(std::thread([&cpus, &fn, t, len]() {
+            pinThread(std::vector<int>(1, cpus[t]));
+            fn(t * len / cpus.size(), (t + 1) * len / cpus.size());
+        }));
+    }
+    for (auto &thread : threads)
+        thread.join();
+}
+
+// parallelFor over threads created and pinned once, for running op after op in a timed
+// loop without paying thread creation and pinning in every op
+class WorkerPool {
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mStart;
+    std::condition_variable mDone;
+    std::function<void(size_t, size_t)> mTask;
+    size_t mLen = 0;
+    size_t mGeneration = 0;
+    size_t mPending = 0;
+    bool mStopping = false;
+
+    void work(size_t t) {
+        size_t seen = 0;
+        while (true) {
+            size_t len;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mStart.wait(lock, [&]() { return mStopping || (mGeneration != seen); });
+                if (mStopping)
+                    return;
+                seen = mGeneration;
+                len = mLen;
+            }
+            mTask(t * len / mThreads.size(), (t + 1) * len / mThreads.size());
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (--mPending == 0)
+                mDone.notify_one();
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mStart.notify_all();
+        for (auto &thread : mThreads)
+            thread.join();
+    }
+
+public:
+    WorkerPool(const std::vector<int> &cpus) {
+        // All threads exist before any of them reads mThreads.size()
+        std::unique_lock<std::mutex> lock(mMutex);
+        for (size_t t = 0; t < cpus.size(); t++)
+            mThreads.push_back(std::thread([this, t]() { work(t); }));
+        lock.unlock();
+        for (size_t t = 0; t < cpus.size(); t++) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[t], &set);
+            const int ec = pthread_setaffinity_np(mThreads[t].native_handle(), sizeof(set), &set);
+            if (ec) {
+                stop();
+                throw std::system_error(ec, std::system_category(), "pthread_setaffinity_np");
+            }
+        }
+    }
+
+    ~WorkerPool() {
+        stop();
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Run fn(begin, end) over [0, len) split across the pool's threads, as parallelFor
+    template<typename F> void run(size_t len, F fn) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mTask = std::ref(fn);
+        mLen = len;
+        mPending = mThreads.size();
+        mGeneration++;
+        mStart.notify_all();
+        mDone.wait(lock, [this]() { return mPending == 0; });
+        mTask = nullptr;
+    }
+};
+
+// Host equivalent of the vectoradd kernel in kernel.cpp
+inline void hostVectorAdd(float *__restrict__ aaa, const float *__restrict__ bbb,
+                          const float *__restrict__ ccc, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        aaa[i] = bbb[i] + ccc[i];
+}
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <numa.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+// Page backing of host buffers: base pages, transparent huge pages requested with
+// madvise, or 2 MiB/1 GiB pages from the hugetlbfs pool (see /proc/sys/vm/nr_hugepages)
+enum class PageSize {
+    Base,
+    Transparent,
+    Huge2M,
+    Huge1G
+};
+
+inline const char *pageSizeName(PageSize pages) {
+    switch (pages) {
+    case PageSize::Transparent:
+        return "thp";
+    case PageSize::Huge2M:
+        return "2m";
+    case PageSize::Huge1G:
+        return "1g";
+    default:
+        return "base";
+    }
+}
+
+inline PageSize parsePageSize(const std::string &name) {
+    if (name == "base")
+        return PageSize::Base;
+    if (name == "thp")
+        return PageSize::Transparent;
+    if (name == "2m")
+        return PageSize::Huge2M;
+    if (name == "1g")
+        return PageSize::Huge1G;
+    throw std::invalid_argument("Unknown page size " + name + ", expected base, thp, 2m or 1g");
+}
+
+// Abstraction of host buffer placed on a chosen NUMA node so we can do automatic buffer
+// deallocation (RAII). Pages are bound to the node but only populated on first touch or
+// by prefault(); node -1 leaves placement to the default first touch policy.
+template<typename T> class HostBO {
+    T *mBuffer;
+    size_t mSize;
+    int mNode;
+    PageSize mPages;
+    void *mMapping;
+    size_t mMapped;
+
+    static size_t alignUp(size_t value, size_t align) {
+        return (value + align - 1) / align * align;
+    }
+
+public:
+    HostBO(size_t size, int node = -1, PageSize pages = PageSize::Base) : mBuffer(nullptr), mSize(size),
+                                                                          mNode(node), mPages(pages),
+                                                                          mMapping(MAP_FAILED), mMapped(0) {
+        if ((node >= 0) && (numa_available() < 0))
+            throw std::runtime_error("NUMA placement requested on node " + std::to_string(node) +
+                                     " but NUMA is not available");
+
+        const size_t bytes = alignUp(size * sizeof(T), pageBytes());
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        if (pages == PageSize::Huge2M)
+            flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+        else if (pages == PageSize::Huge1G)
+            flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+
+        // Transparent huge pages are only used for 2 MiB aligned ranges so over allocate
+        // and trim the mapping to an aligned start
+        mMapped = (pages == PageSize::Transparent) ? bytes + pageBytes() : bytes;
+        mMapping = mmap(nullptr, mMapped, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mMapping == MAP_FAILED)
+            throw std::system_error(errno, std::system_category(),
+                                    std::string("mmap of ") + pageSizeName(pages) + " pages");
+        char *start = static_cast<char *>(mMapping);
+        if (pages == PageSize::Transparent) {
+            start = reinterpret_cast<char *>(alignUp(reinterpret_cast<uintptr_t>(start), pageBytes()));
+            if (madvise(start, bytes, MADV_HUGEPAGE)) {
+                const int error = errno;
+                munmap(mMapping, mMapped);
+                throw std::system_error(error, std::system_category(), "madvise(MADV_HUGEPAGE)");
+            }
+        }
+        if (node >= 0)
+            numa_tonode_memory(start, bytes, node);
+        mBuffer = reinterpret_cast<T *>(start);
+    }
+
+    ~HostBO() noexcept {
+        if (mMapping != MAP_FAILED)
+            munmap(mMapping, mMapped);
+    }
+
+    HostBO(const HostBO &) = delete;
+    HostBO &operator=(const HostBO &) = delete;
+
+    // Size of the pages backing the buffer
+    size_t pageBytes() const {
+        switch (mPages) {
+        case PageSize::Transparent:
+        case PageSize::Huge2M:
+            return 0x200000;
+        case PageSize::Huge1G:
+            return 0x40000000;
+        default:
+            return sysconf(_SC_PAGESIZE);
+        }
+    }
+
+    // Populate every page of the byte range [begin, end) now instead of on first touch;
+    // call from a thread on the buffer's node
+    void prefault(size_t begin = 0, size_t end = SIZE_MAX) const {
+        end = std::min(end, mSize * sizeof(T));
+        const size_t step = pageBytes();
+        begin = alignUp(begin, step);
+        if (begin >= end)
+            return;
+        char *start = reinterpret_cast<char *>(mBuffer);
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(start + begin, alignUp(end - begin, step), MADV_POPULATE_WRITE) == 0)
+            return;
+#endif
+        for (size_t offset = begin; offset < end; offset += step)
+            static_cast<volatile char *>(start)[offset] = 0;
+    }
+
+    T *get() const {
+        return mBuffer;
+    }
+
+    T &operator[](size_t i) const {
+        return mBuffer[i];
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+    int node() const {
+        return mNode;
+    }
+
+    PageSize pages() const {
+        return mPages;
+    }
+};
@@ -19,3 +19,140 @@ vectoradd(float* __restrict__ aaa, const float* __restrict__ bbb, const float* _
     int i = hipBlockDim_x * hipBlockIdx_x + hipThreadIdx_x;
     aaa[i] = bbb[i] + ccc[i];
 }
+
+// Device side check of vectoradd output, result is laid out as VerifyResult in verify.h:
+// mismatch count, first mismatching index and VERIFY_SAMPLES sampled indices
+#define VERIFY_SAMPLES 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+__global__ void
+vectoradd_verify(const float* __restrict__ aaa, const float* __restrict__ bbb, const float* __restrict__ ccc,
+                 unsigned len, unsigned* __restrict__ result);
+#ifdef __cplusplus
+}
+#endif
+
+__global__ void
+vectoradd_verify(const float* __restrict__ aaa, const float* __restrict__ bbb, const float* __restrict__ ccc,
+                 unsigned len, unsigned* __restrict__ result)
+{
+    unsigned i = hipBlockDim_x * hipBlockIdx_x + hipThreadIdx_x;
+    if ((i >= len) || (aaa[i] == bbb[i] + ccc[i]))
+        return;
+    unsigned n = atomicAdd(&result[0], 1u);
+    atomicMin(&result[1], i);
+    if (n < VERIFY_SAMPLES)
+        result[2 + n] = i;
+}
+
+// Fill dst with Philox uniforms of the given seed and stream, see philox.h; every thread
+// produces one block of four elements
+#include "philox.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+__global__ void
+philox_fill(float* __restrict__ dst, unsigned len, unsigned seedlo, unsigned seedhi, unsigned stream);
+#ifdef __cplusplus
+}
+#endif
+
+__global__ void
+philox_fill(float* __restrict__ dst, unsigned len, unsigned seedlo, unsigned seedhi, unsigned stream)
+{
+    unsigned block = hipBlockDim_x * hipBlockIdx_x + hipThreadIdx_x;
+    uint64_t seed = (static_cast<uint64_t>(seedhi) << 32) | seedlo;
+    Philox4x32 bits = philoxBlock(seed, stream, block);
+    for (unsigned j = 0; j < 4; j++) {
+        unsigned i = block * 4 + j;
+        if (i < len)
+            dst[i] = philoxFloat(bits.v[j]);
+    }
+}
+
+// Scatter a coalesced transfer, one block per ScatterEntry (see coalesce.h). Messages
+// are copied in words where source, destination and length allow and in bytes
+// otherwise.
+#include "scatter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+__global__ void
+scatter_copy(const unsigned char* __restrict__ staging, const ScatterEntry* __restrict__ table, unsigned count);
+#ifdef __cplusplus
+}
+#endif
+
+__global__ void
+scatter_copy(const unsigned char* __restrict__ staging, const ScatterEntry* __restrict__ table, unsigned count)
+{
+    if (hipBlockIdx_x >= count)
+        return;
+    ScatterEntry entry = table[hipBlockIdx_x];
+    const unsigned char* src = staging + entry.offset;
+    unsigned char* dst = reinterpret_cast<unsigned char*>(entry.dst);
+    unsigned words = 0;
+    if (((entry.dst | entry.offset) & 3) == 0) {
+        words = entry.bytes / 4;
+        for (unsigned i = hipThreadIdx_x; i < words; i += hipBlockDim_x)
+            reinterpret_cast<unsigned*>(dst)[i] = reinterpret_cast<const unsigned*>(src)[i];
+    }
+    for (unsigned i = words * 4 + hipThreadIdx_x; i < entry.bytes; i += hipBlockDim_x)
+        dst[i] = src[i];
+}
+
+// Ragged batch of vector additions in one launch (see segmented.h). offsets is the
+// exclusive prefix sum of the segment lengths, count + 1 entries ending with total. The
+// flattened element range is cut into equal tiles, one per block, so a few huge segments
+// spread over many blocks while runs of tiny ones share a block. Every block looks up
+// the segment its tile starts in once, threads then walk forward from there.
+#include "segments.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+__global__ void
+vectoradd_segmented(const Segment* __restrict__ segments, const unsigned* __restrict__ offsets,
+                    unsigned count, unsigned total);
+#ifdef __cplusplus
+}
+#endif
+
+__global__ void
+vectoradd_segmented(const Segment* __restrict__ segments, const unsigned* __restrict__ offsets,
+                    unsigned count, unsigned total)
+{
+    __shared__ unsigned first;
+    unsigned start = hipBlockIdx_x * hipBlockDim_x * SEGMENT_ITEMS;
+    if (hipThreadIdx_x == 0) {
+        // Last segment beginning at or before start
+        unsigned lo = 0;
+        unsigned hi = count - 1;
+        while (lo < hi) {
+            unsigned mid = (lo + hi + 1) / 2;
+            if (offsets[mid] <= start)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        first = lo;
+    }
+    __syncthreads();
+
+    unsigned s = first;
+    for (unsigned j = 0; j < SEGMENT_ITEMS; j++) {
+        unsigned i = start + j * hipBlockDim_x + hipThreadIdx_x;
+        if (i >= total)
+            return;
+        while (offsets[s + 1] <= i)
+            s++;
+        Segment segment = segments[s];
+        unsigned k = i - offsets[s];
+        reinterpret_cast<float*>(segment.aaa)[k] = reinterpret_cast<const float*>(segment.bbb)[k] +
+                                                   reinterpret_cast<const float*>(segment.ccc)[k];
+    }
+}
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+// Kernels the harnesses benchmark, see registry.h
+
+#include <algorithm>
+#include <cmath>
+
+#include "hostexec.h"
+#include "registry.h"
+
+namespace {
+
+static const unsigned THREADS_PER_BLOCK_X = 32;
+static const unsigned STREAM_THREADS_PER_BLOCK_X = 256;
+// STREAM's scalar
+static const float STREAM_SCALAR = 3.0f;
+
+LaunchGeometry perElement(size_t len)
+{
+    return LaunchGeometry{static_cast<unsigned>(len / THREADS_PER_BLOCK_X), THREADS_PER_BLOCK_X};
+}
+
+LaunchGeometry single(size_t)
+{
+    return LaunchGeometry{1, 1};
+}
+
+// STREAM kernels check their length so any length works
+LaunchGeometry perElementBounded(size_t len)
+{
+    return LaunchGeometry{static_cast<unsigned>((len + STREAM_THREADS_PER_BLOCK_X - 1) / STREAM_THREADS_PER_BLOCK_X),
+                          STREAM_THREADS_PER_BLOCK_X};
+}
+
+void vectoraddReference(float *out, const float *const *in, size_t len)
+{
+    hostVectorAdd(out, in[0], in[1], len);
+}
+
+void copyReference(float *out, const float *const *in, size_t len)
+{
+    std::copy(in[0], in[0] + len, out);
+}
+
+void scaleReference(float *out, const float *const *in, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        out[i] = STREAM_SCALAR * in[0][i];
+}
+
+void triadReference(float *out, const float *const *in, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        out[i] = std::fma(STREAM_SCALAR, in[1][i], in[0][i]);
+}
+
+}
+
+REGISTER_KERNEL(vectoradd, {"kernel.co", "vectoradd", {ArgKind::Output, ArgKind::Input, ArgKind::Input},
+                            perElement, 3 * sizeof(float), 1, vectoraddReference, "vectoradd_verify"});
+
+REGISTER_KERNEL(mynop, {"nop.co", "mynop", {ArgKind::Output, ArgKind::Input, ArgKind::Input},
+                        single, 0, 0, nullptr});
+
+// STREAM suite, bytes per element count every array read or written once
+REGISTER_KERNEL(stream_copy, {"stream.co", "stream_copy", {ArgKind::Output, ArgKind::Input, ArgKind::Length},
+                              perElementBounded, 2 * sizeof(float), 0, copyReference});
+
+REGISTER_KERNEL(stream_scale, {"stream.co", "stream_scale",
+                               {ArgKind::Output, ArgKind::Input, ArgKind::Scalar, ArgKind::Length},
+                               perElementBounded, 2 * sizeof(float), 1, scaleReference, nullptr, STREAM_SCALAR});
+
+REGISTER_KERNEL(stream_add, {"stream.co", "stream_add",
+                             {ArgKind::Output, ArgKind::Input, ArgKind::Input, ArgKind::Length},
+                             perElementBounded, 3 * sizeof(float), 1, vectoraddReference});
+
+REGISTER_KERNEL(stream_triad, {"stream.co", "stream_triad",
+                               {ArgKind::Output, ArgKind::Input, ArgKind::Input, ArgKind::Scalar, ArgKind::Length},
+                               perElementBounded, 3 * sizeof(float), 2, triadReference, nullptr, STREAM_SCALAR});
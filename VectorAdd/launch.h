@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+
+struct LaunchGeometry {
+    unsigned grid;
+    unsigned block;
+};
+
+// Kernel arguments packed once into the kernarg layout (each argument at its natural
+// alignment) and handed to hipModuleLaunchKernel through HIP_LAUNCH_PARAM_BUFFER_POINTER,
+// so repeated launches do not walk and copy a void *args[] array every time.
+class PackedArgs {
+    std::vector<char> mBuffer;
+    size_t mSize;
+    void *mConfig[5];
+
+public:
+    PackedArgs() : mSize(0) {
+        mConfig[0] = HIP_LAUNCH_PARAM_BUFFER_POINTER;
+        mConfig[1] = nullptr;
+        mConfig[2] = HIP_LAUNCH_PARAM_BUFFER_SIZE;
+        mConfig[3] = &mSize;
+        mConfig[4] = HIP_LAUNCH_PARAM_END;
+    }
+
+    // mConfig points into this object
+    PackedArgs(const PackedArgs &) = delete;
+    PackedArgs &operator=(const PackedArgs &) = delete;
+
+    void clear() {
+        mBuffer.clear();
+        mSize = 0;
+    }
+
+    template <typename T> void push(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "kernel arguments are copied bytewise");
+        const size_t offset = (mSize + alignof(T) - 1) / alignof(T) * alignof(T);
+        mBuffer.resize(offset + sizeof(T));
+        std::memcpy(mBuffer.data() + offset, &value, sizeof(T));
+        mSize = mBuffer.size();
+        mConfig[1] = mBuffer.data();
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+    // Pass as the extra argument of hipModuleLaunchKernel with kernelParams nullptr
+    void **config() {
+        return mConfig;
+    }
+};
+
+// Typed handle of a kernel taking Args. The argument types are checked when the
+// arguments are bound, which packs them once; launch() then only submits.
+//
+//    Kernel<float *, const float *, const float *> vadd(function, a, b, c);
+//    vadd.launch(geometry, stream);
+template <typename... Args>
+class Kernel {
+    hipFunction_t mFunction;
+    const char *mName;
+    PackedArgs mArgs;
+
+public:
+    Kernel(hipFunction_t function, Args... args) : mFunction(function), mName(hipKernelNameRef(function)) {
+        bind(args...);
+    }
+
+    // Repack with new argument values, e.g. to retarget the kernel at other buffers
+    void bind(Args... args) {
+        mArgs.clear();
+        (mArgs.push(args), ...);
+    }
+
+    void launch(const LaunchGeometry &geometry, hipStream_t stream = 0, unsigned sharedBytes = 0) {
+        hipCheck(hipModuleLaunchKernel(mFunction,
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         sharedBytes, stream, nullptr, mArgs.config()), mName);
+    }
+
+    size_t argBytes() const {
+        return mArgs.size();
+    }
+
+    hipFunction_t function() const {
+        return mFunction;
+    }
+};
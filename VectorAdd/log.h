@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Logging for worker threads which must not wait on std::cout. Every thread appends
+// whole records to its own preallocated ring without taking a lock; a background thread
+// (or stop) merges the rings by timestamp and writes the records out, so the output of
+// concurrent workers is never interleaved mid line and costs them only a memcpy.
+//
+//     LogLine() << "Running " << name << ' ' << loops << " times";
+//
+// A record which does not fit into a full ring is dropped and counted, never waited for.
+
+struct LogRecord {
+    static const size_t TEXT = 232;
+
+    uint64_t time;
+    uint32_t thread;
+    uint32_t length;
+    char text[TEXT];
+};
+
+// Single producer, single consumer ring of records owned by one thread
+class ThreadLog {
+    static const size_t CAPACITY = 1024;
+
+    std::unique_ptr<LogRecord[]> mRecords;
+    // Written by the owner only
+    std::atomic<uint64_t> mHead;
+    // Written by the flusher only
+    std::atomic<uint64_t> mTail;
+    // While a record is being written, a time no later than its timestamp, otherwise 0
+    std::atomic<uint64_t> mBusy;
+    std::atomic<uint64_t> mDropped;
+    const uint32_t mThread;
+
+public:
+    ThreadLog *next;
+
+    ThreadLog(uint32_t thread) : mRecords(new LogRecord[CAPACITY]), mHead(0), mTail(0), mBusy(0), mDropped(0),
+                                 mThread(thread), next(nullptr) {}
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void append(const char *text, size_t length) {
+        const uint64_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) == CAPACITY) {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        mBusy.store(now());
+        LogRecord &record = mRecords[head % CAPACITY];
+        record.time = now();
+        record.thread = mThread;
+        record.length = std::min(length, LogRecord::TEXT);
+        std::memcpy(record.text, text, record.length);
+        mHead.store(head + 1, std::memory_order_release);
+        mBusy.store(0);
+    }
+
+    // Lowest timestamp a record not yet published may still get, the flusher must not
+    // emit anything later than that from the other rings
+    uint64_t pending() const {
+        return mBusy.load();
+    }
+
+    // Move the published records with timestamps up to cut into out
+    void drain(uint64_t cut, std::vector<LogRecord> &out) {
+        uint64_t tail = mTail.load(std::memory_order_relaxed);
+        const uint64_t head = mHead.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            const LogRecord &record = mRecords[tail % CAPACITY];
+            if (record.time > cut)
+                break;
+            out.push_back(record);
+        }
+        mTail.store(tail, std::memory_order_release);
+    }
+
+    uint64_t dropped() const {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+};
+
+class Logger {
+    std::atomic<ThreadLog *> mLogs;
+    std::atomic<uint32_t> mThreads;
+    const uint64_t mStart;
+    std::ostream *mOut;
+    std::mutex mFlushMutex;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    bool mRunning;
+    std::thread mFlusher;
+    uint64_t mReportedDrops;
+
+    Logger() : mLogs(nullptr), mThreads(0), mStart(ThreadLog::now()), mOut(&std::cout), mRunning(false),
+               mReportedDrops(0) {}
+
+    ~Logger() {
+        stop();
+        for (ThreadLog *log = mLogs.load(); log;) {
+            ThreadLog *next = log->next;
+            delete log;
+            log = next;
+        }
+    }
+
+public:
+    static Logger &instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    // Ring of the calling thread, created on its first record; rings outlive their
+    // threads so that nothing logged before a thread exits is lost
+    ThreadLog &local() {
+        thread_local ThreadLog *log = nullptr;
+        if (!log) {
+            log = new ThreadLog(mThreads.fetch_add(1));
+            log->next = mLogs.load();
+            while (!mLogs.compare_exchange_weak(log->next, log));
+        }
+        return *log;
+    }
+
+    // Write every record committed before now, in timestamp order
+    void flush() {
+        std::lock_guard<std::mutex> lock(mFlushMutex);
+        uint64_t cut = ThreadLog::now();
+        for (ThreadLog *log = mLogs.load(); log; log = log->next) {
+            const uint64_t pending = log->pending();
+            if (pending)
+                cut = std::min(cut, pending - 1);
+        }
+        std::vector<LogRecord> records;
+        uint64_t dropped = 0;
+        for (ThreadLog *log = mLogs.load(); log; log = log->next) {
+            log->drain(cut, records);
+            dropped += log->dropped();
+        }
+        std::stable_sort(records.begin(), records.end(), [](const LogRecord &a, const LogRecord &b) {
+            return a.time < b.time;
+        });
+
+        std::string text;
+        for (auto &record : records) {
+            char prefix[48];
+            const int length = std::snprintf(prefix, sizeof(prefix), "[%10.3f ms t%u] ",
+                                             (record.time - mStart) / 1000000.0, record.thread);
+            const char *line = record.text;
+            const char *end = record.text + record.length;
+            // Every line of a multi line record gets the prefix
+            while (line < end) {
+                const char *stop = std::find(line, end, '\n');
+                text.append(prefix, length);
+                text.append(line, stop);
+                text += '\n';
+                line = stop + 1;
+            }
+            if (record.length == 0) {
+                text.append(prefix, length);
+                text += '\n';
+            }
+        }
+        if (dropped != mReportedDrops) {
+            text += "[log] " + std::to_string(dropped - mReportedDrops) + " records dropped, ring full\n";
+            mReportedDrops = dropped;
+        }
+        if (!text.empty()) {
+            mOut->write(text.data(), text.size());
+            mOut->flush();
+        }
+    }
+
+    // Flush from a background thread every period until stop()
+    void start(std::chrono::milliseconds period = std::chrono::milliseconds(20), std::ostream &out = std::cout) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mRunning)
+            return;
+        mOut = &out;
+        mRunning = true;
+        mFlusher = std::thread([this, period]() {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while (mRunning) {
+                mWake.wait_for(lock, period);
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        });
+    }
+
+    // Stop the background thread and write out everything logged so far
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRunning = false;
+        }
+        mWake.notify_one();
+        if (mFlusher.joinable())
+            mFlusher.join();
+        flush();
+    }
+};
+
+// One record, formatted into a fixed buffer on the stack and committed to the calling
+// thread's ring when the statement ends. Text beyond LogRecord::TEXT is cut off.
+class LogLine {
+    char mText[LogRecord::TEXT];
+    size_t mLength;
+
+    void put(const char *text, size_t length) {
+        length = std::min(length, sizeof(mText) - mLength);
+        std::memcpy(mText + mLength, text, length);
+        mLength += length;
+    }
+
+public:
+    LogLine() : mLength(0) {}
+
+    ~LogLine() {
+        Logger::instance().local().append(mText, mLength);
+    }
+
+    LogLine(const LogLine &) = delete;
+    LogLine &operator=(const LogLine &) = delete;
+
+    LogLine &operator<<(const char *text) {
+        put(text, std::strlen(text));
+        return *this;
+    }
+
+    LogLine &operator<<(const std::string &text) {
+        put(text.data(), text.size());
+        return *this;
+    }
+
+    LogLine &operator<<(char c) {
+        put(&c, 1);
+        return *this;
+    }
+
+    template<typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    LogLine &operator<<(T value) {
+        char buffer[24];
+        const std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        put(buffer, result.ptr - buffer);
+        return *this;
+    }
+
+    // Same rendering as an ostream with default flags
+    LogLine &operator<<(double value) {
+        char buffer[32];
+        const int length = std::snprintf(buffer, sizeof(buffer), "%g", value);
+        put(buffer, std::max(0, length));
+        return *this;
+    }
+
+    LogLine &operator<<(const void *pointer) {
+        char buffer[24];
+        const int length = std::snprintf(buffer, sizeof(buffer), "%p", pointer);
+        put(buffer, std::max(0, length));
+        return *this;
+    }
+};
@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "launch.h"
+
+namespace {
+
+static const int LOOP = 10000;
+static const int WARMUP = 100;
+static const int MAX_ARGS = 30;
+
+static int loops = LOOP;
+
+template <typename T, size_t> using Repeat = T;
+
+// Kernel<float *, ... N times> bound to the first N buffers
+template <size_t... I>
+std::unique_ptr<Kernel<Repeat<float *, I>...>> makekernel(hipFunction_t function, const std::vector<float *> &buffers,
+                                                        std::index_sequence<I...>)
+{
+    return std::unique_ptr<Kernel<Repeat<float *, I>...>>(new Kernel<Repeat<float *, I>...>(function, buffers[I]...));
+}
+
+template <typename K, size_t... I>
+void rebind(K &kernel, const std::vector<float *> &buffers, std::index_sequence<I...>)
+{
+    kernel.bind(buffers[I]...);
+}
+
+struct Sample {
+    long long submit;
+    long long total;
+};
+
+// Launch loops times with launch(), return the time to submit all of them and the time
+// until they retired
+template <typename F> Sample measure(F launch)
+{
+    for (int i = 0; i < WARMUP; i++)
+        launch();
+    hipCheck(hipDeviceSynchronize());
+
+    Timer timer;
+    for (int i = 0; i < loops; i++)
+        launch();
+    Sample sample;
+    sample.submit = timer.stop();
+    hipCheck(hipDeviceSynchronize());
+    sample.total = timer.stop();
+    return sample;
+}
+
+void report(int count, const char *mode, size_t bytes, const Sample &sample)
+{
+    std::cout << std::setw(6) << count << std::setw(10) << mode << std::setw(8) << bytes
+              << std::setw(14) << std::fixed << std::setprecision(3) << double(sample.submit)/loops
+              << std::setw(14) << double(sample.total)/loops << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+// Compare the kernelParams path, where the runtime walks the void *args[] array and
+// copies every argument into a kernarg block on each launch, with launching a typed
+// Kernel whose argument block was packed once
+template <size_t N>
+void compare(HipDevice &hdevice, const char *symbol, const std::vector<float *> &buffers)
+{
+    hipFunction_t function = hdevice.getFunction("nop.co", symbol);
+    const LaunchGeometry geometry = {1, 1};
+
+    std::vector<void *> args;
+    for (size_t i = 0; i < N; i++)
+        args.push_back(const_cast<float **>(&buffers[i]));
+    Sample array = measure([&]() {
+        hipCheck(hipModuleLaunchKernel(function,
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         0, 0, args.data(), nullptr), symbol);
+    });
+    report(N, "array", N * sizeof(float *), array);
+
+    auto kernel = makekernel(function, buffers, std::make_index_sequence<N>());
+    Sample packed = measure([&]() {
+        kernel->launch(geometry);
+    });
+    report(N, "packed", kernel->argBytes(), packed);
+
+    // Repacking before every launch, what a wrapper without a persistent argument block
+    // would pay on top of the packed path
+    Sample repacked = measure([&]() {
+        rebind(*kernel, buffers, std::make_index_sequence<N>());
+        kernel->launch(geometry);
+    });
+    report(N, "repacked", kernel->argBytes(), repacked);
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+
+    // The kernels never dereference their arguments, the buffers only give them
+    // realistic values
+    std::vector<std::unique_ptr<DeviceBO<float>>> deviceBuffers;
+    std::vector<float *> buffers;
+    for (int i = 0; i < MAX_ARGS; i++) {
+        deviceBuffers.emplace_back(new DeviceBO<float>(1));
+        buffers.push_back(deviceBuffers.back()->get());
+    }
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Argument marshalling cost of empty kernels over " << loops << " launches" << std::endl;
+    std::cout << std::setw(6) << "args" << std::setw(10) << "mode" << std::setw(8) << "bytes"
+              << std::setw(14) << "submit us" << std::setw(14) << "total us" << std::endl;
+    compare<3>(hdevice, "mynop", buffers);
+    compare<MAX_ARGS>(hdevice, "mynop30", buffers);
+    std::cout << "PASSED" << std::endl;
+    return 0;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "l:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            loops = std::max(1, std::atoi(optarg));
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-l <loops>]\n";
+            std::cout << "  -l <loops>  Launches per measurement (default: " << LOOP << ")\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
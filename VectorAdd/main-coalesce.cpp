@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "coalesce.h"
+#include "hostexec.h"
+#include "hostmem.h"
+
+namespace {
+
+static const size_t MIN_MESSAGE = 16;
+static const size_t MAX_MESSAGE = 0x10000;
+// Payload per measurement and its cap in messages
+static const size_t PAYLOAD = 0x4000000;
+static const size_t MAX_MESSAGES = 0x10000;
+
+static const size_t DEFAULT_FLUSH_BYTES = 0x400000;
+static const size_t DEFAULT_MAX_ENTRIES = 0x4000;
+static const long long DEFAULT_DEADLINE_US = 100;
+
+static CoalescingUploader::Policy policy = {DEFAULT_FLUSH_BYTES, DEFAULT_MAX_ENTRIES, DEFAULT_DEADLINE_US};
+
+// Messages are consecutive slices of the source, each going to the same offset of the
+// destination, as a client sending many small vectors would
+struct Workload {
+    size_t size;
+    size_t count;
+
+    size_t bytes() const {
+        return size * count;
+    }
+};
+
+void report(const char *method, const Workload &load, long long delay, size_t transfers)
+{
+    std::cout << std::setw(10) << method << std::setw(10) << load.size << std::setw(10) << load.count
+              << std::setw(12) << transfers << std::setw(12) << delay << std::fixed << std::setprecision(2)
+              << std::setw(10) << double(load.bytes())/(delay * 1000.0) << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+// Compare the destination with the source in one transfer, then clear it
+int validate(const Workload &load, const char *src, char *dst, std::vector<char> &check)
+{
+    hipCheck(hipMemcpy(check.data(), dst, load.bytes(), hipMemcpyDeviceToHost));
+    hipCheck(hipMemset(dst, 0, load.bytes()));
+    return std::memcmp(check.data(), src, load.bytes()) ? 1 : 0;
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+
+    const int hostNode = hdevice.numaNode();
+    pinThread(nodeCpus(hostNode));
+
+    // Pageable client memory
+    HostBO<char> source(PAYLOAD, hostNode);
+    for (size_t i = 0; i < PAYLOAD; i++)
+        source[i] = static_cast<char>(i * 7 + (i >> 8));
+    DeviceBO<char> destination(PAYLOAD);
+    hipCheck(hipMemset(destination.get(), 0, PAYLOAD));
+    std::vector<char> check(PAYLOAD);
+
+    hipStream_t stream;
+    hipCheck(hipStreamCreateWithFlags(&stream, hipStreamNonBlocking));
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Effective H2D bandwidth of small messages, flush at " << policy.flushBytes << " bytes, "
+              << policy.maxEntries << " messages or " << policy.deadlineUs << " us" << std::endl;
+    std::cout << std::setw(10) << "method" << std::setw(10) << "bytes" << std::setw(10) << "messages"
+              << std::setw(12) << "transfers" << std::setw(12) << "us" << std::setw(10) << "GB/s" << std::endl;
+
+    int errors = 0;
+    for (size_t size = MIN_MESSAGE; size <= MAX_MESSAGE; size *= 4) {
+        const Workload load = {size, std::min(MAX_MESSAGES, PAYLOAD / size)};
+
+        Timer timer;
+        for (size_t i = 0; i < load.count; i++)
+            hipCheck(hipMemcpyAsync(destination.get() + i * size, source.get() + i * size, size,
+                                    hipMemcpyHostToDevice, stream));
+        hipCheck(hipStreamSynchronize(stream));
+        report("direct", load, timer.stop(), load.count);
+        errors += validate(load, source.get(), destination.get(), check);
+
+        CoalescingUploader uploader(hdevice, stream, policy);
+        timer.reset();
+        for (size_t i = 0; i < load.count; i++)
+            uploader.submit(destination.get() + i * size, source.get() + i * size, size);
+        uploader.finish();
+        report("coalesced", load, timer.stop(), uploader.transfers());
+        errors += validate(load, source.get(), destination.get(), check);
+    }
+
+    hipCheck(hipStreamDestroy(stream));
+    if (errors)
+        std::cout << "FAILED" << std::endl;
+    else
+        std::cout << "PASSED" << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "b:e:t:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            policy.flushBytes = std::strtoul(optarg, nullptr, 0);
+            break;
+        case 'e':
+            policy.maxEntries = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 't':
+            policy.deadlineUs = std::strtoll(optarg, nullptr, 0);
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-b <bytes>] [-e <messages>] [-t <us>]\n";
+            std::cout << "  -b <bytes>     Flush a batch at this many bytes (default: " << DEFAULT_FLUSH_BYTES << ")\n";
+            std::cout << "  -e <messages>  Flush a batch at this many messages (default: " << DEFAULT_MAX_ENTRIES << ")\n";
+            std::cout << "  -t <us>        Flush a batch once its oldest message waited this long (default: "
+                      << DEFAULT_DEADLINE_US << ")\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,419 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "hostexec.h"
+#include "registry.h"
+#include "service.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+static const long long DEFAULT_SLO_US = 1000;
+static const size_t DEFAULT_MAX_BATCH = 0x1000000;
+// Weight of the newest batch in the service time estimate
+static const double EWMA_WEIGHT = 0.125;
+
+static std::string socketPath = defaultSocketPath();
+static long long sloUs = DEFAULT_SLO_US;
+static size_t maxBatch = DEFAULT_MAX_BATCH;
+
+static volatile sig_atomic_t stopping = 0;
+
+void onsignal(int)
+{
+    stopping = 1;
+}
+
+long long elapsedUs(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+// A client which went away before its response was sent is dropped on its next poll
+void respond(int fd, const ServiceResponse &response)
+{
+    try {
+        sendMessage(fd, &response, sizeof(response));
+    } catch (std::system_error &e) {
+        if ((e.code().value() != EPIPE) && (e.code().value() != ECONNRESET))
+            throw;
+    }
+}
+
+struct Connection {
+    int fd;
+    uint64_t nextHandle;
+    std::map<uint64_t, std::shared_ptr<SharedMapping>> mappings;
+};
+
+// Holds on to the mapping its operands point into, so an Unmap of a handle with requests
+// still queued leaves them valid until they have run
+struct Pending {
+    Connection *connection;
+    std::shared_ptr<SharedMapping> mapping;
+    uint64_t id;
+    float *aaa;
+    const float *bbb;
+    const float *ccc;
+    uint32_t len;
+    Clock::time_point arrival;
+};
+
+// Runs a batch of requests as one vectoradd launch: inputs are gathered into pinned
+// staging, copied up in one transfer per operand, added, and the results copied down and
+// scattered back into the clients' shared memory
+class BatchRunner {
+    const KernelDesc &mDesc;
+    hipFunction_t mFunction;
+    hipStream_t mStream;
+    size_t mCapacity;
+    float *mStaging[3];
+    std::unique_ptr<DeviceBO<float>> mDevice[3];
+    // Moving average of the batch service time, used to size the batching window
+    double mServiceUs;
+    size_t mBatches;
+    size_t mRequests;
+
+    // vectoradd covers its length with whole blocks, pad to a multiple of them
+    size_t padded(size_t len) const {
+        const LaunchGeometry geometry = mDesc.geometry(1);
+        const size_t granule = std::max(1u, geometry.block);
+        return (len + granule - 1) / granule * granule;
+    }
+
+    void reserve(size_t len) {
+        if (len <= mCapacity)
+            return;
+        release();
+        mCapacity = std::max(len, 2 * mCapacity);
+        for (int i = 0; i < 3; i++) {
+            hipCheck(hipHostMalloc((void **)&mStaging[i], mCapacity * sizeof(float), hipHostMallocDefault));
+            std::memset(mStaging[i], 0, mCapacity * sizeof(float));
+            mDevice[i].reset(new DeviceBO<float>(mCapacity));
+        }
+    }
+
+    void release() {
+        for (int i = 0; i < 3; i++) {
+            if (mStaging[i])
+                (void)hipHostFree(mStaging[i]);
+            mStaging[i] = nullptr;
+            mDevice[i].reset();
+        }
+    }
+
+public:
+    BatchRunner(HipDevice &device) : mDesc(KernelRegistry::find("vectoradd")),
+                                     mFunction(device.getFunction(mDesc.codeObject, mDesc.symbol)),
+                                     mStream(nullptr), mCapacity(0), mStaging{nullptr, nullptr, nullptr},
+                                     mServiceUs(0), mBatches(0), mRequests(0) {
+        hipCheck(hipStreamCreateWithFlags(&mStream, hipStreamNonBlocking));
+    }
+
+    ~BatchRunner() {
+        release();
+        (void)hipStreamDestroy(mStream);
+    }
+
+    void run(const std::vector<Pending> &batch) {
+        const Clock::time_point start = Clock::now();
+        size_t total = 0;
+        for (auto &request : batch)
+            total += request.len;
+        const size_t len = padded(total);
+        reserve(len);
+
+        size_t offset = 0;
+        for (auto &request : batch) {
+            std::memcpy(mStaging[1] + offset, request.bbb, request.len * sizeof(float));
+            std::memcpy(mStaging[2] + offset, request.ccc, request.len * sizeof(float));
+            offset += request.len;
+        }
+        for (int i = 1; i < 3; i++)
+            hipCheck(hipMemcpyAsync(mDevice[i]->get(), mStaging[i], len * sizeof(float), hipMemcpyHostToDevice, mStream));
+
+        const std::vector<void *> slots = {mDevice[0]->get(), mDevice[1]->get(), mDevice[2]->get()};
+        KernelArgs args(mDesc, slots, len);
+        const LaunchGeometry geometry = mDesc.geometry(len);
+        hipCheck(hipModuleLaunchKernel(mFunction,
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         0, mStream, nullptr, args.config()), mDesc.symbol);
+        hipCheck(hipMemcpyAsync(mStaging[0], mDevice[0]->get(), total * sizeof(float), hipMemcpyDeviceToHost, mStream));
+        hipCheck(hipStreamSynchronize(mStream));
+
+        offset = 0;
+        for (auto &request : batch) {
+            std::memcpy(request.aaa, mStaging[0] + offset, request.len * sizeof(float));
+            offset += request.len;
+        }
+
+        const Clock::time_point end = Clock::now();
+        const uint64_t serviceUs = elapsedUs(start, end);
+        mServiceUs = mBatches ? (1 - EWMA_WEIGHT) * mServiceUs + EWMA_WEIGHT * serviceUs : serviceUs;
+        mBatches++;
+        mRequests += batch.size();
+
+        for (auto &request : batch) {
+            ServiceResponse response = {request.id, 0, static_cast<uint32_t>(batch.size()), 0,
+                                        static_cast<uint64_t>(elapsedUs(request.arrival, start)), serviceUs};
+            respond(request.connection->fd, response);
+        }
+    }
+
+    // How long the first request of a batch may wait for company and still make the SLO
+    long long windowUs() const {
+        return std::max(0LL, sloUs - static_cast<long long>(mServiceUs));
+    }
+
+    size_t batches() const {
+        return mBatches;
+    }
+
+    size_t requests() const {
+        return mRequests;
+    }
+};
+
+class Daemon {
+    BatchRunner mRunner;
+    int mListen;
+    std::vector<std::unique_ptr<Connection>> mConnections;
+    std::vector<Pending> mPending;
+    size_t mPendingElements;
+
+    void reply(Connection &connection, const ServiceRequest &request, int status, uint64_t handle = 0) {
+        ServiceResponse response = {request.id, status, 0, handle, 0, 0};
+        respond(connection.fd, response);
+    }
+
+    void handle(Connection &connection, const ServiceRequest &request, int fd) {
+        if (request.magic != SERVICE_MAGIC) {
+            reply(connection, request, -EPROTO);
+            return;
+        }
+        switch (request.op) {
+        case ServiceOp::Map: {
+            if (fd < 0) {
+                reply(connection, request, -EBADF);
+                return;
+            }
+            // Access past the end of the file would raise SIGBUS in the daemon, so the file
+            // must be sealed against shrinking and cover the mapping now
+            struct stat info;
+            const int seals = fcntl(fd, F_GET_SEALS);
+            if ((seals < 0) || !(seals & F_SEAL_SHRINK) || fstat(fd, &info) ||
+                (request.size > static_cast<uint64_t>(info.st_size))) {
+                reply(connection, request, -EINVAL);
+                return;
+            }
+            try {
+                std::shared_ptr<SharedMapping> mapping(new SharedMapping(fd, request.size));
+                const uint64_t handle = connection.nextHandle++;
+                connection.mappings[handle] = std::move(mapping);
+                reply(connection, request, 0, handle);
+            } catch (std::system_error &e) {
+                reply(connection, request, -e.code().value());
+            }
+            return;
+        }
+        case ServiceOp::Unmap:
+            reply(connection, request, connection.mappings.erase(request.handle) ? 0 : -ENOENT);
+            return;
+        case ServiceOp::Add: {
+            auto it = connection.mappings.find(request.handle);
+            if (it == connection.mappings.end()) {
+                reply(connection, request, -ENOENT);
+                return;
+            }
+            const SharedMapping &mapping = *it->second;
+            if (!request.len || (request.len > maxBatch) || !mapping.contains(request.aaa, request.len) ||
+                !mapping.contains(request.bbb, request.len) || !mapping.contains(request.ccc, request.len)) {
+                reply(connection, request, -EINVAL);
+                return;
+            }
+            mPending.push_back(Pending{&connection, it->second, request.id,
+                                       reinterpret_cast<float *>(mapping.get() + request.aaa),
+                                       reinterpret_cast<const float *>(mapping.get() + request.bbb),
+                                       reinterpret_cast<const float *>(mapping.get() + request.ccc),
+                                       request.len, Clock::now()});
+            mPendingElements += request.len;
+            return;
+        }
+        default:
+            reply(connection, request, -EOPNOTSUPP);
+        }
+    }
+
+    // Read every message the connection has queued, false once the client went away
+    bool drain(Connection &connection) {
+        while (true) {
+            ServiceRequest request;
+            int fd = -1;
+            const int status = receiveMessage(connection.fd, &request, sizeof(request), &fd, MSG_DONTWAIT);
+            if (status < 0)
+                return true;
+            if (status == 0)
+                return false;
+            handle(connection, request, fd);
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+
+    void disconnect(size_t index) {
+        Connection *connection = mConnections[index].get();
+        mPending.erase(std::remove_if(mPending.begin(), mPending.end(), [&](const Pending &pending) {
+            if (pending.connection != connection)
+                return false;
+            mPendingElements -= pending.len;
+            return true;
+        }), mPending.end());
+        close(connection->fd);
+        mConnections.erase(mConnections.begin() + index);
+    }
+
+    // Run the pending requests, at most maxBatch elements per launch
+    void dispatch() {
+        size_t begin = 0;
+        while (begin < mPending.size()) {
+            size_t end = begin;
+            size_t elements = 0;
+            while ((end < mPending.size()) && ((end == begin) || (elements + mPending[end].len <= maxBatch)))
+                elements += mPending[end++].len;
+            mRunner.run(std::vector<Pending>(mPending.begin() + begin, mPending.begin() + end));
+            begin = end;
+        }
+        mPending.clear();
+        mPendingElements = 0;
+    }
+
+public:
+    Daemon(HipDevice &device) : mRunner(device), mListen(listenSocket(socketPath)), mPendingElements(0) {}
+
+    ~Daemon() {
+        for (auto &connection : mConnections)
+            close(connection->fd);
+        close(mListen);
+        unlink(socketPath.c_str());
+    }
+
+    void serve() {
+        while (!stopping) {
+            std::vector<pollfd> fds(1, pollfd{mListen, POLLIN, 0});
+            for (auto &connection : mConnections)
+                fds.push_back(pollfd{connection->fd, POLLIN, 0});
+
+            // Sleep until a message arrives or the oldest pending request's window closes
+            timespec timeout = {1, 0};
+            if (!mPending.empty()) {
+                const long long wait = std::max(0LL, mRunner.windowUs() - elapsedUs(mPending.front().arrival, Clock::now()));
+                timeout = {static_cast<time_t>(wait / 1000000), static_cast<long>((wait % 1000000) * 1000)};
+            }
+            if (ppoll(fds.data(), fds.size(), &timeout, nullptr) < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "ppoll");
+            }
+
+            if (fds[0].revents & POLLIN) {
+                const int fd = accept4(mListen, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0)
+                    mConnections.emplace_back(new Connection{fd, 1, {}});
+            }
+            for (size_t i = fds.size() - 1; i > 0; i--) {
+                if (!fds[i].revents)
+                    continue;
+                if (!drain(*mConnections[i - 1]))
+                    disconnect(i - 1);
+            }
+
+            if (mPending.empty())
+                continue;
+            if ((mPendingElements >= maxBatch) ||
+                (elapsedUs(mPending.front().arrival, Clock::now()) >= mRunner.windowUs()))
+                dispatch();
+        }
+    }
+
+    const BatchRunner &runner() const {
+        return mRunner;
+    }
+};
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+    pinThread(nodeCpus(hdevice.numaNode()));
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onsignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    Daemon daemon(hdevice);
+    std::cout << "Serving vectoradd on " << socketPath << ", latency SLO " << sloUs << " us, at most "
+              << maxBatch << " elements per launch" << std::endl;
+    daemon.serve();
+
+    const BatchRunner &runner = daemon.runner();
+    std::cout << "Served " << runner.requests() << " requests in " << runner.batches() << " launches";
+    if (runner.batches())
+        std::cout << ", " << double(runner.requests())/runner.batches() << " requests per launch";
+    std::cout << std::endl;
+    return 0;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "S:s:b:h")) != -1) {
+        switch (opt) {
+        case 'S':
+            socketPath = optarg;
+            break;
+        case 's':
+            sloUs = std::strtoll(optarg, nullptr, 0);
+            break;
+        case 'b':
+            maxBatch = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-S <socket>] [-s <us>] [-b <elements>]\n";
+            std::cout << "  -S <socket>    Unix socket to serve on (default: " << defaultSocketPath() << ")\n";
+            std::cout << "  -s <us>        Latency SLO; requests wait for batching up to the SLO less the\n"
+                      << "                 expected launch time, 0 disables batching (default: " << DEFAULT_SLO_US << ")\n";
+            std::cout << "  -b <elements>  Most elements per launch (default: " << DEFAULT_MAX_BATCH << ")\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
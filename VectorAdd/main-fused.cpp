@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "expr.h"
+#include "fused.h"
+
+namespace {
+
+static const size_t LEN = 0x1000000;
+static const size_t SIZE = LEN * sizeof(float);
+static const int LOOP = 100;
+
+double gbps(size_t bytes, long long us)
+{
+    return us ? bytes / (us * 1000.0) : 0;
+}
+
+void report(const char *what, size_t bytes, long long delayD)
+{
+    std::cout << what << " (" << LOOP << " loops, " << delayD << " us, " << delayD/LOOP << " us average, "
+              << bytes/LOOP/0x100000 << " MB per run, " << gbps(bytes, delayD) << " GB/s)" << std::endl;
+}
+
+// Run the expression fused and unfused on the device and on the host, validate the
+// device result against the host and report the memory traffic fusion saves
+template<typename E> int benchmark(FusedEngine &engine, const E &e, float *deviceOut)
+{
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Expression " << expr::shape(e) << std::endl;
+    const size_t fusedBytes = expr::fusedBytes(e, LEN);
+
+    // Warm up also compiles the kernel for this shape
+    engine.run(deviceOut, e, LEN);
+    hipCheck(hipDeviceSynchronize());
+    Timer timer;
+    for (int i = 0; i < LOOP; i++)
+        engine.run(deviceOut, e, LEN);
+    hipCheck(hipDeviceSynchronize());
+    report("Fused device", fusedBytes * LOOP, timer.stop());
+
+    DeviceUnfused unfused(engine, LEN);
+    e.materialize(unfused);
+    hipCheck(hipDeviceSynchronize());
+    const size_t unfusedBytes = unfused.bytes();
+    timer.reset();
+    for (int i = 0; i < LOOP; i++) {
+        unfused.reset();
+        e.materialize(unfused);
+    }
+    hipCheck(hipDeviceSynchronize());
+    report("Unfused device", unfusedBytes * LOOP, timer.stop());
+
+    std::unique_ptr<float[]> hostOut(new float[LEN]);
+    timer.reset();
+    for (int i = 0; i < LOOP; i++)
+        expr::evaluate(hostOut.get(), e, 0, LEN);
+    report("Fused host SIMD", fusedBytes * LOOP, timer.stop());
+
+    expr::HostUnfused hostUnfused(LEN);
+    e.materialize(hostUnfused);
+    timer.reset();
+    for (int i = 0; i < LOOP; i++) {
+        hostUnfused.reset();
+        e.materialize(hostUnfused);
+    }
+    report("Unfused host", unfusedBytes * LOOP, timer.stop());
+
+    std::cout << e.ops() << " operations, " << engine.size() << " kernels compiled, "
+              << (unfusedBytes - fusedBytes)/0x100000 << " MB saved per run ("
+              << (100.0 * (unfusedBytes - fusedBytes))/unfusedBytes << "% of unfused traffic)" << std::endl;
+
+    // The device may contract multiply-add into fma, so allow rounding differences
+    std::unique_ptr<float[]> deviceResult(new float[LEN]);
+    hipCheck(hipMemcpy(deviceResult.get(), deviceOut, SIZE, hipMemcpyDeviceToHost));
+    int errors = 0;
+    for (size_t i = 0; i < LEN; i++) {
+        if (std::fabs(deviceResult[i] - hostOut[i]) > 1e-5f * std::max(1.0f, std::fabs(hostOut[i]))) {
+            errors++;
+            break;
+        }
+    }
+
+    if (errors)
+        std::cout << "FAILED" << std::endl;
+    else
+        std::cout << "PASSED" << std::endl;
+    return errors;
+}
+
+int mainworker() {
+
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+    CodeObjectCache cache;
+    FusedEngine engine(hdevice, cache);
+
+    std::unique_ptr<float[]> hostB(new float[LEN]);
+    std::unique_ptr<float[]> hostC(new float[LEN]);
+    std::unique_ptr<float[]> hostD(new float[LEN]);
+    std::unique_ptr<float[]> hostE(new float[LEN]);
+
+    // Initialize input vectors, half of e is negative so relu has work to do
+    for (size_t i = 0; i < LEN; i++) {
+        hostB[i] = i;
+        hostC[i] = i * 2;
+        hostD[i] = 0.5f;
+        hostE[i] = (float)i - LEN/2;
+    }
+
+    DeviceBO<float> deviceA(LEN);
+    DeviceBO<float> deviceB(LEN);
+    DeviceBO<float> deviceC(LEN);
+    DeviceBO<float> deviceD(LEN);
+    DeviceBO<float> deviceE(LEN);
+
+    // Sync host buffers to device
+    hipCheck(hipMemcpy(deviceB.get(), hostB.get(), SIZE, hipMemcpyHostToDevice));
+    hipCheck(hipMemcpy(deviceC.get(), hostC.get(), SIZE, hipMemcpyHostToDevice));
+    hipCheck(hipMemcpy(deviceD.get(), hostD.get(), SIZE, hipMemcpyHostToDevice));
+    hipCheck(hipMemcpy(deviceE.get(), hostE.get(), SIZE, hipMemcpyHostToDevice));
+
+    expr::Vector b(hostB.get(), deviceB.get());
+    expr::Vector c(hostC.get(), deviceC.get());
+    expr::Vector d(hostD.get(), deviceD.get());
+    expr::Vector e(hostE.get(), deviceE.get());
+
+    int errors = 0;
+    errors += benchmark(engine, b + c, deviceA.get());
+    errors += benchmark(engine, b + c * d - relu(e), deviceA.get());
+    // Same shape as the previous expression, reuses its kernel
+    errors += benchmark(engine, c + b * e - relu(d), deviceA.get());
+    errors += benchmark(engine, max(b * 0.25f + c, e) * d - c / 3.0f, deviceA.get());
+    std::cout << "Code object cache " << cache.dir() << ": " << cache.hits() << " hits, "
+              << cache.misses() << " misses" << std::endl;
+    return errors;
+}
+}
+
+int main()
+{
+    try {
+        return mainworker() ? 1 : 0;
+
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "hostexec.h"
+#include "hostmem.h"
+#include "registry.h"
+#include "workload.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+static const long long DURATION_MS = 300;
+static const size_t LEN = 0x400000;
+static const size_t DEPTH = 4;
+// Per hog thread, twice: source and destination
+static const size_t HOG_BYTES = 0x4000000;
+
+static long long durationMs = DURATION_MS;
+static size_t ways = 2;
+static size_t hogThreads = 0;
+
+// Something which runs flat out until told to stop and reports its rate
+class Workload {
+public:
+    virtual ~Workload() {}
+    virtual const std::string &name() const = 0;
+    // Rate in the workload's own unit, per second
+    virtual double run(Clock::time_point end) = 0;
+    virtual int validate(HipDevice &hdevice, const std::vector<int> &cpus) = 0;
+};
+
+// A registered kernel launched back to back, depth deep, on its own stream
+class KernelRunner : public Workload {
+    std::string mName;
+    KernelWorkload mKernel;
+    hipStream_t mStream;
+
+public:
+    KernelRunner(HipDevice &hdevice, DeviceGenerator &generator, const KernelDesc &desc,
+                 KernelWorkload::Placement placement, int hostNode) :
+        mName(std::string(desc.symbol) + (placement == KernelWorkload::Placement::Mapped ? "@host" : "")),
+        mKernel(hdevice, generator, desc, LEN, placement, hostNode), mStream(nullptr) {
+        hipCheck(hipStreamCreateWithFlags(&mStream, hipStreamNonBlocking));
+    }
+
+    ~KernelRunner() {
+        (void)hipStreamDestroy(mStream);
+    }
+
+    const std::string &name() const override {
+        return mName;
+    }
+
+    double run(Clock::time_point end) override {
+        LaunchWindow window(DEPTH, mStream);
+        size_t launches = 0;
+        Timer timer;
+        while (Clock::now() < end) {
+            window.acquire();
+            mKernel.launch(mStream);
+            window.commit();
+            launches++;
+        }
+        window.drain();
+        return (launches * 1000000.0)/timer.stop();
+    }
+
+    int validate(HipDevice &hdevice, const std::vector<int> &cpus) override {
+        return mKernel.validate(hdevice, cpus);
+    }
+};
+
+// Host memory bandwidth hog: one thread per CPU copying its own buffers over and over,
+// competing with host mapped kernels and transfers for the memory controllers
+class MemoryHog : public Workload {
+    std::string mName;
+    std::vector<int> mCpus;
+    std::vector<std::unique_ptr<HostBO<char>>> mSources;
+    std::vector<std::unique_ptr<HostBO<char>>> mDestinations;
+
+public:
+    MemoryHog(const std::vector<int> &cpus, int hostNode) : mName("hog"), mCpus(cpus) {
+        for (size_t t = 0; t < mCpus.size(); t++) {
+            mSources.emplace_back(new HostBO<char>(HOG_BYTES, hostNode));
+            mDestinations.emplace_back(new HostBO<char>(HOG_BYTES, hostNode));
+        }
+        parallelFor(mCpus, mCpus.size(), [this](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++) {
+                for (size_t i = 0; i < HOG_BYTES; i++)
+                    (*mSources[t])[i] = static_cast<char>(i * 13 + t);
+                std::memset(mDestinations[t]->get(), 0, HOG_BYTES);
+            }
+        });
+    }
+
+    const std::string &name() const override {
+        return mName;
+    }
+
+    // GB/s copied
+    double run(Clock::time_point end) override {
+        std::vector<size_t> copies(mCpus.size(), 0);
+        Timer timer;
+        parallelFor(mCpus, mCpus.size(), [&](size_t begin, size_t last) {
+            while (Clock::now() < end) {
+                for (size_t t = begin; t < last; t++) {
+                    std::memcpy(mDestinations[t]->get(), mSources[t]->get(), HOG_BYTES);
+                    copies[t]++;
+                }
+            }
+        });
+        const long long delay = timer.stop();
+        size_t total = 0;
+        for (auto count : copies)
+            total += count;
+        return (2.0 * HOG_BYTES * total)/(delay * 1000.0);
+    }
+
+    int validate(HipDevice &, const std::vector<int> &) override {
+        for (size_t t = 0; t < mCpus.size(); t++) {
+            if (std::memcmp(mDestinations[t]->get(), mSources[t]->get(), HOG_BYTES))
+                return 1;
+        }
+        return 0;
+    }
+};
+
+// Run the workloads together, each from its own thread pinned to the node, and collect
+// their rates
+std::vector<double> corun(const std::vector<Workload *> &set, const std::vector<int> &cpus)
+{
+    std::vector<double> rates(set.size(), 0);
+    const Clock::time_point end = Clock::now() + std::chrono::milliseconds(durationMs);
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < set.size(); w++) {
+        threads.emplace_back([&, w]() {
+            pinThread(cpus);
+            rates[w] = set[w]->run(end);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    return rates;
+}
+
+// Every combination of ways indices out of count, in lexicographic order
+std::vector<std::vector<size_t>> combinations(size_t count, size_t ways)
+{
+    std::vector<std::vector<size_t>> result;
+    std::vector<size_t> pick(ways);
+    for (size_t i = 0; i < ways; i++)
+        pick[i] = i;
+    while (ways <= count) {
+        result.push_back(pick);
+        size_t i = ways;
+        while (i > 0 && pick[i - 1] == count - ways + i - 1)
+            i--;
+        if (i == 0)
+            break;
+        pick[i - 1]++;
+        for (size_t j = i; j < ways; j++)
+            pick[j] = pick[j - 1] + 1;
+    }
+    return result;
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+    const int hostNode = hdevice.numaNode();
+    const std::vector<int> cpus = nodeCpus(hostNode);
+    pinThread(cpus);
+
+    // Every registered kernel on device memory, those which touch memory also on host
+    // memory mapped into the device, and the host memory hog
+    DeviceGenerator generator(hdevice);
+    std::vector<std::unique_ptr<Workload>> workloads;
+    for (auto &desc : KernelRegistry::all()) {
+        workloads.emplace_back(new KernelRunner(hdevice, generator, desc, KernelWorkload::Placement::Device, hostNode));
+        if (desc.bytesPerElement)
+            workloads.emplace_back(new KernelRunner(hdevice, generator, desc, KernelWorkload::Placement::Mapped,
+                                                    hostNode));
+    }
+    const std::vector<int> hogCpus(cpus.begin(), cpus.begin() + std::min(cpus.size(), hogThreads ? hogThreads : cpus.size()));
+    workloads.emplace_back(new MemoryHog(hogCpus, hostNode));
+    const size_t count = workloads.size();
+    ways = std::min(ways, count);
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Solo rates (launches/s, hog GB/s), " << durationMs << " ms per run" << std::endl;
+    std::vector<double> solo(count);
+    for (size_t w = 0; w < count; w++) {
+        solo[w] = corun({workloads[w].get()}, cpus)[0];
+        std::cout << std::setw(4) << w << std::setw(22) << workloads[w]->name() << std::fixed << std::setprecision(1)
+                  << std::setw(12) << solo[w] << std::endl;
+        std::cout.unsetf(std::ios_base::floatfield);
+    }
+
+    // Slowdown is the solo rate over the co-run rate, 1.00 means no interference
+    std::cout << "---------------------------------------------------------------------------------\n";
+    const std::vector<std::vector<size_t>> sets = combinations(count, ways);
+    std::vector<std::vector<double>> matrix(count, std::vector<double>(count, 0));
+    for (auto &set : sets) {
+        std::vector<Workload *> members;
+        for (auto w : set)
+            members.push_back(workloads[w].get());
+        const std::vector<double> rates = corun(members, cpus);
+        if (ways == 2) {
+            matrix[set[0]][set[1]] = rates[0] ? solo[set[0]] / rates[0] : 0;
+            matrix[set[1]][set[0]] = rates[1] ? solo[set[1]] / rates[1] : 0;
+            continue;
+        }
+        std::cout << std::fixed << std::setprecision(2);
+        for (size_t m = 0; m < set.size(); m++)
+            std::cout << (m ? ", " : "") << workloads[set[m]]->name() << ' ' << (rates[m] ? solo[set[m]] / rates[m] : 0) << 'x';
+        std::cout << std::endl;
+        std::cout.unsetf(std::ios_base::floatfield);
+    }
+    if (ways == 2) {
+        std::cout << "Slowdown of the row workload next to the column workload" << std::endl;
+        std::cout << std::setw(22) << "";
+        for (size_t c = 0; c < count; c++)
+            std::cout << std::setw(7) << c;
+        std::cout << std::endl << std::fixed << std::setprecision(2);
+        for (size_t r = 0; r < count; r++) {
+            std::cout << std::setw(22) << workloads[r]->name();
+            for (size_t c = 0; c < count; c++) {
+                if (r == c)
+                    std::cout << std::setw(7) << '-';
+                else
+                    std::cout << std::setw(7) << matrix[r][c];
+            }
+            std::cout << std::endl;
+        }
+        std::cout.unsetf(std::ios_base::floatfield);
+    }
+
+    int errors = 0;
+    for (auto &workload : workloads)
+        errors += workload->validate(hdevice, cpus);
+    std::cout << (errors ? "FAILED" : "PASSED") << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "t:w:H:h")) != -1) {
+        switch (opt) {
+        case 't':
+            durationMs = std::max(1LL, std::strtoll(optarg, nullptr, 0));
+            break;
+        case 'w':
+            ways = std::max(2ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'H':
+            hogThreads = std::strtoul(optarg, nullptr, 0);
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-t <ms>] [-w <ways>] [-H <threads>]\n";
+            std::cout << "  -t <ms>       Duration of each run (default: " << DURATION_MS << ")\n";
+            std::cout << "  -w <ways>     Workloads per co-run; 2 prints the pairwise slowdown matrix (default: 2)\n";
+            std::cout << "  -H <threads>  Threads of the host memory hog (default: one per CPU of the device's node)\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,635 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "registry.h"
+#include "service.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+static const int PRODUCERS = 4;
+static const size_t REQUESTS = 10000;
+static const size_t LENGTH = 4096;
+static const unsigned OUTSTANDING = 2;
+// vectoradd has no bounds check, requests cover whole blocks
+static const size_t GRANULE = 32;
+
+static int producers = PRODUCERS;
+static size_t requests = REQUESTS;
+static size_t length = LENGTH;
+static unsigned outstanding = OUTSTANDING;
+static std::string memoryOption = "all";
+
+// Where a producer keeps its vectors: a memfd the consumer maps and registers with the
+// runtime, or a device allocation the consumer opens through its IPC handle. Either way
+// the consumer launches on the producer's own memory and nothing is copied.
+enum class Memory {
+    Host,
+    Device
+};
+
+const char *memoryName(Memory memory)
+{
+    return (memory == Memory::Host) ? "memfd" : "device ipc";
+}
+
+enum class IpcOp : uint32_t {
+    Attach = 1,
+    Add = 2,
+    Report = 3
+};
+
+// Producer to consumer message. A producer's region holds outstanding slots of
+// [aaa|bbb|ccc], length floats each; Add asks for aaa = bbb + ccc in one slot.
+struct IpcMessage {
+    IpcOp op;
+    uint32_t slot;
+    // Attach: bytes of the region, Report: requests completed
+    uint64_t size;
+    // Report: time the requests took and failed checks; the latencies follow as a memfd
+    uint64_t elapsedUs;
+    int32_t errors;
+    uint32_t reserved;
+    // Attach of device memory
+    hipIpcMemHandle_t handle;
+};
+
+// Consumer to producer: the slot's result is in place
+struct IpcCompletion {
+    uint32_t slot;
+    int32_t status;
+};
+
+// Measurements of one path, merged over its producers
+struct PathStats {
+    std::vector<double> latencies;
+    long long elapsedUs;
+    int errors;
+};
+
+size_t slotFloats()
+{
+    return 3 * length;
+}
+
+size_t regionBytes()
+{
+    return slotFloats() * outstanding * sizeof(float);
+}
+
+// Closed loop of requests with outstanding in flight: submit(slot) starts one and
+// complete() blocks for the next finished slot
+template<typename S, typename C> void closedLoop(std::vector<double> &latencies, S submit, C complete)
+{
+    std::vector<Clock::time_point> sent(outstanding);
+    size_t issued = 0;
+    for (unsigned s = 0; (s < outstanding) && (issued < requests); s++, issued++) {
+        sent[s] = Clock::now();
+        submit(s);
+    }
+    latencies.reserve(requests);
+    for (size_t done = 0; done < issued; done++) {
+        const unsigned s = complete();
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent[s]).count());
+        if (issued < requests) {
+            issued++;
+            sent[s] = Clock::now();
+            submit(s);
+        }
+    }
+}
+
+int checkSlots(const float *region)
+{
+    for (unsigned s = 0; s < outstanding; s++) {
+        const float *slot = region + s * slotFloats();
+        for (size_t i = 0; i < length; i++) {
+            if (slot[i] != slot[length + i] + slot[2 * length + i])
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// Inputs of producer index, distinct for every producer and slot
+void fillRegion(float *region, int index, DeviceGenerator *generator)
+{
+    for (unsigned s = 0; s < outstanding; s++) {
+        float *slot = region + s * slotFloats();
+        const size_t first = (static_cast<size_t>(index) * outstanding + s) * length;
+        if (generator) {
+            hipCheck(hipMemset(slot, 0, length * sizeof(float)));
+            generator->fill(slot + length, length, DEFAULT_SEED + first, 0);
+            generator->fill(slot + 2 * length, length, DEFAULT_SEED + first, 1);
+        }
+        else {
+            std::memset(slot, 0, length * sizeof(float));
+            fillHost(slot + length, 0, length, DEFAULT_SEED + first, 0);
+            fillHost(slot + 2 * length, 0, length, DEFAULT_SEED + first, 1);
+        }
+    }
+}
+
+// Body of a forked producer process, talks to the consumer over sock
+int producer(int sock, int index, Memory memory)
+{
+    IpcCompletion completion;
+    auto wait = [&]() {
+        if (receiveMessage(sock, &completion, sizeof(completion), nullptr) != 1)
+            throw std::runtime_error("Consumer closed the connection");
+    };
+    // Producers of a group set up together and then start their requests together
+    wait();
+
+    std::unique_ptr<HipDevice> hdevice;
+    std::unique_ptr<DeviceBO<float>> device;
+    std::unique_ptr<SharedMapping> mapping;
+    IpcMessage message;
+    std::memset(&message, 0, sizeof(message));
+    message.op = IpcOp::Attach;
+    message.size = regionBytes();
+
+    if (memory == Memory::Device) {
+        hdevice.reset(new HipDevice());
+        DeviceGenerator generator(*hdevice);
+        device.reset(new DeviceBO<float>(slotFloats() * outstanding));
+        fillRegion(device->get(), index, &generator);
+        hipCheck(hipDeviceSynchronize());
+        hipCheck(hipIpcGetMemHandle(&message.handle, device->get()));
+        sendMessage(sock, &message, sizeof(message));
+    }
+    else {
+        const int fd = createMemfd("producer", regionBytes());
+        mapping.reset(new SharedMapping(fd, regionBytes()));
+        fillRegion(reinterpret_cast<float *>(mapping->get()), index, nullptr);
+        sendMessage(sock, &message, sizeof(message), fd);
+        close(fd);
+    }
+    wait();
+
+    std::vector<double> latencies;
+    int errors = 0;
+    Timer timer;
+    closedLoop(latencies, [&](unsigned s) {
+        message.op = IpcOp::Add;
+        message.slot = s;
+        sendMessage(sock, &message, sizeof(message));
+    }, [&]() {
+        wait();
+        if (completion.status)
+            errors++;
+        return completion.slot % outstanding;
+    });
+    message.elapsedUs = timer.stop();
+
+    if (device) {
+        std::vector<float> check(slotFloats() * outstanding);
+        hipCheck(hipMemcpy(check.data(), device->get(), regionBytes(), hipMemcpyDeviceToHost));
+        errors += checkSlots(check.data());
+    }
+    else {
+        errors += checkSlots(reinterpret_cast<const float *>(mapping->get()));
+    }
+
+    // Hand the latencies over as a memfd rather than through the socket
+    const int fd = createMemfd("latencies", latencies.size() * sizeof(double));
+    {
+        SharedMapping report(fd, latencies.size() * sizeof(double));
+        std::memcpy(report.get(), latencies.data(), latencies.size() * sizeof(double));
+    }
+    message.op = IpcOp::Report;
+    message.size = latencies.size();
+    message.errors = errors;
+    sendMessage(sock, &message, sizeof(message), fd);
+    close(fd);
+
+    // Wait for the consumer to let go of our memory (and close the socket) before it is freed
+    while (receiveMessage(sock, &completion, sizeof(completion), nullptr) > 0);
+    return errors;
+}
+
+// The consumer's view of one producer
+class ProducerLink {
+    const KernelDesc &mDesc;
+    int mSock;
+    Memory mMemory;
+    std::unique_ptr<SharedMapping> mMapping;
+    float *mRegion;
+    std::vector<std::unique_ptr<KernelArgs>> mArgs;
+    bool mReported;
+
+    void attach(const IpcMessage &message, int fd) {
+        if (message.size != regionBytes())
+            throw std::runtime_error("Producer region has the wrong size");
+        void *region = nullptr;
+        if (mMemory == Memory::Device) {
+            hipCheck(hipIpcOpenMemHandle(&region, message.handle, hipIpcMemLazyEnablePeerAccess));
+        }
+        else {
+            if (fd < 0)
+                throw std::runtime_error("Producer attached without a memfd");
+            mMapping.reset(new SharedMapping(fd, message.size));
+            hipCheck(hipHostRegister(mMapping->get(), message.size, hipHostRegisterMapped));
+            hipCheck(hipHostGetDevicePointer(&region, mMapping->get(), 0));
+        }
+        mRegion = static_cast<float *>(region);
+        for (unsigned s = 0; s < outstanding; s++) {
+            float *slot = mRegion + s * slotFloats();
+            const std::vector<void *> slots = {slot, slot + length, slot + 2 * length};
+            mArgs.emplace_back(new KernelArgs(mDesc, slots, length));
+        }
+    }
+
+    void detach() {
+        if (!mRegion)
+            return;
+        if (mMemory == Memory::Device)
+            (void)hipIpcCloseMemHandle(mRegion);
+        else
+            (void)hipHostUnregister(mMapping->get());
+        mMapping.reset();
+        mRegion = nullptr;
+    }
+
+public:
+    ProducerLink(const KernelDesc &desc, int sock, Memory memory) : mDesc(desc), mSock(sock), mMemory(memory),
+                                                                   mRegion(nullptr), mReported(false) {}
+
+    ~ProducerLink() {
+        detach();
+        close(mSock);
+    }
+
+    int sock() const {
+        return mSock;
+    }
+
+    bool attached() const {
+        return mRegion || mReported;
+    }
+
+    bool reported() const {
+        return mReported;
+    }
+
+    // Let the producer go ahead with its next phase: setting up, then the requests
+    void start() {
+        const IpcCompletion completion = {0, 0};
+        sendMessage(mSock, &completion, sizeof(completion));
+    }
+
+    // Handle every message the producer has queued: launch the adds it asks for on the
+    // stream, noting their slots in ready, and merge its report into stats
+    void drain(hipFunction_t function, hipStream_t stream, std::vector<uint32_t> &ready, PathStats &stats) {
+        while (!mReported) {
+            IpcMessage message;
+            int fd = -1;
+            const int status = receiveMessage(mSock, &message, sizeof(message), &fd, MSG_DONTWAIT);
+            if (status < 0)
+                return;
+            if (status == 0)
+                throw std::runtime_error("Producer went away");
+            switch (message.op) {
+            case IpcOp::Attach:
+                attach(message, fd);
+                break;
+            case IpcOp::Add: {
+                const LaunchGeometry geometry = mDesc.geometry(length);
+                hipCheck(hipModuleLaunchKernel(function,
+                                                 geometry.grid, 1, 1,
+                                                 geometry.block, 1, 1,
+                                                 0, stream, nullptr, mArgs.at(message.slot)->config()), mDesc.symbol);
+                ready.push_back(message.slot);
+                break;
+            }
+            case IpcOp::Report: {
+                SharedMapping latencies(fd, message.size * sizeof(double));
+                const double *first = reinterpret_cast<const double *>(latencies.get());
+                stats.latencies.insert(stats.latencies.end(), first, first + message.size);
+                stats.elapsedUs = std::max(stats.elapsedUs, static_cast<long long>(message.elapsedUs));
+                stats.errors += message.errors;
+                detach();
+                mReported = true;
+                break;
+            }
+            }
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+
+    void complete(const std::vector<uint32_t> &ready) {
+        for (auto slot : ready) {
+            const IpcCompletion completion = {slot, 0};
+            sendMessage(mSock, &completion, sizeof(completion));
+        }
+    }
+};
+
+// Producer processes of one memory kind, forked before this process touches the
+// runtime; they stay idle until their group is served
+struct ProducerGroup {
+    Memory memory;
+    std::vector<int> socks;
+    std::vector<pid_t> children;
+};
+
+void spawn(ProducerGroup &group, const std::vector<ProducerGroup> &others)
+{
+    for (int p = 0; p < producers; p++) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair))
+            throw std::system_error(errno, std::generic_category(), "socketpair");
+        std::cout.flush();
+        const pid_t pid = fork();
+        if (pid < 0)
+            throw std::system_error(errno, std::generic_category(), "fork");
+        if (pid == 0) {
+            for (auto &other : others) {
+                for (auto sock : other.socks)
+                    close(sock);
+            }
+            for (auto sock : group.socks)
+                close(sock);
+            close(pair[0]);
+            int status = 1;
+            try {
+                status = producer(pair[1], p, group.memory) ? 1 : 0;
+            } catch (std::exception &e) {
+                std::cerr << "Producer " << p << ": " << e.what() << std::endl;
+            }
+            std::cout.flush();
+            _exit(status);
+        }
+        close(pair[1]);
+        group.socks.push_back(pair[0]);
+        group.children.push_back(pid);
+    }
+}
+
+PathStats serve(HipDevice &hdevice, ProducerGroup &group)
+{
+    PathStats stats = {{}, 0, 0};
+    std::vector<std::unique_ptr<ProducerLink>> links;
+    try {
+        const KernelDesc &desc = KernelRegistry::find("vectoradd");
+        hipFunction_t function = hdevice.getFunction(desc.codeObject, desc.symbol);
+        hipStream_t stream;
+        hipCheck(hipStreamCreateWithFlags(&stream, hipStreamNonBlocking));
+        for (auto sock : group.socks)
+            links.emplace_back(new ProducerLink(desc, sock, group.memory));
+        group.socks.clear();
+        for (auto &link : links)
+            link->start();
+
+        // Launch what every producer asked for, then wait once and complete them all
+        std::vector<std::vector<uint32_t>> ready(links.size());
+        size_t attached = 0;
+        size_t reported = 0;
+        while (reported < links.size()) {
+            std::vector<pollfd> fds;
+            for (auto &link : links)
+                fds.push_back(pollfd{link->sock(), static_cast<short>(link->reported() ? 0 : POLLIN), 0});
+            if ((poll(fds.data(), fds.size(), -1) < 0) && (errno != EINTR))
+                throw std::system_error(errno, std::generic_category(), "poll");
+            bool launched = false;
+            for (size_t p = 0; p < links.size(); p++) {
+                if (!fds[p].revents || links[p]->reported())
+                    continue;
+                const bool wasAttached = links[p]->attached();
+                links[p]->drain(function, stream, ready[p], stats);
+                launched |= !ready[p].empty();
+                attached += (!wasAttached && links[p]->attached()) ? 1 : 0;
+                reported += links[p]->reported() ? 1 : 0;
+                // Release the producers together once all are set up
+                if (!wasAttached && (attached == links.size())) {
+                    for (auto &link : links)
+                        link->start();
+                }
+            }
+            if (!launched)
+                continue;
+            hipCheck(hipStreamSynchronize(stream));
+            for (size_t p = 0; p < links.size(); p++) {
+                links[p]->complete(ready[p]);
+                ready[p].clear();
+            }
+        }
+        hipCheck(hipStreamDestroy(stream));
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        stats.errors++;
+    }
+    // Release the producers' memory, closing the sockets lets them exit
+    links.clear();
+    for (auto sock : group.socks)
+        close(sock);
+    group.socks.clear();
+
+    for (auto pid : group.children) {
+        int status = 0;
+        if ((waitpid(pid, &status, 0) < 0) || !WIFEXITED(status) || WEXITSTATUS(status))
+            stats.errors++;
+    }
+    group.children.clear();
+    return stats;
+}
+
+// The same closed loop of every producer run by a thread of this process, launching
+// directly on its own pinned host or device memory
+PathStats runthreads(HipDevice &hdevice, Memory memory)
+{
+    const KernelDesc &desc = KernelRegistry::find("vectoradd");
+    hipFunction_t function = hdevice.getFunction(desc.codeObject, desc.symbol);
+    DeviceGenerator generator(hdevice);
+    std::vector<PathStats> stats(producers, PathStats{{}, 0, 0});
+    std::vector<std::string> failures(producers);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            try {
+                float *region = nullptr;
+                std::unique_ptr<DeviceBO<float>> device;
+                if (memory == Memory::Device) {
+                    device.reset(new DeviceBO<float>(slotFloats() * outstanding));
+                    region = device->get();
+                    fillRegion(region, p, &generator);
+                }
+                else {
+                    hipCheck(hipHostMalloc((void **)&region, regionBytes(), hipHostMallocMapped));
+                    fillRegion(region, p, nullptr);
+                }
+                hipStream_t stream;
+                hipCheck(hipStreamCreateWithFlags(&stream, hipStreamNonBlocking));
+                std::vector<hipEvent_t> done(outstanding);
+                std::vector<std::unique_ptr<KernelArgs>> args;
+                for (unsigned s = 0; s < outstanding; s++) {
+                    hipCheck(hipEventCreateWithFlags(&done[s], hipEventDisableTiming));
+                    float *slot = region + s * slotFloats();
+                    const std::vector<void *> slots = {slot, slot + length, slot + 2 * length};
+                    args.emplace_back(new KernelArgs(desc, slots, length));
+                }
+                hipCheck(hipDeviceSynchronize());
+
+                // Launches complete in stream order, so the oldest one is always next
+                const LaunchGeometry geometry = desc.geometry(length);
+                unsigned oldest = 0;
+                Timer timer;
+                closedLoop(stats[p].latencies, [&](unsigned s) {
+                    hipCheck(hipModuleLaunchKernel(function,
+                                                     geometry.grid, 1, 1,
+                                                     geometry.block, 1, 1,
+                                                     0, stream, nullptr, args[s]->config()), desc.symbol);
+                    hipCheck(hipEventRecord(done[s], stream));
+                }, [&]() {
+                    const unsigned s = oldest;
+                    oldest = (oldest + 1) % outstanding;
+                    hipCheck(hipEventSynchronize(done[s]));
+                    return s;
+                });
+                stats[p].elapsedUs = timer.stop();
+
+                if (device) {
+                    std::vector<float> check(slotFloats() * outstanding);
+                    hipCheck(hipMemcpy(check.data(), region, regionBytes(), hipMemcpyDeviceToHost));
+                    stats[p].errors += checkSlots(check.data());
+                }
+                else {
+                    stats[p].errors += checkSlots(region);
+                    hipCheck(hipHostFree(region));
+                }
+                for (auto event : done)
+                    hipCheck(hipEventDestroy(event));
+                hipCheck(hipStreamDestroy(stream));
+            } catch (std::exception &e) {
+                failures[p] = e.what();
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    PathStats merged = {{}, 0, 0};
+    for (int p = 0; p < producers; p++) {
+        if (!failures[p].empty()) {
+            std::cerr << "Thread " << p << ": " << failures[p] << std::endl;
+            merged.errors++;
+        }
+        merged.latencies.insert(merged.latencies.end(), stats[p].latencies.begin(), stats[p].latencies.end());
+        merged.elapsedUs = std::max(merged.elapsedUs, stats[p].elapsedUs);
+        merged.errors += stats[p].errors;
+    }
+    return merged;
+}
+
+void report(const char *path, Memory memory, PathStats &stats)
+{
+    const size_t served = stats.latencies.size();
+    std::cout << std::setw(10) << path << std::setw(12) << memoryName(memory) << std::fixed << std::setprecision(2)
+              << std::setw(12) << (stats.elapsedUs ? served * 1000000.0 / stats.elapsedUs : 0.0)
+              << std::setw(12) << (served ? double(stats.elapsedUs) * producers / served : 0.0)
+              << std::setw(10) << percentile(stats.latencies, 50.0) << std::setw(10) << percentile(stats.latencies, 99.0)
+              << std::setw(8) << (stats.errors ? "FAILED" : "ok") << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+int mainworker() {
+    std::vector<Memory> memories;
+    if ((memoryOption == "all") || (memoryOption == "host"))
+        memories.push_back(Memory::Host);
+    if ((memoryOption == "all") || (memoryOption == "device"))
+        memories.push_back(Memory::Device);
+    if (memories.empty())
+        throw std::invalid_argument("Unknown memory " + memoryOption);
+
+    std::cout << "*********************************************************************************\n";
+    std::cout << producers << " producers, " << requests << " requests of " << length << " elements each, "
+              << outstanding << " outstanding per producer" << std::endl;
+
+    // Producers must be forked before this process initializes the runtime
+    std::vector<ProducerGroup> groups;
+    for (auto memory : memories) {
+        ProducerGroup group = {memory, {}, {}};
+        spawn(group, groups);
+        groups.push_back(group);
+    }
+
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << std::setw(10) << "path" << std::setw(12) << "memory" << std::setw(12) << "req/s"
+              << std::setw(12) << "us/req" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+              << std::setw(8) << "check" << std::endl;
+    int errors = 0;
+    for (size_t m = 0; m < memories.size(); m++) {
+        PathStats processes = serve(hdevice, groups[m]);
+        PathStats threads = runthreads(hdevice, memories[m]);
+        report("process", memories[m], processes);
+        report("thread", memories[m], threads);
+        errors += processes.errors + threads.errors;
+    }
+    std::cout << (errors ? "FAILED" : "PASSED") << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:l:q:m:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            producers = std::max(1, std::atoi(optarg));
+            break;
+        case 'n':
+            requests = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'l':
+            length = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            length = (length + GRANULE - 1) / GRANULE * GRANULE;
+            break;
+        case 'q':
+            outstanding = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'm':
+            memoryOption = optarg;
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-p <producers>] [-n <requests>] [-l <len>] [-q <depth>] [-m <memory>]\n";
+            std::cout << "  -p <producers>  Producer processes, and threads for the in-process path (default: "
+                      << PRODUCERS << ")\n";
+            std::cout << "  -n <requests>   Requests per producer (default: " << REQUESTS << ")\n";
+            std::cout << "  -l <len>        Elements per request, rounded up to " << GRANULE << " (default: "
+                      << LENGTH << ")\n";
+            std::cout << "  -q <depth>      Outstanding requests per producer (default: " << OUTSTANDING << ")\n";
+            std::cout << "  -m <memory>     host (memfd), device (IPC handles) or all (default: all)\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "common.h"
+#include "generate.h"
+#include "service.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+static const int CONNECTIONS = 4;
+static const size_t REQUESTS = 10000;
+static const uint32_t LENGTH = 4096;
+static const unsigned OUTSTANDING = 4;
+
+static std::string socketPath = defaultSocketPath();
+static int connections = CONNECTIONS;
+static size_t requests = REQUESTS;
+static uint32_t length = LENGTH;
+static unsigned outstanding = OUTSTANDING;
+
+// Results of one client connection
+struct ClientStats {
+    std::vector<double> latencies;
+    uint64_t batched;
+    uint64_t queueUs;
+    int errors;
+};
+
+// One closed loop client: a shared memory file of outstanding slots of [aaa|bbb|ccc],
+// mapped into the daemon once, with a new request sent for a slot as soon as its
+// previous one completes
+void client(int index, ClientStats &stats)
+{
+    const size_t slotBytes = 3 * length * sizeof(float);
+    const size_t size = slotBytes * outstanding;
+    const int fd = createMemfd("loadgen", size);
+    SharedMapping mapping(fd, size);
+    for (unsigned s = 0; s < outstanding; s++) {
+        float *slot = reinterpret_cast<float *>(mapping.get() + s * slotBytes);
+        const size_t first = (static_cast<size_t>(index) * outstanding + s) * length;
+        std::memset(slot, 0, length * sizeof(float));
+        fillHost(slot + length, first, length, DEFAULT_SEED, 0);
+        fillHost(slot + 2 * length, first, length, DEFAULT_SEED, 1);
+    }
+
+    const int sock = connectSocket(socketPath);
+    ServiceRequest request;
+    std::memset(&request, 0, sizeof(request));
+    request.magic = SERVICE_MAGIC;
+    request.op = ServiceOp::Map;
+    request.size = size;
+    sendMessage(sock, &request, sizeof(request), fd);
+    close(fd);
+    ServiceResponse response;
+    if ((receiveMessage(sock, &response, sizeof(response), nullptr) != 1) || response.status)
+        throw std::runtime_error("Could not map shared memory into the daemon");
+    const uint64_t handle = response.handle;
+
+    std::vector<Clock::time_point> sent(outstanding);
+    size_t issued = 0;
+    auto issue = [&](unsigned s) {
+        request.op = ServiceOp::Add;
+        request.id = issued++ * outstanding + s;
+        request.handle = handle;
+        request.aaa = s * slotBytes;
+        request.bbb = request.aaa + length * sizeof(float);
+        request.ccc = request.bbb + length * sizeof(float);
+        request.len = length;
+        sent[s] = Clock::now();
+        sendMessage(sock, &request, sizeof(request));
+    };
+    for (unsigned s = 0; (s < outstanding) && (issued < requests); s++)
+        issue(s);
+
+    stats.latencies.reserve(requests);
+    for (size_t done = 0; done < issued; done++) {
+        if (receiveMessage(sock, &response, sizeof(response), nullptr) != 1)
+            throw std::runtime_error("Daemon closed the connection");
+        const unsigned s = response.id % outstanding;
+        stats.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent[s]).count());
+        if (response.status)
+            stats.errors++;
+        stats.batched += response.batch;
+        stats.queueUs += response.queueUs;
+        if (issued < requests)
+            issue(s);
+    }
+
+    for (unsigned s = 0; s < outstanding; s++) {
+        const float *slot = reinterpret_cast<const float *>(mapping.get() + s * slotBytes);
+        for (uint32_t i = 0; i < length; i++) {
+            if (slot[i] != slot[length + i] + slot[2 * length + i]) {
+                stats.errors++;
+                break;
+            }
+        }
+    }
+    request.op = ServiceOp::Unmap;
+    sendMessage(sock, &request, sizeof(request));
+    receiveMessage(sock, &response, sizeof(response), nullptr);
+    close(sock);
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    std::cout << connections << " connections to " << socketPath << ", " << requests << " requests of "
+              << length << " elements each, " << outstanding << " outstanding per connection" << std::endl;
+
+    std::vector<ClientStats> stats(connections, ClientStats{{}, 0, 0, 0});
+    std::vector<std::thread> threads;
+    std::vector<std::string> failures(connections);
+    Timer timer;
+    for (int c = 0; c < connections; c++) {
+        threads.emplace_back([c, &stats, &failures]() {
+            try {
+                client(c, stats[c]);
+            } catch (std::exception &e) {
+                failures[c] = e.what();
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    const long long delay = timer.stop();
+
+    int errors = 0;
+    std::vector<double> latencies;
+    uint64_t batched = 0;
+    uint64_t queueUs = 0;
+    for (int c = 0; c < connections; c++) {
+        if (!failures[c].empty()) {
+            std::cerr << "Connection " << c << ": " << failures[c] << std::endl;
+            errors++;
+        }
+        errors += stats[c].errors;
+        latencies.insert(latencies.end(), stats[c].latencies.begin(), stats[c].latencies.end());
+        batched += stats[c].batched;
+        queueUs += stats[c].queueUs;
+    }
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    if (!latencies.empty()) {
+        const size_t served = latencies.size();
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "Throughput " << served * 1000000.0 / delay << " req/s, "
+                  << (3 * sizeof(float) * double(length) * served)/(delay * 1000.0) << " GB/s" << std::endl;
+        std::cout << "Latency (us) p50 " << percentile(latencies, 50.0) << ", p90 " << percentile(latencies, 90.0)
+                  << ", p99 " << percentile(latencies, 99.0) << ", p99.9 " << percentile(latencies, 99.9) << std::endl;
+        std::cout << "Mean batch " << double(batched)/served << " requests, mean queueing "
+                  << double(queueUs)/served << " us" << std::endl;
+        std::cout.unsetf(std::ios_base::floatfield);
+    }
+    std::cout << (errors ? "FAILED" : "PASSED") << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "S:c:n:l:q:h")) != -1) {
+        switch (opt) {
+        case 'S':
+            socketPath = optarg;
+            break;
+        case 'c':
+            connections = std::max(1, std::atoi(optarg));
+            break;
+        case 'n':
+            requests = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'l':
+            length = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'q':
+            outstanding = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-S <socket>] [-c <connections>] [-n <requests>] [-l <len>] [-q <depth>]\n";
+            std::cout << "  -S <socket>       Daemon socket (default: " << defaultSocketPath() << ")\n";
+            std::cout << "  -c <connections>  Concurrent clients, one thread each (default: " << CONNECTIONS << ")\n";
+            std::cout << "  -n <requests>     Requests per client (default: " << REQUESTS << ")\n";
+            std::cout << "  -l <len>          Elements per request (default: " << LENGTH << ")\n";
+            std::cout << "  -q <depth>        Outstanding requests per client (default: " << OUTSTANDING << ")\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
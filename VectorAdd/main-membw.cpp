@@ -0,0 +1,215 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "hostexec.h"
+#include "hostmem.h"
+#include "registry.h"
+#include "verify.h"
+
+namespace {
+
+// 64 Mi elements, 256 MiB per array, well past any last level cache as STREAM requires
+static const size_t DEFAULT_LEN = 0x4000000;
+static const int NTIMES = 20;
+// Kernels without a length argument cover len exactly with their blocks
+static const size_t LEN_GRANULE = 256;
+
+static size_t len = DEFAULT_LEN;
+static int ntimes = NTIMES;
+static std::string only;
+
+// Time ntimes individual launches with events and return the durations in us, the first
+// one excluded as in STREAM
+std::vector<double> timekernel(const KernelDesc &desc, hipFunction_t function, void *config[])
+{
+    const LaunchGeometry geometry = desc.geometry(len);
+    hipEvent_t start, stop;
+    hipCheck(hipEventCreate(&start));
+    hipCheck(hipEventCreate(&stop));
+
+    std::vector<double> times;
+    for (int i = 0; i < ntimes; i++) {
+        hipCheck(hipEventRecord(start, 0));
+        hipCheck(hipModuleLaunchKernel(function,
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         0, 0, nullptr, config), desc.symbol);
+        hipCheck(hipEventRecord(stop, 0));
+        hipCheck(hipEventSynchronize(stop));
+        float ms = 0;
+        hipCheck(hipEventElapsedTime(&ms, start, stop));
+        if (i)
+            times.push_back(ms * 1000.0);
+    }
+
+    hipCheck(hipEventDestroy(stop));
+    hipCheck(hipEventDestroy(start));
+    return times;
+}
+
+void report(const KernelDesc &desc, const std::vector<double> &times)
+{
+    double total = 0;
+    for (auto t : times)
+        total += t;
+    const double best = *std::min_element(times.begin(), times.end());
+    const double worst = *std::max_element(times.begin(), times.end());
+    std::cout << std::setw(14) << desc.symbol << std::fixed << std::setprecision(1)
+              << std::setw(12) << (desc.bytesPerElement * len)/(best * 1000.0)
+              << std::setw(12) << total/times.size() << std::setw(12) << best
+              << std::setw(12) << worst;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+// Run every selected kernel over the slots, which are device or device mapped host
+// buffers. output is where the host sees the output slot: the mapped buffer itself, or
+// a buffer to read resident output back into when the kernel has no device verifier.
+int runsuite(HipDevice &hdevice, const std::vector<const KernelDesc *> &kernels,
+             const std::vector<hipFunction_t> &functions, const std::vector<void *> &slots,
+             float *output, bool resident, const std::vector<int> &cpus)
+{
+    std::cout << std::setw(14) << "Function" << std::setw(12) << "Best GB/s" << std::setw(12) << "Avg us"
+              << std::setw(12) << "Min us" << std::setw(12) << "Max us" << std::endl;
+
+    int errors = 0;
+    for (size_t k = 0; k < kernels.size(); k++) {
+        const KernelDesc &desc = *kernels[k];
+        KernelArgs args(desc, slots, len);
+        // Clear what the previous kernel left in the output, it may well be the same
+        hipCheck(hipMemset(slots[0], 0, len * sizeof(float)));
+        report(desc, timekernel(desc, functions[k], args.config()));
+
+        VerifyResult result;
+        if (resident && desc.verifier) {
+            result = DeviceVerifier(hdevice, desc).run(desc, slots, len);
+        }
+        else if (desc.reference) {
+            if (resident)
+                hipCheck(hipMemcpy(output, slots[0], len * sizeof(float), hipMemcpyDeviceToHost));
+            result = verifyGenerated(desc, output, DEFAULT_SEED, len, cpus);
+        }
+        std::cout << (result.count ? "    FAILED" : "    PASSED") << std::endl;
+        errors += result.count ? 1 : 0;
+    }
+    return errors;
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+
+    // Every registered kernel which moves memory, vectoradd included
+    std::vector<const KernelDesc *> kernels;
+    std::vector<hipFunction_t> functions;
+    for (auto &desc : KernelRegistry::all()) {
+        if (!desc.bytesPerElement || (!only.empty() && only != desc.symbol))
+            continue;
+        kernels.push_back(&desc);
+        functions.push_back(hdevice.getFunction(desc.codeObject, desc.symbol));
+    }
+    if (kernels.empty())
+        throw std::invalid_argument("Kernel " + only + " is not registered or moves no memory");
+
+    const int hostNode = hdevice.numaNode();
+    const std::vector<int> cpus = nodeCpus(hostNode);
+    pinThread(cpus);
+
+    const size_t count = 1 + KernelRegistry::maxInputs();
+    std::cout << "Array size " << len << " elements, " << (len * sizeof(float)) / (1024 * 1024)
+              << " MiB per array, " << count << " arrays, best of " << ntimes - 1 << " runs" << std::endl;
+
+    int errors = 0;
+    {
+        std::vector<std::unique_ptr<DeviceBO<float>>> deviceSlots;
+        std::vector<void *> deviceBuffers;
+        DeviceGenerator generator(hdevice);
+        for (size_t s = 0; s < count; s++) {
+            deviceSlots.emplace_back(new DeviceBO<float>(len));
+            deviceBuffers.push_back(deviceSlots.back()->get());
+            if (s)
+                generator.fill(deviceSlots.back()->get(), len, DEFAULT_SEED, s - 1);
+        }
+        hipCheck(hipDeviceSynchronize());
+        HostBO<float> readback(len, hostNode);
+
+        std::cout << "---------------------------------------------------------------------------------\n";
+        std::cout << "Device resident memory" << std::endl;
+        errors += runsuite(hdevice, kernels, functions, deviceBuffers, readback.get(), true, cpus);
+    }
+
+    std::vector<std::unique_ptr<HostBO<float>>> hostSlots;
+    std::vector<void *> mappedBuffers;
+    for (size_t s = 0; s < count; s++) {
+        hostSlots.emplace_back(new HostBO<float>(len, hostNode));
+        float *buffer = hostSlots.back()->get();
+        if (s)
+            fillHost(cpus, buffer, len, DEFAULT_SEED, s - 1);
+        else
+            parallelFor(cpus, len, [&](size_t begin, size_t end) {
+                std::fill(buffer + begin, buffer + end, 0.0f);
+            });
+        hipCheck(hipHostRegister(buffer, len * sizeof(float), hipHostRegisterDefault));
+        void *ptr = nullptr;
+        hipCheck(hipHostGetDevicePointer(&ptr, buffer, 0));
+        mappedBuffers.push_back(ptr);
+    }
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Host resident memory on NUMA node " << hostNode << std::endl;
+    errors += runsuite(hdevice, kernels, functions, mappedBuffers, hostSlots[0]->get(), false, cpus);
+
+    for (auto it = hostSlots.rbegin(); it != hostSlots.rend(); ++it)
+        hipCheck(hipHostUnregister((*it)->get()));
+
+    if (errors)
+        std::cout << "FAILED" << std::endl;
+    else
+        std::cout << "PASSED" << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "l:t:k:h")) != -1) {
+        switch (opt) {
+        case 'l':
+            len = std::max(LEN_GRANULE, std::strtoul(optarg, nullptr, 0) / LEN_GRANULE * LEN_GRANULE);
+            break;
+        case 't':
+            ntimes = std::max(2, std::atoi(optarg) + 1);
+            break;
+        case 'k':
+            only = optarg;
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-l <elements>] [-t <runs>] [-k <kernel>]\n";
+            std::cout << "  -l <elements>  Array length, rounded down to a multiple of " << LEN_GRANULE
+                      << " (default: " << DEFAULT_LEN << ")\n";
+            std::cout << "  -t <runs>      Timed runs per kernel after one warm up run (default: " << NTIMES - 1 << ")\n";
+            std::cout << "  -k <kernel>    Run only this registered kernel\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "hostexec.h"
+#include "registry.h"
+
+namespace {
+
+static const size_t LEN = 0x1000000;
+// Shard boundaries are kept a multiple of the vectoradd block size
+static const int THREADS_PER_BLOCK_X = 32;
+static const int LOOP = 200;
+static const int CALIBRATION_LOOP = 20;
+
+// One participant of the data parallel run; every method is called on the worker's own
+// thread, bind() first
+class ShardWorker {
+public:
+    virtual ~ShardWorker() {}
+    virtual std::string name() const = 0;
+    virtual void bind() = 0;
+    // Stage a shard of the inputs on the worker
+    virtual void load(const float *bbb, const float *ccc, size_t len) = 0;
+    // Run vectoradd loops times over the staged shard, return the elapsed time in us
+    virtual long long run(int loops) = 0;
+    // Copy the output of the staged shard back
+    virtual void store(float *aaa) = 0;
+};
+
+class DeviceShardWorker : public ShardWorker {
+    HipDevice mDevice;
+    hipFunction_t mFunction;
+    LaunchGeometry (*mGeometry)(size_t len);
+    hipStream_t mStream;
+    std::unique_ptr<DeviceBO<float>> mA;
+    std::unique_ptr<DeviceBO<float>> mB;
+    std::unique_ptr<DeviceBO<float>> mC;
+    std::unique_ptr<Kernel<float *, const float *, const float *>> mKernel;
+    size_t mLen;
+
+public:
+    DeviceShardWorker(int index) : mDevice(index), mFunction(nullptr), mGeometry(nullptr), mStream(nullptr), mLen(0) {}
+
+    ~DeviceShardWorker() {
+        mA.reset();
+        mB.reset();
+        mC.reset();
+        if (mStream)
+            (void)hipStreamDestroy(mStream);
+    }
+
+    std::string name() const override {
+        return "device " + std::to_string(mDevice.index());
+    }
+
+    void bind() override {
+        mDevice.makeCurrent();
+        if (!mStream) {
+            const KernelDesc &desc = KernelRegistry::find("vectoradd");
+            mFunction = mDevice.getFunction(desc.codeObject, desc.symbol);
+            mGeometry = desc.geometry;
+            hipCheck(hipStreamCreateWithFlags(&mStream, hipStreamNonBlocking));
+        }
+    }
+
+    void load(const float *bbb, const float *ccc, size_t len) override {
+        mA.reset(new DeviceBO<float>(len));
+        mB.reset(new DeviceBO<float>(len));
+        mC.reset(new DeviceBO<float>(len));
+        mLen = len;
+        mKernel.reset(new Kernel<float *, const float *, const float *>(mFunction, mA->get(), mB->get(), mC->get()));
+        hipCheck(hipMemcpyWithStream(mB->get(), bbb, len * sizeof(float), hipMemcpyHostToDevice, mStream));
+        hipCheck(hipMemcpyWithStream(mC->get(), ccc, len * sizeof(float), hipMemcpyHostToDevice, mStream));
+    }
+
+    long long run(int loops) override {
+        const LaunchGeometry geometry = mGeometry(mLen);
+        Timer timer;
+        for (int i = 0; i < loops; i++)
+            mKernel->launch(geometry, mStream);
+        hipCheck(hipStreamSynchronize(mStream));
+        return timer.stop();
+    }
+
+    void store(float *aaa) override {
+        hipCheck(hipMemcpyWithStream(aaa, mA->get(), mLen * sizeof(float), hipMemcpyDeviceToHost, mStream));
+    }
+};
+
+// Emulated device made of a group of host cores, one pinned thread per core. The shard is
+// copied into buffers first touched by the worker so they are local to its cores.
+class HostShardWorker : public ShardWorker {
+    int mIndex;
+    std::vector<int> mCpus;
+    std::vector<float> mA;
+    std::vector<float> mB;
+    std::vector<float> mC;
+
+public:
+    HostShardWorker(int index, const std::vector<int> &cpus) : mIndex(index), mCpus(cpus) {}
+
+    std::string name() const override {
+        return "host " + std::to_string(mIndex) + " (" + std::to_string(mCpus.size()) + " cpus)";
+    }
+
+    void bind() override {
+        pinThread(mCpus);
+    }
+
+    void load(const float *bbb, const float *ccc, size_t len) override {
+        mA.assign(len, 0);
+        mB.assign(bbb, bbb + len);
+        mC.assign(ccc, ccc + len);
+    }
+
+    long long run(int loops) override {
+        const size_t len = mA.size();
+        std::vector<std::thread> threads;
+        Timer timer;
+        for (size_t t = 0; t < mCpus.size(); t++) {
+            threads.push_back(std::thread([this, t, len, loops]() {
+                pinThread(std::vector<int>(1, mCpus[t]));
+                const size_t begin = t * len / mCpus.size();
+                const size_t end = (t + 1) * len / mCpus.size();
+                for (int i = 0; i < loops; i++)
+                    hostVectorAdd(mA.data() + begin, mB.data() + begin, mC.data() + begin, end - begin);
+            }));
+        }
+        for (auto &thread : threads)
+            thread.join();
+        return timer.stop();
+    }
+
+    void store(float *aaa) override {
+        std::copy(mA.begin(), mA.end(), aaa);
+    }
+};
+
+// Releases all workers into the timed region together
+class StartGate {
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    size_t mWaiting;
+    const size_t mCount;
+
+public:
+    StartGate(size_t count) : mWaiting(0), mCount(count) {}
+
+    void arrive() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (++mWaiting == mCount) {
+            mCond.notify_all();
+            return;
+        }
+        mCond.wait(lock, [this]() { return mWaiting == mCount; });
+    }
+};
+
+// Split len elements in proportion to weights; every shard is a multiple of granule
+// elements and the last shard takes the remainder
+std::vector<size_t> shardLengths(size_t len, const std::vector<double> &weights, size_t granule)
+{
+    double total = 0;
+    for (auto w : weights)
+        total += w;
+    std::vector<size_t> lengths;
+    size_t assigned = 0;
+    for (size_t i = 0; i + 1 < weights.size(); i++) {
+        size_t shard = static_cast<size_t>(len * (weights[i] / total)) / granule * granule;
+        shard = std::min(shard, len - assigned);
+        lengths.push_back(shard);
+        assigned += shard;
+    }
+    lengths.push_back(len - assigned);
+    // A device with an empty shard would launch a grid of 0 blocks
+    for (size_t i = 0; i < lengths.size(); i++) {
+        if (!lengths[i])
+            throw std::runtime_error("Shard " + std::to_string(i) + " of " + std::to_string(lengths.size()) +
+                                     " gets no elements, its device is too slow to be worth sharding to");
+    }
+    return lengths;
+}
+
+double gbps(size_t len, int loops, long long us)
+{
+    return us ? (3.0 * sizeof(float) * len * loops) / (us * 1000.0) : 0;
+}
+
+std::vector<std::unique_ptr<ShardWorker>> makeWorkers(const std::string &emulate)
+{
+    std::vector<std::unique_ptr<ShardWorker>> workers;
+    if (emulate.empty()) {
+        const int count = HipDevice::count();
+        for (int i = 0; i < count; i++)
+            workers.emplace_back(new DeviceShardWorker(i));
+        return workers;
+    }
+
+    std::vector<std::vector<int>> groups;
+    if (emulate == "numa")
+        groups = numaCpuGroups();
+    else if (emulate.find_first_of("-,:") == std::string::npos)
+        groups = splitCpuGroups(std::stoul(emulate));
+    else {
+        std::stringstream stream(emulate);
+        std::string list;
+        while (std::getline(stream, list, ':'))
+            groups.push_back(parseCpuList(list));
+    }
+    for (size_t i = 0; i < groups.size(); i++)
+        workers.emplace_back(new HostShardWorker(i, groups[i]));
+    return workers;
+}
+
+int mainworker(const std::string &emulate) {
+    std::cout << "*********************************************************************************\n";
+    std::vector<std::unique_ptr<ShardWorker>> workers = makeWorkers(emulate);
+    if (workers.empty())
+        throw std::runtime_error("No devices found");
+
+    std::unique_ptr<float[]> hostA(new float[LEN]);
+    std::unique_ptr<float[]> hostB(new float[LEN]);
+    std::unique_ptr<float[]> hostC(new float[LEN]);
+
+    // Initialize input/output vectors
+    for (size_t i = 0; i < LEN; i++) {
+        hostB[i] = i;
+        hostC[i] = i * 2;
+        hostA[i] = 0;
+    }
+
+    // Measure each worker in isolation over an equal probe shard
+    const size_t probe = LEN / workers.size() / THREADS_PER_BLOCK_X * THREADS_PER_BLOCK_X;
+    std::vector<double> weights;
+    std::cout << "Calibrating " << workers.size() << " devices over " << probe << " elements each\n";
+    for (auto &worker : workers) {
+        long long delayD = 0;
+        std::exception_ptr error;
+        std::thread thread([&]() {
+            try {
+                worker->bind();
+                worker->load(hostB.get(), hostC.get(), probe);
+                worker->run(1);
+                delayD = worker->run(CALIBRATION_LOOP);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        });
+        thread.join();
+        if (error)
+            std::rethrow_exception(error);
+        weights.push_back(gbps(probe, CALIBRATION_LOOP, delayD));
+        std::cout << worker->name() << ": " << weights.back() << " GB/s" << std::endl;
+    }
+
+    std::vector<size_t> lengths = shardLengths(LEN, weights, THREADS_PER_BLOCK_X);
+    std::vector<long long> delays(workers.size(), 0);
+    std::vector<std::exception_ptr> failures(workers.size());
+    StartGate gate(workers.size());
+    std::vector<std::thread> threads;
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Run vectoradd " << LOOP << " times over " << LEN << " elements sharded across "
+              << workers.size() << " devices" << std::endl;
+    Timer timer;
+    size_t offset = 0;
+    for (size_t i = 0; i < workers.size(); i++) {
+        threads.push_back(std::thread([&, i, offset]() {
+            // A worker which failed still arrives at the gate so that the others start
+            try {
+                workers[i]->bind();
+                workers[i]->load(hostB.get() + offset, hostC.get() + offset, lengths[i]);
+            } catch (...) {
+                failures[i] = std::current_exception();
+            }
+            gate.arrive();
+            if (failures[i])
+                return;
+            try {
+                delays[i] = workers[i]->run(LOOP);
+                workers[i]->store(hostA.get() + offset);
+            } catch (...) {
+                failures[i] = std::current_exception();
+            }
+        }));
+        offset += lengths[i];
+    }
+    for (auto &thread : threads)
+        thread.join();
+    auto delayT = timer.stop();
+    for (auto &failure : failures) {
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+    long long slowest = 0;
+    for (size_t i = 0; i < workers.size(); i++) {
+        std::cout << std::setw(24) << std::left << workers[i]->name() << std::right
+                  << std::setw(12) << lengths[i] << " elements, "
+                  << std::setw(10) << delays[i] << " us, "
+                  << gbps(lengths[i], LOOP, delays[i]) << " GB/s" << std::endl;
+        slowest = std::max(slowest, delays[i]);
+    }
+    std::cout << "Aggregate metrics" << std::endl;
+    std::cout << '(' << LOOP << " loops, " << slowest << " us, " << gbps(LEN, LOOP, slowest)
+              << " GB/s, " << delayT << " us including staging)" << std::endl;
+
+    // Verify the gathered output
+    int errors = 0;
+    for (size_t i = 0; i < LEN; i++) {
+        if (hostA[i] != (hostB[i] + hostC[i])) {
+            errors++;
+            break;
+        }
+    }
+
+    if (errors)
+        std::cout << "FAILED" << std::endl;
+    else
+        std::cout << "PASSED" << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    std::string emulate;
+    int opt;
+    while ((opt = getopt(argc, argv, "e:h")) != -1) {
+        switch (opt) {
+        case 'e':
+            emulate = optarg;
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-e numa|<count>|<cpulist>:<cpulist>...]\n";
+            std::cout << "  -e  Emulate devices with host core groups: one per NUMA node, <count> equal\n";
+            std::cout << "      groups of the online CPUs, or explicit cpulists separated by ':'\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker(emulate) ? 1 : 0;
+
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
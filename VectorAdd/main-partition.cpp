@@ -0,0 +1,321 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "hostexec.h"
+#include "hostmem.h"
+#include "registry.h"
+#include "workload.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+static const long long DURATION_MS = 1000;
+static const int SPLITS = 8;
+// Small latency critical launches next to large bandwidth bound ones
+static const size_t CRITICAL_LEN = 0x10000;
+static const size_t BULK_LEN = 0x1000000;
+static const size_t CRITICAL_DEPTH = 1;
+static const size_t BULK_DEPTH = 4;
+
+static long long durationMs = DURATION_MS;
+static int splits = SPLITS;
+static std::string targetOption = "all";
+
+// Bitmask of count compute units starting at first, as hipExtStreamCreateWithCUMask
+// takes it: bit i of word i / 32 enables CU i
+std::vector<uint32_t> cuMask(unsigned total, unsigned first, unsigned count)
+{
+    std::vector<uint32_t> mask((total + 31) / 32, 0);
+    for (unsigned cu = first; cu < std::min(total, first + count); cu++)
+        mask[cu / 32] |= 1u << (cu % 32);
+    return mask;
+}
+
+struct TenantResult {
+    size_t ops;
+    long long delay;
+    std::vector<long long> latencies;
+};
+
+void report(const std::string &split, const char *tenant, TenantResult &result)
+{
+    std::cout << std::setw(16) << split << std::setw(10) << tenant << std::fixed << std::setprecision(1)
+              << std::setw(12) << (result.delay ? (result.ops * 1000000.0)/result.delay : 0.0)
+              << std::setw(10) << percentile(result.latencies, 50.0)
+              << std::setw(10) << percentile(result.latencies, 99.0) << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+void header(const char *unit)
+{
+    std::cout << std::setw(16) << unit << std::setw(10) << "tenant" << std::setw(12) << "ops/s"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::endl;
+}
+
+// Closed loop of the workload's launches, depth deep, into the stream until end
+TenantResult runtenant(const KernelWorkload &workload, size_t depth, hipStream_t stream, Clock::time_point end)
+{
+    LaunchWindow window(depth, stream);
+    TenantResult result = {0, 0, {}};
+    Timer timer;
+    while (Clock::now() < end) {
+        window.acquire();
+        workload.launch(stream);
+        window.commit();
+        result.ops++;
+    }
+    window.drain();
+    result.delay = timer.stop();
+    result.latencies = window.latencies();
+    return result;
+}
+
+// Run the tenants concurrently, each on a stream restricted to its CUs; an empty mask
+// leaves the stream on every CU and a tenant with a null mask sits the run out
+int rundevicesplit(HipDevice &hdevice, std::vector<std::unique_ptr<KernelWorkload>> &tenants,
+                   const std::vector<const std::vector<uint32_t> *> &masks, const std::string &split,
+                   const std::vector<int> &cpus)
+{
+    static const char *names[] = {"critical", "bulk"};
+    static const size_t depths[] = {CRITICAL_DEPTH, BULK_DEPTH};
+    std::vector<hipStream_t> streams(tenants.size(), nullptr);
+    for (size_t t = 0; t < tenants.size(); t++) {
+        if (!masks[t])
+            continue;
+        if (masks[t]->empty())
+            hipCheck(hipStreamCreateWithFlags(&streams[t], hipStreamNonBlocking));
+        else
+            hipCheck(hipExtStreamCreateWithCUMask(&streams[t], masks[t]->size(), masks[t]->data()));
+    }
+
+    std::vector<TenantResult> results(tenants.size(), TenantResult{0, 0, {}});
+    const Clock::time_point end = Clock::now() + std::chrono::milliseconds(durationMs);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < tenants.size(); t++) {
+        if (!streams[t])
+            continue;
+        threads.emplace_back([&, t]() {
+            results[t] = runtenant(*tenants[t], depths[t], streams[t], end);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    int errors = 0;
+    for (size_t t = 0; t < tenants.size(); t++) {
+        if (!streams[t])
+            continue;
+        report(split, names[t], results[t]);
+        hipCheck(hipStreamDestroy(streams[t]));
+        errors += tenants[t]->validate(hdevice, cpus);
+    }
+    return errors;
+}
+
+int rundevice(HipDevice &hdevice, const std::vector<int> &cpus)
+{
+    const unsigned total = hdevice.computeUnits();
+    DeviceGenerator generator(hdevice);
+    std::vector<std::unique_ptr<KernelWorkload>> tenants;
+    tenants.emplace_back(new KernelWorkload(hdevice, generator, KernelRegistry::find("vectoradd"), CRITICAL_LEN));
+    tenants.emplace_back(new KernelWorkload(hdevice, generator, KernelRegistry::find("stream_triad"), BULK_LEN));
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Device: " << total << " CUs, critical vectoradd of " << CRITICAL_LEN << " elements " << CRITICAL_DEPTH
+              << " deep, bulk stream_triad of " << BULK_LEN << " elements " << BULK_DEPTH << " deep" << std::endl;
+    header("CUs");
+
+    const std::vector<uint32_t> all;
+    int errors = 0;
+    errors += rundevicesplit(hdevice, tenants, {&all, nullptr}, "alone", cpus);
+    errors += rundevicesplit(hdevice, tenants, {nullptr, &all}, "alone", cpus);
+    errors += rundevicesplit(hdevice, tenants, {&all, &all}, "shared", cpus);
+    for (int s = 1; s < splits; s++) {
+        const unsigned critical = std::max(1u, total * s / splits);
+        if (critical >= total)
+            break;
+        const std::vector<uint32_t> criticalMask = cuMask(total, 0, critical);
+        const std::vector<uint32_t> bulkMask = cuMask(total, critical, total - critical);
+        std::ostringstream split;
+        split << critical << '/' << total - critical;
+        errors += rundevicesplit(hdevice, tenants, {&criticalMask, &bulkMask}, split.str(), cpus);
+    }
+    return errors;
+}
+
+// One host tenant: hostVectorAdd over its arrays split across its CPUs, op after op; the
+// CPUs' worker threads are started once per run so an op pays only its wakeup
+class HostTenant {
+    size_t mLen;
+    HostBO<float> mA;
+    HostBO<float> mB;
+    HostBO<float> mC;
+
+public:
+    HostTenant(size_t len, const std::vector<int> &cpus) : mLen(len), mA(len), mB(len), mC(len) {
+        std::fill(mA.get(), mA.get() + len, 0.0f);
+        fillHost(cpus, mB.get(), len, DEFAULT_SEED, 0);
+        fillHost(cpus, mC.get(), len, DEFAULT_SEED, 1);
+    }
+
+    TenantResult run(const std::vector<int> &cpus, Clock::time_point end) {
+        TenantResult result = {0, 0, {}};
+        WorkerPool pool(cpus);
+        Timer timer;
+        while (Clock::now() < end) {
+            Timer op;
+            pool.run(mLen, [this](size_t begin, size_t end) {
+                hostVectorAdd(mA.get() + begin, mB.get() + begin, mC.get() + begin, end - begin);
+            });
+            result.latencies.push_back(op.stop());
+            result.ops++;
+        }
+        result.delay = timer.stop();
+        return result;
+    }
+
+    int validate() {
+        for (size_t i = 0; i < mLen; i++) {
+            if (mA[i] != mB[i] + mC[i])
+                return 1;
+        }
+        std::fill(mA.get(), mA.get() + mLen, 0.0f);
+        return 0;
+    }
+};
+
+std::string cpuList(const std::vector<int> &cpus)
+{
+    std::ostringstream list;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        if (i && (cpus[i] == cpus[i - 1] + 1) && ((i + 1 < cpus.size()) && (cpus[i + 1] == cpus[i] + 1)))
+            continue;
+        if (i && (cpus[i] == cpus[i - 1] + 1))
+            list << '-' << cpus[i];
+        else
+            list << (i ? "," : "") << cpus[i];
+    }
+    return list.str();
+}
+
+int runhostsplit(std::vector<std::unique_ptr<HostTenant>> &tenants, const std::vector<std::vector<int>> &sets,
+                 const std::string &split)
+{
+    static const char *names[] = {"critical", "bulk"};
+    std::vector<TenantResult> results(tenants.size(), TenantResult{0, 0, {}});
+    const Clock::time_point end = Clock::now() + std::chrono::milliseconds(durationMs);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < tenants.size(); t++) {
+        if (sets[t].empty())
+            continue;
+        threads.emplace_back([&, t]() {
+            results[t] = tenants[t]->run(sets[t], end);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    int errors = 0;
+    for (size_t t = 0; t < tenants.size(); t++) {
+        if (sets[t].empty())
+            continue;
+        report(split, names[t], results[t]);
+        errors += tenants[t]->validate();
+    }
+    return errors;
+}
+
+int runhost(const std::vector<int> &cpus)
+{
+    std::vector<std::unique_ptr<HostTenant>> tenants;
+    tenants.emplace_back(new HostTenant(CRITICAL_LEN, cpus));
+    tenants.emplace_back(new HostTenant(BULK_LEN, cpus));
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Host: CPUs " << cpuList(cpus) << ", critical add of " << CRITICAL_LEN << " elements, bulk add of "
+              << BULK_LEN << " elements" << std::endl;
+    header("CPUs");
+
+    int errors = 0;
+    errors += runhostsplit(tenants, {cpus, {}}, "alone");
+    errors += runhostsplit(tenants, {{}, cpus}, "alone");
+    errors += runhostsplit(tenants, {cpus, cpus}, "shared");
+    // Core sets: the critical tenant takes the first CPUs, the bulk tenant the rest
+    size_t last = 0;
+    for (int s = 1; s < splits; s++) {
+        const size_t critical = std::max<size_t>(1, cpus.size() * s / splits);
+        if ((critical >= cpus.size()) || (critical == last))
+            continue;
+        last = critical;
+        const std::vector<int> criticalSet(cpus.begin(), cpus.begin() + critical);
+        const std::vector<int> bulkSet(cpus.begin() + critical, cpus.end());
+        errors += runhostsplit(tenants, {criticalSet, bulkSet}, cpuList(criticalSet) + '/' + cpuList(bulkSet));
+    }
+    return errors;
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+    const std::vector<int> cpus = nodeCpus(hdevice.numaNode());
+    pinThread(cpus);
+
+    int errors = 0;
+    if ((targetOption == "all") || (targetOption == "device"))
+        errors += rundevice(hdevice, cpus);
+    if ((targetOption == "all") || (targetOption == "host"))
+        errors += runhost(cpus);
+    std::cout << (errors ? "FAILED" : "PASSED") << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "t:s:m:h")) != -1) {
+        switch (opt) {
+        case 't':
+            durationMs = std::max(1LL, std::strtoll(optarg, nullptr, 0));
+            break;
+        case 's':
+            splits = std::max(2, std::atoi(optarg));
+            break;
+        case 'm':
+            targetOption = optarg;
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-t <ms>] [-s <splits>] [-m <target>]\n";
+            std::cout << "  -t <ms>      Duration of each run (default: " << DURATION_MS << ")\n";
+            std::cout << "  -s <splits>  Sweep the critical tenant's share in steps of 1/splits (default: "
+                      << SPLITS << ")\n";
+            std::cout << "  -m <target>  device (CU masks), host (core sets) or all (default: all)\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "hostexec.h"
+#include "hostmem.h"
+#include "registry.h"
+#include "segmented.h"
+
+namespace {
+
+static const size_t SEGMENTS = 4096;
+static const double MEAN_LENGTH = 256;
+static const int LOOP = 20;
+
+static size_t segments = SEGMENTS;
+static double meanLength = MEAN_LENGTH;
+
+// Segment lengths of one distribution, all with roughly the same mean
+std::vector<unsigned> makelengths(const std::string &distribution)
+{
+    std::mt19937 generator(2023);
+    std::vector<unsigned> lengths;
+    for (size_t s = 0; s < segments; s++) {
+        double len = meanLength;
+        if (distribution == "uniform") {
+            len = std::uniform_real_distribution<double>(1, 2 * meanLength)(generator);
+        }
+        else if (distribution == "pareto") {
+            // Heavy tail, shape 1.5: mostly short segments and a few very long ones
+            const double u = std::uniform_real_distribution<double>(0, 1)(generator);
+            len = (meanLength / 3) / std::pow(1 - u, 1 / 1.5);
+        }
+        else if (distribution == "bimodal") {
+            len = (s % 64) ? meanLength / 4 : meanLength * 49 / 4;
+        }
+        lengths.push_back(std::max(1u, static_cast<unsigned>(len)));
+    }
+    return lengths;
+}
+
+void report(const char *method, const RaggedBatch &batch, long long delay, int loops)
+{
+    std::cout << std::setw(12) << method << std::setw(12) << delay/loops << std::fixed << std::setprecision(2)
+              << std::setw(12) << (3 * sizeof(float) * double(batch.total()) * loops)/(delay * 1000.0)
+              << std::setw(14) << (double(batch.count()) * loops)/delay << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+// Compare device output with the host's and clear it for the next method
+int validate(const float *expected, float *deviceA, size_t total, std::vector<float> &check)
+{
+    hipCheck(hipMemcpy(check.data(), deviceA, total * sizeof(float), hipMemcpyDeviceToHost));
+    hipCheck(hipMemset(deviceA, 0, total * sizeof(float)));
+    return std::equal(check.begin(), check.begin() + total, expected) ? 0 : 1;
+}
+
+int rundistribution(HipDevice &hdevice, const std::string &distribution, const std::vector<int> &cpus)
+{
+    const std::vector<unsigned> lengths = makelengths(distribution);
+    size_t total = 0;
+    for (auto len : lengths)
+        total += len;
+    if (total > RaggedBatch::MAX_TOTAL)
+        throw std::length_error(distribution + " batch of " + std::to_string(total) + " elements exceeds " +
+                                std::to_string(RaggedBatch::MAX_TOTAL));
+    const unsigned longest = *std::max_element(lengths.begin(), lengths.end());
+
+    // Segments are slices of three arrays on either side, each addressed on its own
+    DeviceBO<float> deviceA(total);
+    DeviceBO<float> deviceB(total);
+    DeviceBO<float> deviceC(total);
+    HostBO<float> hostA(total);
+    HostBO<float> hostB(total);
+    HostBO<float> hostC(total);
+    DeviceGenerator generator(hdevice);
+    generator.fill(deviceB.get(), total, DEFAULT_SEED, 0);
+    generator.fill(deviceC.get(), total, DEFAULT_SEED, 1);
+    hipCheck(hipMemset(deviceA.get(), 0, total * sizeof(float)));
+    fillHost(cpus, hostB.get(), total, DEFAULT_SEED, 0);
+    fillHost(cpus, hostC.get(), total, DEFAULT_SEED, 1);
+    hipCheck(hipDeviceSynchronize());
+
+    RaggedBatch deviceBatch;
+    RaggedBatch hostBatch;
+    size_t offset = 0;
+    for (auto len : lengths) {
+        deviceBatch.add(deviceA.get() + offset, deviceB.get() + offset, deviceC.get() + offset, len);
+        hostBatch.add(hostA.get() + offset, hostB.get() + offset, hostC.get() + offset, len);
+        offset += len;
+    }
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << distribution << ": " << lengths.size() << " segments, " << total << " elements, longest "
+              << longest << std::endl;
+    std::cout << std::setw(12) << "method" << std::setw(12) << "us" << std::setw(12) << "GB/s"
+              << std::setw(14) << "segments/us" << std::endl;
+
+    WorkerPool pool(cpus);
+    Timer timer;
+    for (int l = 0; l < LOOP; l++)
+        hostRaggedAdd(hostBatch, pool);
+    report("host simd", hostBatch, timer.stop(), LOOP);
+    int errors = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (hostA[i] != hostB[i] + hostC[i]) {
+            errors++;
+            break;
+        }
+    }
+    std::vector<float> check(total);
+
+    // One launch of a length checked add per segment
+    const KernelDesc &add = KernelRegistry::find("stream_add");
+    hipFunction_t function = hdevice.getFunction(add.codeObject, add.symbol);
+    std::vector<std::unique_ptr<KernelArgs>> perSegment;
+    for (size_t s = 0; s < deviceBatch.count(); s++) {
+        const Segment &segment = deviceBatch.segments()[s];
+        const std::vector<void *> slots = {reinterpret_cast<void *>(segment.aaa), reinterpret_cast<void *>(segment.bbb),
+                                           reinterpret_cast<void *>(segment.ccc)};
+        perSegment.emplace_back(new KernelArgs(add, slots, deviceBatch.length(s)));
+    }
+    timer.reset();
+    for (int l = 0; l < LOOP; l++) {
+        for (size_t s = 0; s < deviceBatch.count(); s++) {
+            const LaunchGeometry geometry = add.geometry(deviceBatch.length(s));
+            hipCheck(hipModuleLaunchKernel(function,
+                                             geometry.grid, 1, 1,
+                                             geometry.block, 1, 1,
+                                             0, 0, nullptr, perSegment[s]->config()), add.symbol);
+        }
+    }
+    hipCheck(hipDeviceSynchronize());
+    report("per vector", deviceBatch, timer.stop(), LOOP);
+    errors += validate(hostA.get(), deviceA.get(), total, check);
+
+    DeviceRaggedAdd ragged(hdevice);
+    ragged.upload(deviceBatch);
+    hipCheck(hipDeviceSynchronize());
+    timer.reset();
+    for (int l = 0; l < LOOP; l++)
+        ragged.launch();
+    hipCheck(hipDeviceSynchronize());
+    report("segmented", deviceBatch, timer.stop(), LOOP);
+    errors += validate(hostA.get(), deviceA.get(), total, check);
+
+    std::cout << (errors ? "FAILED" : "PASSED") << std::endl;
+    return errors;
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+
+    const std::vector<int> cpus = nodeCpus(hdevice.numaNode());
+    pinThread(cpus);
+
+    int errors = 0;
+    for (auto distribution : {"fixed", "uniform", "pareto", "bimodal"})
+        errors += rundistribution(hdevice, distribution, cpus);
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "s:l:h")) != -1) {
+        switch (opt) {
+        case 's':
+            segments = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'l':
+            meanLength = std::max(1.0, std::strtod(optarg, nullptr));
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-s <segments>] [-l <mean length>]\n";
+            std::cout << "  -s <segments>     Vectors per batch (default: " << SEGMENTS << ")\n";
+            std::cout << "  -l <mean length>  Mean vector length (default: " << MEAN_LENGTH << ")\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
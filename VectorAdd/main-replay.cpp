@@ -0,0 +1,600 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "record.h"
+#include "registry.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+static const char *RECORDING = "hiptrace.rec";
+static const size_t ALIGNMENT = 4096;
+
+static std::string pathOption = RECORDING;
+static bool maxSpeed = false;
+static size_t passes = 1;
+
+// Offsets of the buffer arguments in the packed arguments of a registered kernel, the
+// same layout PackedArgs builds
+std::vector<size_t> pointerOffsets(const KernelDesc &desc)
+{
+    std::vector<size_t> offsets;
+    size_t offset = 0;
+    for (auto kind : desc.args) {
+        const bool pointer = (kind == ArgKind::Output) || (kind == ArgKind::Input);
+        const size_t size = pointer ? sizeof(void *) : sizeof(unsigned);
+        offset = (offset + size - 1) / size * size;
+        if (pointer)
+            offsets.push_back(offset);
+        offset += size;
+    }
+    return offsets;
+}
+
+// Re-issues the records of one pass against buffers, modules, streams and events of
+// its own, translating the recorded handles and addresses. Memory the recording process
+// did not get from HIP, such as pageable copy buffers, is replaced by one scratch
+// buffer in copies; memsets and launches on such memory are skipped. Graph launches are not replayed; launches captured into a graph are replayed
+// once, where they were captured.
+//
+// Every recorded thread is replayed on a thread of its own, so that one thread blocked
+// in a synchronization or a synchronous copy holds up no other thread's launches. A
+// record is issued only once every other thread has issued its records which started
+// earlier; a blocking call lets the others past before it blocks, as it did when it
+// was recorded.
+class Replayer {
+    struct Allocation {
+        void *replay;
+        uint64_t bytes;
+        MemoryKind kind;
+        // Recorded device address of mapped host memory, 0 if none
+        uint64_t alias;
+    };
+
+    struct Range {
+        uint64_t bytes;
+        char *replay;
+    };
+
+    struct Function {
+        hipFunction_t function;
+        bool registered;
+        std::vector<size_t> offsets;
+    };
+
+    struct Stats {
+        size_t count;
+        size_t skipped;
+        uint64_t recordedNs;
+        uint64_t replayedNs;
+    };
+
+    // Progress of a thread which has issued all its records
+    static constexpr uint64_t DONE = UINT64_MAX;
+
+    // What each replaying thread keeps to itself
+    struct Worker {
+        std::vector<char> args;
+        std::vector<size_t> offsets;
+        Stats stats[static_cast<size_t>(RecordType::Types)];
+    };
+
+    // Guards the tables below, never held across a call which may block
+    std::mutex mMutex;
+    std::map<uint64_t, Allocation> mAllocations;
+    std::map<uint64_t, Range> mRanges;
+    std::map<uint64_t, hipModule_t> mModules;
+    std::map<uint64_t, Function> mFunctions;
+    std::map<uint64_t, hipStream_t> mStreams;
+    std::map<uint64_t, hipEvent_t> mEvents;
+    std::unique_ptr<char, decltype(&std::free)> mScratch;
+    Stats mStats[static_cast<size_t>(RecordType::Types)];
+
+    // Replay address of a recorded one, nullptr if it lies in no recorded allocation
+    void *find(uint64_t address) const {
+        auto it = mRanges.upper_bound(address);
+        if (it == mRanges.begin())
+            return nullptr;
+        --it;
+        if (address - it->first >= it->second.bytes)
+            return nullptr;
+        return it->second.replay + (address - it->first);
+    }
+
+    void *translate(uint64_t address) const {
+        if (!address)
+            return nullptr;
+        void *replay = find(address);
+        return replay ? replay : mScratch.get();
+    }
+
+    hipStream_t stream(uint64_t handle) {
+        if (!handle)
+            return nullptr;
+        hipStream_t &stream = mStreams[handle];
+        if (!stream)
+            hipCheck(hipStreamCreateWithFlags(&stream, hipStreamNonBlocking));
+        return stream;
+    }
+
+    hipEvent_t event(uint64_t handle) {
+        hipEvent_t &event = mEvents[handle];
+        if (!event)
+            hipCheck(hipEventCreateWithFlags(&event, hipEventDisableTiming));
+        return event;
+    }
+
+    void alloc(const AllocPayload &payload) {
+        void *replay = nullptr;
+        switch (static_cast<MemoryKind>(payload.kind)) {
+        case MemoryKind::Device:
+            hipCheck(hipMalloc(&replay, payload.bytes));
+            break;
+        case MemoryKind::Host:
+            hipCheck(hipHostMalloc(&replay, payload.bytes, hipHostMallocDefault));
+            break;
+        case MemoryKind::Registered:
+            replay = std::aligned_alloc(ALIGNMENT, (payload.bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+            if (!replay)
+                throw std::bad_alloc();
+            hipCheck(hipHostRegister(replay, payload.bytes, hipHostRegisterDefault));
+            break;
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        mAllocations[payload.address] = {replay, payload.bytes, static_cast<MemoryKind>(payload.kind), 0};
+        mRanges[payload.address] = {payload.bytes, static_cast<char *>(replay)};
+    }
+
+    // Remove an allocation from the tables, called with the lock held
+    Allocation take(std::map<uint64_t, Allocation>::iterator it) {
+        const Allocation allocation = it->second;
+        if (allocation.alias)
+            mRanges.erase(allocation.alias);
+        mRanges.erase(it->first);
+        mAllocations.erase(it);
+        return allocation;
+    }
+
+    static void release(const Allocation &allocation) {
+        switch (allocation.kind) {
+        case MemoryKind::Device:
+            hipCheck(hipFree(allocation.replay));
+            break;
+        case MemoryKind::Host:
+            hipCheck(hipHostFree(allocation.replay));
+            break;
+        case MemoryKind::Registered:
+            hipCheck(hipHostUnregister(allocation.replay));
+            std::free(allocation.replay);
+            break;
+        }
+    }
+
+    // Calls which may wait for the device
+    static bool blocking(const RecordEntry *entry) {
+        switch (static_cast<RecordType>(entry->type)) {
+        case RecordType::Sync:
+        case RecordType::Memset:
+            return true;
+        case RecordType::Copy: {
+            const CopyPayload *payload = RecordFile::payload<CopyPayload>(entry);
+            return payload && (static_cast<CopyCall>(payload->call) != CopyCall::Async);
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Returns false if the record could not be re-issued
+    bool issue(const RecordEntry *entry, Worker &worker) {
+        switch (static_cast<RecordType>(entry->type)) {
+        case RecordType::Alloc:
+            alloc(*RecordFile::payload<AllocPayload>(entry));
+            return true;
+        case RecordType::Free: {
+            Allocation allocation;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                auto it = mAllocations.find(RecordFile::payload<FreePayload>(entry)->address);
+                if (it == mAllocations.end())
+                    return false;
+                allocation = take(it);
+            }
+            release(allocation);
+            return true;
+        }
+        case RecordType::Map: {
+            const MapPayload *payload = RecordFile::payload<MapPayload>(entry);
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mAllocations.find(payload->host);
+            if (it == mAllocations.end())
+                return false;
+            void *device = nullptr;
+            hipCheck(hipHostGetDevicePointer(&device, it->second.replay, 0));
+            if (payload->device != payload->host) {
+                it->second.alias = payload->device;
+                mRanges[payload->device] = {it->second.bytes, static_cast<char *>(device)};
+            }
+            return true;
+        }
+        case RecordType::Module: {
+            const ModulePayload *payload = RecordFile::payload<ModulePayload>(entry);
+            const char *image = RecordFile::extra<ModulePayload>(entry, payload->bytes);
+            if (!payload->bytes || !image)
+                return false;
+            hipModule_t module;
+            hipCheck(hipModuleLoadData(&module, image));
+            std::lock_guard<std::mutex> lock(mMutex);
+            mModules[payload->module] = module;
+            return true;
+        }
+        case RecordType::Function: {
+            const FunctionPayload *payload = RecordFile::payload<FunctionPayload>(entry);
+            const std::string name(payload->name, strnlen(payload->name, sizeof(payload->name)));
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mModules.find(payload->module);
+            if (it == mModules.end())
+                return false;
+            Function function = {nullptr, false, {}};
+            hipCheck(hipModuleGetFunction(&function.function, it->second, name.c_str()), name.c_str());
+            for (auto &desc : KernelRegistry::all()) {
+                if (name == desc.symbol) {
+                    function.registered = true;
+                    function.offsets = pointerOffsets(desc);
+                }
+            }
+            mFunctions[payload->function] = function;
+            return true;
+        }
+        case RecordType::Launch: {
+            const LaunchPayload *payload = RecordFile::payload<LaunchPayload>(entry);
+            const char *args = RecordFile::extra<LaunchPayload>(entry, payload->argBytes);
+            if ((payload->flags & LaunchPayload::ARGS_MISSING) || !args)
+                return false;
+            std::vector<char> &packed = worker.args;
+            packed.assign(args, args + payload->argBytes);
+            hipFunction_t function;
+            hipStream_t queue;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                auto it = mFunctions.find(payload->function);
+                if (it == mFunctions.end())
+                    return false;
+                function = it->second.function;
+                // Buffer arguments by the registered layout, otherwise every aligned word
+                // which points into a recorded allocation
+                if (!it->second.registered) {
+                    worker.offsets.clear();
+                    for (size_t offset = 0; offset + sizeof(uint64_t) <= packed.size(); offset += sizeof(uint64_t)) {
+                        uint64_t value;
+                        std::memcpy(&value, &packed[offset], sizeof(value));
+                        if (find(value))
+                            worker.offsets.push_back(offset);
+                    }
+                }
+                for (auto offset : it->second.registered ? it->second.offsets : worker.offsets) {
+                    if (offset + sizeof(uint64_t) > packed.size())
+                        continue;
+                    uint64_t value;
+                    std::memcpy(&value, &packed[offset], sizeof(value));
+                    // A buffer outside every recorded allocation would fault the device
+                    void *replay = find(value);
+                    if (value && !replay)
+                        return false;
+                    std::memcpy(&packed[offset], &replay, sizeof(replay));
+                }
+                queue = stream(payload->stream);
+            }
+            size_t size = packed.size();
+            void *config[] = {HIP_LAUNCH_PARAM_BUFFER_POINTER, packed.data(), HIP_LAUNCH_PARAM_BUFFER_SIZE, &size,
+                              HIP_LAUNCH_PARAM_END};
+            hipCheck(hipModuleLaunchKernel(function,
+                                             payload->grid[0], payload->grid[1], payload->grid[2],
+                                             payload->block[0], payload->block[1], payload->block[2],
+                                             payload->shared, queue, nullptr, config));
+            return true;
+        }
+        case RecordType::Copy: {
+            const CopyPayload *payload = RecordFile::payload<CopyPayload>(entry);
+            void *dst;
+            const void *src;
+            hipStream_t queue;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                dst = translate(payload->dst);
+                src = translate(payload->src);
+                queue = stream(payload->stream);
+            }
+            const hipMemcpyKind kind = static_cast<hipMemcpyKind>(payload->kind);
+            switch (static_cast<CopyCall>(payload->call)) {
+            case CopyCall::Memcpy:
+                hipCheck(hipMemcpy(dst, src, payload->bytes, kind));
+                break;
+            case CopyCall::Async:
+                hipCheck(hipMemcpyAsync(dst, src, payload->bytes, kind, queue));
+                break;
+            case CopyCall::WithStream:
+                hipCheck(hipMemcpyWithStream(dst, src, payload->bytes, kind, queue));
+                break;
+            }
+            return true;
+        }
+        case RecordType::Memset: {
+            const MemsetPayload *payload = RecordFile::payload<MemsetPayload>(entry);
+            // Only into recorded allocations, the scratch buffer is host memory sized for copies
+            void *dst;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                dst = find(payload->dst);
+            }
+            if (!dst)
+                return false;
+            hipCheck(hipMemset(dst, payload->value, payload->bytes));
+            return true;
+        }
+        case RecordType::Sync: {
+            const SyncPayload *payload = RecordFile::payload<SyncPayload>(entry);
+            switch (static_cast<SyncKind>(payload->kind)) {
+            case SyncKind::Device:
+                hipCheck(hipDeviceSynchronize());
+                break;
+            case SyncKind::Stream: {
+                hipStream_t queue;
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    queue = stream(payload->object);
+                }
+                hipCheck(hipStreamSynchronize(queue));
+                break;
+            }
+            case SyncKind::Event: {
+                hipEvent_t recorded;
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    auto it = mEvents.find(payload->object);
+                    if (it == mEvents.end())
+                        return false;
+                    recorded = it->second;
+                }
+                hipCheck(hipEventSynchronize(recorded));
+                break;
+            }
+            }
+            return true;
+        }
+        case RecordType::EventRecord: {
+            const HandlePayload *payload = RecordFile::payload<HandlePayload>(entry);
+            std::lock_guard<std::mutex> lock(mMutex);
+            hipCheck(hipEventRecord(event(payload->handle), stream(payload->stream)));
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Replay the records of one recorded thread. progress[t] is the start time of the
+    // first record thread t has not let the others past yet.
+    void replay(const std::vector<const RecordEntry *> &entries, size_t self, std::atomic<uint64_t> *progress,
+                size_t threads, uint64_t first, Clock::time_point begin, bool flatOut, Worker &worker) {
+        for (size_t k = 0; k < entries.size(); k++) {
+            const RecordEntry *entry = entries[k];
+            const uint64_t next = (k + 1 < entries.size()) ? entries[k + 1]->time : DONE;
+            Stats &stats = worker.stats[std::min<size_t>(entry->type, static_cast<size_t>(RecordType::Types) - 1)];
+            stats.count++;
+            if (entry->status != hipSuccess) {
+                stats.skipped++;
+                progress[self].store(next);
+                continue;
+            }
+            for (size_t t = 0; t < threads; t++) {
+                while ((t != self) && (progress[t].load() < entry->time))
+                    std::this_thread::yield();
+            }
+            if (!flatOut)
+                std::this_thread::sleep_until(begin + std::chrono::nanoseconds(entry->time - first));
+            const bool waits = blocking(entry);
+            if (waits)
+                progress[self].store(next);
+            const Clock::time_point start = Clock::now();
+            if (issue(entry, worker)) {
+                stats.recordedNs += entry->duration;
+                stats.replayedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            }
+            else {
+                stats.skipped++;
+            }
+            if (!waits)
+                progress[self].store(next);
+        }
+        progress[self].store(DONE);
+    }
+
+public:
+    Replayer(size_t scratchBytes) : mScratch(nullptr, &std::free) {
+        std::memset(mStats, 0, sizeof(mStats));
+        if (scratchBytes) {
+            mScratch.reset(static_cast<char *>(std::aligned_alloc(ALIGNMENT, (scratchBytes + ALIGNMENT - 1) /
+                                                                  ALIGNMENT * ALIGNMENT)));
+            if (!mScratch)
+                throw std::bad_alloc();
+        }
+    }
+
+    ~Replayer() {
+        (void)hipDeviceSynchronize();
+        for (auto &event : mEvents)
+            (void)hipEventDestroy(event.second);
+        for (auto &stream : mStreams)
+            (void)hipStreamDestroy(stream.second);
+        try {
+            while (!mAllocations.empty())
+                release(take(mAllocations.begin()));
+        } catch (std::exception &) {
+        }
+        for (auto &module : mModules)
+            (void)hipModuleUnload(module.second);
+    }
+
+    Replayer(const Replayer &) = delete;
+    Replayer &operator=(const Replayer &) = delete;
+
+    // Issue the records, each recorded thread's from a thread of its own, at their
+    // recorded offsets unless flat out; returns the time the pass took in us
+    long long run(const std::vector<const RecordEntry *> &entries, bool flatOut) {
+        std::map<uint32_t, std::vector<const RecordEntry *>> byThread;
+        for (auto entry : entries)
+            byThread[entry->thread].push_back(entry);
+        const size_t threads = byThread.size();
+        std::unique_ptr<std::atomic<uint64_t>[]> progress(new std::atomic<uint64_t>[threads]);
+        std::vector<Worker> workers(threads);
+        std::vector<std::exception_ptr> errors(threads);
+        size_t t = 0;
+        for (auto &recorded : byThread)
+            progress[t++].store(recorded.second.front()->time);
+
+        const uint64_t first = entries.empty() ? 0 : entries.front()->time;
+        const Clock::time_point begin = Clock::now();
+        std::vector<std::thread> replaying;
+        t = 0;
+        for (auto &recorded : byThread) {
+            std::memset(workers[t].stats, 0, sizeof(workers[t].stats));
+            replaying.emplace_back([&, t]() {
+                try {
+                    replay(recorded.second, t, progress.get(), threads, first, begin, flatOut, workers[t]);
+                } catch (...) {
+                    errors[t] = std::current_exception();
+                    progress[t].store(DONE);
+                }
+            });
+            t++;
+        }
+        for (auto &thread : replaying)
+            thread.join();
+        for (auto &error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+        hipCheck(hipDeviceSynchronize());
+        const long long delay = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count();
+
+        for (auto &worker : workers) {
+            for (size_t type = 0; type < static_cast<size_t>(RecordType::Types); type++) {
+                mStats[type].count += worker.stats[type].count;
+                mStats[type].skipped += worker.stats[type].skipped;
+                mStats[type].recordedNs += worker.stats[type].recordedNs;
+                mStats[type].replayedNs += worker.stats[type].replayedNs;
+            }
+        }
+        return delay;
+    }
+
+    // Time spent in the calls of the records re-issued, as recorded and as replayed; the
+    // replayed time includes translating handles and addresses
+    void print(std::ostream &stream) const {
+        stream << std::setw(10) << "record" << std::setw(10) << "count" << std::setw(10) << "skipped"
+               << std::setw(14) << "recorded us" << std::setw(14) << "replayed us" << std::endl;
+        for (size_t t = 1; t < static_cast<size_t>(RecordType::Types); t++) {
+            const Stats &stats = mStats[t];
+            if (!stats.count)
+                continue;
+            stream << std::setw(10) << recordTypeName(t) << std::setw(10) << stats.count << std::setw(10) << stats.skipped
+                   << std::fixed << std::setprecision(1) << std::setw(14) << stats.recordedNs / 1000.0
+                   << std::setw(14) << stats.replayedNs / 1000.0 << std::endl;
+            stream.unsetf(std::ios_base::floatfield);
+        }
+    }
+};
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    RecordFile recording(pathOption);
+    const std::vector<const RecordEntry *> &entries = recording.entries();
+    if (entries.empty()) {
+        std::cout << pathOption << " holds no records" << std::endl;
+        std::cout << "FAILED" << std::endl;
+        return 1;
+    }
+
+    std::set<uint32_t> threads;
+    size_t scratchBytes = 0;
+    for (auto entry : entries) {
+        threads.insert(entry->thread);
+        if (entry->type == static_cast<uint32_t>(RecordType::Copy))
+            scratchBytes = std::max<size_t>(scratchBytes, RecordFile::payload<CopyPayload>(entry)->bytes);
+    }
+    const uint64_t span = entries.back()->time + entries.back()->duration - entries.front()->time;
+
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Recording " << pathOption << ": " << entries.size() << " records in " << recording.bytes()
+              << " bytes from " << threads.size() << " threads, " << span / 1000 << " us" << std::endl;
+
+    for (size_t p = 0; p < passes; p++) {
+        Replayer replayer(scratchBytes);
+        const long long delay = replayer.run(entries, maxSpeed);
+        std::cout << "---------------------------------------------------------------------------------\n";
+        std::cout << "Pass " << p << " at " << (maxSpeed ? "maximal" : "original") << " speed: " << delay
+                  << " us (recorded " << span / 1000 << " us)" << std::endl;
+        replayer.print(std::cout);
+    }
+    std::cout << "PASSED" << std::endl;
+    return 0;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "f:m:n:h")) != -1) {
+        switch (opt) {
+        case 'f':
+            pathOption = optarg;
+            break;
+        case 'm':
+            maxSpeed = (std::string(optarg) == "max");
+            break;
+        case 'n':
+            passes = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-f <file>] [-m <speed>] [-n <passes>]\n";
+            std::cout << "  -f <file>    Recording made with HIPTRACE_RECORD, see hiptrace.cpp (default: "
+                      << RECORDING << ")\n";
+            std::cout << "  -m <speed>   original keeps the recorded timing, max issues flat out (default: original)\n";
+            std::cout << "  -n <passes>  Times to replay the recording (default: 1)\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
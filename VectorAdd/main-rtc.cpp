@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "rtc.h"
+#include "rtc-hip.h"
+
+namespace {
+
+static const unsigned LEN = 0x100000;
+static const int THREADS_PER_BLOCK_X = 256;
+static const int LOOP = 100;
+
+// Specialized at runtime with -DT=<type> -DLEN=<elements> -DUNROLL=<elements per thread>.
+// hiprtc builds the kernel, the host compiler the loop which stands in for it.
+static const char *VECTORADD_SOURCE = R"(
+#ifdef __HIPCC_RTC__
+extern "C" __global__ void
+vectoradd(T* __restrict__ aaa, const T* __restrict__ bbb, const T* __restrict__ ccc)
+{
+    const unsigned base = (blockDim.x * blockIdx.x + threadIdx.x) * UNROLL;
+#pragma unroll
+    for (unsigned k = 0; k < UNROLL; k++) {
+        if (base + k < LEN)
+            aaa[base + k] = bbb[base + k] + ccc[base + k];
+    }
+}
+#else
+extern "C" void
+vectoradd(T* __restrict__ aaa, const T* __restrict__ bbb, const T* __restrict__ ccc)
+{
+    for (unsigned base = 0; base < LEN; base += UNROLL) {
+        for (unsigned k = 0; k < UNROLL; k++) {
+            if (base + k < LEN)
+                aaa[base + k] = bbb[base + k] + ccc[base + k];
+        }
+    }
+}
+#endif
+)";
+
+// Run on the host through the host compiler, no GPU needed
+static bool host = false;
+
+struct Variant {
+    const char *type;
+    unsigned unroll;
+};
+
+static const Variant VARIANTS[] = {
+    {"float", 1}, {"float", 4}, {"double", 1}, {"double", 4}, {"int", 1}, {"int", 4}
+};
+
+std::vector<std::string> options(const Variant &variant)
+{
+    return {"-O3", std::string("-DT=") + variant.type, "-DLEN=" + std::to_string(LEN),
+            "-DUNROLL=" + std::to_string(variant.unroll)};
+}
+
+// Build, load and run one specialization, return 0 if its output validates
+template<typename T> int runvariant(HipDevice *hdevice, RtcCompiler &compiler, CodeObjectCache &cache,
+                                    const Variant &variant)
+{
+    std::unique_ptr<T[]> hostA(new T[LEN]);
+    std::unique_ptr<T[]> hostB(new T[LEN]);
+    std::unique_ptr<T[]> hostC(new T[LEN]);
+    for (unsigned i = 0; i < LEN; i++) {
+        hostB[i] = i;
+        hostC[i] = i * 2;
+        hostA[i] = 0;
+    }
+
+    bool hit = false;
+    Timer timer;
+    std::vector<char> image = cache.get(compiler, VECTORADD_SOURCE, "vectoradd.cpp", options(variant), &hit);
+    auto delayB = timer.stop();
+
+    long long delayL = 0;
+    long long delayD = 0;
+    if (host) {
+        typedef void (*Function)(T *, const T *, const T *);
+        timer.reset();
+        HostModule module(image);
+        Function function = module.symbol<Function>("vectoradd");
+        delayL = timer.stop();
+
+        timer.reset();
+        for (int i = 0; i < LOOP; i++)
+            function(hostA.get(), hostB.get(), hostC.get());
+        delayD = timer.stop();
+    }
+    else {
+        const std::string key = CodeObjectCache::key(compiler, VECTORADD_SOURCE, options(variant));
+        timer.reset();
+        hipFunction_t function = hdevice->getFunction(key, image.data(), "vectoradd");
+        delayL = timer.stop();
+
+        DeviceBO<T> deviceA(LEN);
+        DeviceBO<T> deviceB(LEN);
+        DeviceBO<T> deviceC(LEN);
+        hipCheck(hipMemcpy(deviceB.get(), hostB.get(), LEN * sizeof(T), hipMemcpyHostToDevice));
+        hipCheck(hipMemcpy(deviceC.get(), hostC.get(), LEN * sizeof(T), hipMemcpyHostToDevice));
+        void *args[] = {&deviceA.get(), &deviceB.get(), &deviceC.get()};
+
+        const unsigned threads = (LEN + variant.unroll - 1) / variant.unroll;
+        timer.reset();
+        for (int i = 0; i < LOOP; i++) {
+            hipCheck(hipModuleLaunchKernel(function,
+                                             (threads + THREADS_PER_BLOCK_X - 1)/THREADS_PER_BLOCK_X, 1, 1,
+                                             THREADS_PER_BLOCK_X, 1, 1,
+                                             0, 0, args, nullptr), "vectoradd");
+        }
+        hipCheck(hipDeviceSynchronize());
+        delayD = timer.stop();
+        hipCheck(hipMemcpy(hostA.get(), deviceA.get(), LEN * sizeof(T), hipMemcpyDeviceToHost));
+    }
+
+    int errors = 0;
+    for (unsigned i = 0; i < LEN; i++) {
+        if (hostA[i] != (hostB[i] + hostC[i])) {
+            errors++;
+            break;
+        }
+    }
+
+    std::cout << "vectoradd<" << std::setw(6) << std::left << variant.type << std::right << "> UNROLL="
+              << variant.unroll << (hit ? " hit,  " : " miss, ") << std::setw(8) << delayB << " us build, "
+              << std::setw(6) << delayL << " us load, "
+              << (3.0 * sizeof(T) * LEN * LOOP)/(delayD * 1000.0) << " GB/s "
+              << (errors ? "FAILED" : "PASSED") << std::endl;
+    return errors;
+}
+
+int runvariants(HipDevice *hdevice, RtcCompiler &compiler, CodeObjectCache &cache)
+{
+    int errors = 0;
+    for (auto &variant : VARIANTS) {
+        if (!std::strcmp(variant.type, "float"))
+            errors += runvariant<float>(hdevice, compiler, cache, variant);
+        else if (!std::strcmp(variant.type, "double"))
+            errors += runvariant<double>(hdevice, compiler, cache, variant);
+        else
+            errors += runvariant<int>(hdevice, compiler, cache, variant);
+    }
+    return errors;
+}
+
+// The device, when there is one, and the compiler targeting it
+std::unique_ptr<RtcCompiler> makecompiler(std::unique_ptr<HipDevice> &hdevice, bool showInfo)
+{
+    if (host)
+        return std::unique_ptr<RtcCompiler>(new HostCompiler);
+    hdevice.reset(new HipDevice);
+    if (showInfo)
+        hdevice->showInfo(std::cout);
+    return std::unique_ptr<RtcCompiler>(new HiprtcCompiler(hdevice->arch()));
+}
+
+// Every process builds the same variants at once through the shared cache, each variant
+// must be compiled once and end up as exactly one entry. The ROCm runtime is not fork
+// safe once initialized, so the processes are forked before this one touches HIP and
+// each initializes its own. Returns the number of processes which failed.
+int runprocesses(const std::string &dir, size_t maxBytes, int processes)
+{
+    std::cout << "Building " << sizeof(VARIANTS)/sizeof(VARIANTS[0]) << " variants from " << processes
+              << " processes" << std::endl;
+    std::cout.flush();
+    std::vector<pid_t> children;
+    for (int p = 0; p < processes; p++) {
+        const pid_t pid = fork();
+        if (pid < 0)
+            throw std::system_error(errno, std::generic_category(), "fork");
+        if (pid == 0) {
+            int status = 1;
+            try {
+                std::unique_ptr<HipDevice> hdevice;
+                std::unique_ptr<RtcCompiler> compiler = makecompiler(hdevice, false);
+                CodeObjectCache cache(dir, maxBytes);
+                status = runvariants(hdevice.get(), *compiler, cache);
+            } catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+            }
+            std::cout.flush();
+            _exit(status ? 1 : 0);
+        }
+        children.push_back(pid);
+    }
+
+    int errors = 0;
+    for (auto pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+            errors++;
+    }
+    return errors;
+}
+
+int mainworker(const std::string &dir, size_t maxBytes, int processes) {
+
+    std::cout << "*********************************************************************************\n";
+    int errors = 0;
+    if (processes > 1) {
+        errors += runprocesses(dir, maxBytes, processes);
+        std::cout << "---------------------------------------------------------------------------------\n";
+    }
+
+    std::unique_ptr<HipDevice> hdevice;
+    std::unique_ptr<RtcCompiler> compiler = makecompiler(hdevice, true);
+    std::cout << "Compiler target " << compiler->target() << std::endl;
+
+    CodeObjectCache cache(dir, maxBytes);
+    std::cout << "Code object cache " << cache.dir() << " (" << cache.usage() << " entries)" << std::endl;
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Cold or warm start, depending on the cache" << std::endl;
+    errors += runvariants(hdevice.get(), *compiler, cache);
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Warm start" << std::endl;
+    errors += runvariants(hdevice.get(), *compiler, cache);
+
+    size_t bytes = 0;
+    const size_t entries = cache.usage(&bytes);
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << cache.hits() << " hits, " << cache.misses() << " misses, " << entries << " entries, "
+              << bytes/1024 << " KB in cache" << std::endl;
+    if (errors)
+        std::cout << "FAILED" << std::endl;
+    else
+        std::cout << "PASSED" << std::endl;
+    return errors;
+}
+
+void usage(const char *prog)
+{
+    std::cout << "Usage: " << prog << " [-H] [-c <dir>] [-m <MB>] [-x] [-P <processes>]\n";
+    std::cout << "  -H               Compile shared objects for the host instead of code objects\n";
+    std::cout << "  -c <dir>         Cache directory (default: " << CodeObjectCache::defaultDir() << ")\n";
+    std::cout << "  -m <MB>          Cache size budget before least recently used entries are evicted\n";
+    std::cout << "  -x               Empty the cache first for a cold start\n";
+    std::cout << "  -P <processes>   Build concurrently from several processes sharing the cache\n";
+}
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = CodeObjectCache::defaultDir();
+    size_t maxBytes = CodeObjectCache::DEFAULT_MAX_BYTES;
+    bool clear = false;
+    int processes = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "Hc:m:xP:h")) != -1) {
+        switch (opt) {
+        case 'H':
+            host = true;
+            break;
+        case 'c':
+            dir = optarg;
+            break;
+        case 'm':
+            maxBytes = std::strtoul(optarg, nullptr, 0) * 0x100000;
+            break;
+        case 'x':
+            clear = true;
+            break;
+        case 'P':
+            processes = std::atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        // Evicting down to a zero budget empties the cache
+        if (clear)
+            CodeObjectCache(dir, 0).evict();
+        return mainworker(dir, maxBytes, processes) ? 1 : 0;
+
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "registry.h"
+
+namespace {
+
+static const int LEN = 0x100000;
+
+static const char *MODES[] = {"file", "embedded", "preload"};
+
+// Time to first launch of vectoradd in a fresh process, broken down by phase. Modes:
+// file loads kernel.co from the working directory, embedded loads the copy linked into
+// the executable and preload does so from a background thread started right after
+// runtime init, overlapping the device query.
+int firstlaunch(const std::string &mode)
+{
+    const KernelDesc &desc = KernelRegistry::find("vectoradd");
+    const LaunchGeometry geometry = desc.geometry(LEN);
+
+    Timer total;
+    Timer timer;
+    hipCheck(hipInit(0));
+    HipDevice hdevice;
+    if (mode == "preload")
+        hdevice.preload();
+    auto delayInit = timer.stop();
+
+    timer.reset();
+    std::ostringstream info;
+    hdevice.showInfo(info);
+    auto delayQuery = timer.stop();
+
+    timer.reset();
+    hipModule_t hmodule = hdevice.getModule(desc.codeObject, mode != "file");
+    auto delayLoad = timer.stop();
+
+    timer.reset();
+    hipFunction_t function;
+    hipCheck(hipModuleGetFunction(&function, hmodule, desc.symbol), desc.symbol);
+    auto delayResolve = timer.stop();
+
+    timer.reset();
+    DeviceBO<float> deviceA(LEN);
+    DeviceBO<float> deviceB(LEN);
+    DeviceBO<float> deviceC(LEN);
+    auto delayAlloc = timer.stop();
+
+    timer.reset();
+    void *args[] = {&deviceA.get(), &deviceB.get(), &deviceC.get()};
+    hipCheck(hipModuleLaunchKernel(function,
+                                     geometry.grid, 1, 1,
+                                     geometry.block, 1, 1,
+                                     0, 0, args, nullptr), desc.symbol);
+    hipCheck(hipDeviceSynchronize());
+    auto delayLaunch = timer.stop();
+    auto delayTotal = total.stop();
+
+    std::cout << std::setw(10) << mode << std::setw(10) << delayInit << std::setw(10) << delayQuery
+              << std::setw(10) << delayLoad << std::setw(10) << delayResolve << std::setw(10) << delayAlloc
+              << std::setw(10) << delayLaunch << std::setw(10) << delayTotal << std::endl;
+    return 0;
+}
+
+// Each mode runs in its own child so every measurement starts from an uninitialized
+// runtime; the parent never touches HIP
+int mainworker(const std::string &mode) {
+    std::cout << "*********************************************************************************\n";
+    std::cout << "Time to first launch of vectoradd in us" << std::endl;
+    std::cout << std::setw(10) << "mode" << std::setw(10) << "init" << std::setw(10) << "query"
+              << std::setw(10) << "load" << std::setw(10) << "resolve" << std::setw(10) << "alloc"
+              << std::setw(10) << "launch" << std::setw(10) << "total" << std::endl;
+    std::cout.flush();
+
+    int errors = 0;
+    for (auto m : MODES) {
+        if (!mode.empty() && mode != m)
+            continue;
+        const pid_t pid = fork();
+        if (pid < 0)
+            throw std::system_error(errno, std::generic_category(), "fork");
+        if (pid == 0) {
+            int status = 1;
+            try {
+                status = firstlaunch(m);
+            } catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+            }
+            std::cout.flush();
+            _exit(status);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+            errors++;
+    }
+
+    if (errors)
+        std::cout << "FAILED" << std::endl;
+    else
+        std::cout << "PASSED" << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    std::string mode;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:h")) != -1) {
+        switch (opt) {
+        case 'm':
+            mode = optarg;
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-m file|embedded|preload]\n";
+            std::cout << "  -m  Measure only one way of loading the kernel (default: all)\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker(mode) ? 1 : 0;
+
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -7,7 +7,13 @@
 #include <algorithm>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
+
+#include <unistd.h>
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
@@ -15,177 +21,290 @@
 #include "hip/hip_runtime_api.h"
 
 #include "common.h"
-
-#define FILENAME "kernel.co"
-#define KERNELNAME "vectoradd"
-
-#define NOP_FILENAME "nop.co"
-#define NOP_KERNELNAME "mynop"
+#include "hostexec.h"
+#include "hostmem.h"
+#include "generate.h"
+#include "log.h"
+#include "registry.h"
+#include "verify.h"
 
 namespace {
 
 static const int LEN = 0x100000;
 static const int SIZE = LEN * sizeof(float);
-static const int THREADS_PER_BLOCK_X = 32;
 static const int LOOP = 1000;
 
+// Maximum number of launches in flight per stream, 0 means unbounded
+static size_t depth = 0;
+// NUMA node for host buffers and worker threads; by default the device's node
+static int node = -1;
+static bool nodeSet = false;
+// Comma separated registered kernels run side by side, "all" for every one
+static const char *DEFAULT_KERNELS = "vectoradd,mynop";
+static std::string kernelsOption = DEFAULT_KERNELS;
+
+// Kernels named by the -k list, in registration order
+std::vector<const KernelDesc *> selectkernels(const std::string &list)
+{
+    std::vector<std::string> names;
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ','))
+        names.push_back(name);
+
+    std::vector<const KernelDesc *> kernels;
+    for (auto &desc : KernelRegistry::all()) {
+        if ((list == "all") || (std::find(names.begin(), names.end(), desc.symbol) != names.end()))
+            kernels.push_back(&desc);
+    }
+    for (auto &n : names) {
+        if ((n != "all") && std::none_of(kernels.begin(), kernels.end(), [&](const KernelDesc *desc) {
+            return n == desc->symbol;
+        }))
+            throw std::invalid_argument("Kernel " + n + " is not registered");
+    }
+    return kernels;
+}
 
-void runkernel(hipFunction_t function, hipStream_t stream, void *args[])
+void runkernel(const KernelDesc &desc, hipFunction_t function, hipStream_t stream, void *config[])
 {
-    const char *name = hipKernelNameRef(function);
-    std::cout << "Running " << name << ' ' << LOOP << " times...\n";
+    const char *name = desc.symbol;
+    LogLine() << "Running " << name << ' ' << LOOP << " times...";
     Timer timer;
 
-    const int globalr = std::strcmp(name, NOP_KERNELNAME) ? LEN/THREADS_PER_BLOCK_X : 1;
-    const int localr = std::strcmp(name, NOP_KERNELNAME) ? THREADS_PER_BLOCK_X : 1;
+    const LaunchGeometry geometry = desc.geometry(LEN);
+
+    if (depth) {
+        LaunchWindow window(depth, stream);
+        for (int i = 0; i < LOOP; i++) {
+            window.acquire();
+            hipCheck(hipModuleLaunchKernel(function,
+                                             geometry.grid, 1, 1,
+                                             geometry.block, 1, 1,
+                                             0, stream, nullptr, config), name);
+            window.commit();
+        }
+        window.drain();
+        auto delayD = timer.stop();
+
+        LogLine() << "Throughput metrics\n"
+                  << '(' << LOOP << " loops, " << delayD << " us, " << (LOOP * 1000000.0)/delayD
+                  << " ops/s, " << depth << " in-flight depth, " << percentile(window.latencies(), 99.0)
+                  << " us p99 submit-to-retire latency)";
+        return;
+    }
 
     for (int i = 0; i < LOOP; i++) {
         hipCheck(hipModuleLaunchKernel(function,
-                                         globalr, 1, 1,
-                                         localr, 1, 1,
-                                         0, stream, args, nullptr), name);
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         0, stream, nullptr, config), name);
     }
     hipCheck(hipStreamSynchronize(stream));
     auto delayD = timer.stop();
 
-    std::cout << "Throughput metrics" << std::endl;
-    std::cout << '(' << LOOP << " loops, " << delayD << " us, " << (LOOP * 1000000.0)/delayD
-              << " ops/s, " << delayD/LOOP << " us average pipelined latency)" << std::endl;
+    LogLine() << "Throughput metrics\n"
+              << '(' << LOOP << " loops, " << delayD << " us, " << (LOOP * 1000000.0)/delayD
+              << " ops/s, " << delayD/LOOP << " us average pipelined latency)";
 
 }
 
-int mainworkerthread(hipFunction_t function, hipStream_t stream, bool validate = true) {
-
-    std::cout << "*********************************************************************************\n";
-
-    std::unique_ptr<float[]> hostA(new float[LEN]);
-    std::unique_ptr<float[]> hostB(new float[LEN]);
-    std::unique_ptr<float[]> hostC(new float[LEN]);
+// Check the output against the kernel's host reference over inputs regenerated from the
+// seed, then reset it for the subsequent test; kernels without a reference always pass
+int validate(const KernelDesc &desc, float *output, const std::vector<int> &cpus)
+{
+    if (!desc.reference)
+        return 0;
+    const VerifyResult result = verifyGenerated(desc, output, DEFAULT_SEED, LEN, cpus);
+    std::fill(output, output + LEN, 0.0f);
+    return result.count ? 1 : 0;
+}
 
-    // Initialize input/output vectors
-    for (int i = 0; i < LEN; i++) {
-        hostB[i] = i;
-        hostC[i] = i * 2;
-        hostA[i] = 0;
+int mainworkerthread(HipDevice &hdevice, const KernelDesc &desc, hipFunction_t function, hipStream_t stream,
+                     int hostNode) {
+
+    // Submit from, and first touch host buffers on, the CPUs of the chosen node
+    const std::vector<int> cpus = nodeCpus(hostNode);
+    pinThread(cpus);
+
+    LogLine() << "*********************************************************************************";
+
+    // Slot 0 is the output, slot 1 + k the k-th input
+    const size_t count = 1 + desc.count(ArgKind::Input);
+    std::vector<std::unique_ptr<HostBO<float>>> hostSlots;
+    std::vector<std::unique_ptr<DeviceBO<float>>> deviceSlots;
+    std::vector<void *> hostBuffers;
+    std::vector<void *> deviceBuffers;
+    for (size_t s = 0; s < count; s++) {
+        hostSlots.emplace_back(new HostBO<float>(LEN, hostNode));
+        deviceSlots.emplace_back(new DeviceBO<float>(LEN));
+        hostBuffers.push_back(hostSlots.back()->get());
+        deviceBuffers.push_back(deviceSlots.back()->get());
     }
 
-    DeviceBO<float> deviceA(LEN);
-    DeviceBO<float> deviceB(LEN);
-    DeviceBO<float> deviceC(LEN);
-
-    // Sync host buffers to device
-    hipCheck(hipMemcpyWithStream(deviceB.get(), hostB.get(), SIZE, hipMemcpyHostToDevice, stream));
-    hipCheck(hipMemcpyWithStream(deviceC.get(), hostC.get(), SIZE, hipMemcpyHostToDevice, stream));
+    // Initialize input/output vectors, input k is Philox stream k; device inputs are
+    // generated in place rather than uploaded
+    std::fill(hostSlots[0]->get(), hostSlots[0]->get() + LEN, 0.0f);
+    DeviceGenerator generator(hdevice);
+    for (size_t s = 1; s < count; s++) {
+        fillHost(hostSlots[s]->get(), 0, LEN, DEFAULT_SEED, s - 1);
+        generator.fill(static_cast<float *>(deviceBuffers[s]), LEN, DEFAULT_SEED, s - 1, stream);
+    }
 
-    void *argsD[] = {&deviceA.get(), &deviceB.get(), &deviceC.get()};
+    KernelArgs argsD(desc, deviceBuffers, LEN);
 
-    std::cout << "---------------------------------------------------------------------------------\n";
-    std::cout << "Run " << hipKernelNameRef(function) << ' ' << LOOP << " times using device resident memory" << std::endl;
-    std::cout << "Host buffers: " << hostA.get() << ", "
-              << hostB.get() << ", " << hostC.get() << std::endl;
-    std::cout << "Device buffers: " << deviceA.get() << ", "
-              << deviceB.get() << ", " << deviceC.get() << std::endl;
+    // One record per buffer list, a record holds at most LogRecord::TEXT characters
+    LogLine() << "---------------------------------------------------------------------------------\n"
+              << "Run " << desc.symbol << ' ' << LOOP << " times using device resident memory";
+    {
+        LogLine line;
+        line << "Host buffers:";
+        for (auto b : hostBuffers)
+            line << ' ' << b;
+    }
+    {
+        LogLine line;
+        line << "Device buffers:";
+        for (auto b : deviceBuffers)
+            line << ' ' << b;
+    }
 
-    runkernel(function, stream, argsD);
-    // Sync device output buffer to host
-    hipCheck(hipMemcpyWithStream(hostA.get(), deviceA.get(), SIZE, hipMemcpyDeviceToHost, stream));
+    runkernel(desc, function, stream, argsD.config());
 
-    // Verify output and then reset it for the subsequent test
     int errors = 0;
-    if (validate) {
-        for (int i = 0; i < LEN; i++) {
-            if (hostA[i] != (hostB[i] + hostC[i])) {
-                errors++;
-                break;
-            }
-            hostA[i] = 0.0;
-        }
+    if (desc.verifier) {
+        // Only the verification summary comes back, not the output
+        errors += DeviceVerifier(hdevice, desc).run(desc, deviceBuffers, LEN, stream).count ? 1 : 0;
+    }
+    else if (desc.reference) {
+        // Sync device output buffer to host
+        hipCheck(hipMemcpyWithStream(hostBuffers[0], deviceBuffers[0], SIZE, hipMemcpyDeviceToHost, stream));
+        errors += validate(desc, hostSlots[0]->get(), cpus);
     }
 
-    if (errors)
-        std::cout << "FAILED" << std::endl;
-    else
-        std::cout << "PASSED" << std::endl;
+    LogLine() << (errors ? "FAILED" : "PASSED");
 
     // Register our buffer with ROCm so it is pinned and prepare for access by device
-    hipCheck(hipHostRegister(hostA.get(), SIZE, hipHostRegisterDefault));
-    hipCheck(hipHostRegister(hostB.get(), SIZE, hipHostRegisterDefault));
-    hipCheck(hipHostRegister(hostC.get(), SIZE, hipHostRegisterDefault));
-
-    void *tmpA1 = nullptr;
-    void *tmpB1 = nullptr;
-    void *tmpC1 = nullptr;
+    for (auto b : hostBuffers)
+        hipCheck(hipHostRegister(b, SIZE, hipHostRegisterDefault));
 
     // Map the host buffer to device address space so device can access the buffers
-    hipCheck(hipHostGetDevicePointer(&tmpA1, hostA.get(), 0));
-    hipCheck(hipHostGetDevicePointer(&tmpB1, hostB.get(), 0));
-    hipCheck(hipHostGetDevicePointer(&tmpC1, hostC.get(), 0));
-
-    std::cout << "---------------------------------------------------------------------------------\n";
-    std::cout << "Run " << hipKernelNameRef(function) << ' ' << LOOP << " times using host resident memory" << std::endl;
-    std::cout << "Device mapped host buffers: " << tmpA1 << ", "
-              << tmpB1 << ", " << tmpC1 << std::endl;
-
-    void *argsH[] = {&tmpA1, &tmpB1, &tmpC1};
-
-    runkernel(function, stream, argsH);
-
-    if (validate) {
-        // Verify the output
-        for (int i = 0; i < LEN; i++) {
-            if (hostA[i] == (hostB[i] + hostC[i]))
-                continue;
-            errors++;
-        break;
-        }
+    std::vector<void *> mappedBuffers;
+    for (auto b : hostBuffers) {
+        void *ptr = nullptr;
+        hipCheck(hipHostGetDevicePointer(&ptr, b, 0));
+        mappedBuffers.push_back(ptr);
+    }
+
+    LogLine() << "---------------------------------------------------------------------------------\n"
+              << "Run " << desc.symbol << ' ' << LOOP << " times using host resident memory";
+    {
+        LogLine line;
+        line << "Device mapped host buffers:";
+        for (auto b : mappedBuffers)
+            line << ' ' << b;
     }
 
+    KernelArgs argsH(desc, mappedBuffers, LEN);
+
+    runkernel(desc, function, stream, argsH.config());
+
+    // Verify the output
+    errors += validate(desc, hostSlots[0]->get(), cpus);
+
     // Unmap the host buffers from device address space
-    hipCheck(hipHostUnregister(hostC.get()));
-    hipCheck(hipHostUnregister(hostB.get()));
-    hipCheck(hipHostUnregister(hostA.get()));
+    for (auto it = hostBuffers.rbegin(); it != hostBuffers.rend(); ++it)
+        hipCheck(hipHostUnregister(*it));
 
-    if (errors)
-        std::cout << "FAILED" << std::endl;
-    else
-        std::cout << "PASSED" << std::endl;
+    LogLine() << (errors ? "FAILED" : "PASSED");
 
     return errors;
 }
 
+// Run the selected kernels concurrently, each from its own thread on its own stream
 int mainworker() {
     HipDevice hdevice;
     hdevice.showInfo(std::cout);
 
-    hipFunction_t vaddfunction = hdevice.getFunction(FILENAME, KERNELNAME);
-    hipFunction_t nopfunction = hdevice.getFunction(NOP_FILENAME, NOP_KERNELNAME);
-
-    hipStream_t vaddstream;
-    hipCheck(hipStreamCreateWithFlags(&vaddstream, hipStreamNonBlocking));
+    // From here on the workers report through their own log rings, merged in time order
+    Logger::instance().start();
+    const int hostNode = nodeSet ? node : hdevice.numaNode();
+    LogLine() << "Host buffers and worker threads on NUMA node " << hostNode;
+
+    const std::vector<const KernelDesc *> kernels = selectkernels(kernelsOption);
+    std::vector<hipFunction_t> functions;
+    std::vector<hipStream_t> streams;
+    for (auto desc : kernels) {
+        functions.push_back(hdevice.getFunction(desc->codeObject, desc->symbol));
+        hipStream_t stream;
+        hipCheck(hipStreamCreateWithFlags(&stream, hipStreamNonBlocking));
+        streams.push_back(stream);
+    }
 
-    hipStream_t nopstream;
-    hipCheck(hipStreamCreateWithFlags(&nopstream, hipStreamNonBlocking));
+    std::vector<int> results(kernels.size());
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < kernels.size(); k++) {
+        threads.emplace_back([&, k]() {
+            results[k] = mainworkerthread(hdevice, *kernels[k], functions[k], streams[k], hostNode);
+        });
+    }
 
-    std::thread vaddthread = std::thread(mainworkerthread, vaddfunction, vaddstream, true);
-    std::thread nopthread = std::thread(mainworkerthread, nopfunction, nopstream, false);
+    int errors = 0;
+    for (size_t k = 0; k < threads.size(); k++) {
+        threads[k].join();
+        errors += results[k];
+    }
 
-    vaddthread.join();
-    nopthread.join();
+    for (auto stream : streams)
+        hipCheck(hipStreamDestroy(stream));
+    Logger::instance().stop();
+    return errors;
+}
 
-    hipCheck(hipStreamDestroy(nopstream));
-    hipCheck(hipStreamDestroy(vaddstream));
-//    mainworkerthread(vaddfunction, vaddstream, true);
-//    mainworkerthread(nopfunction, nopstream, false);
-    return 0;
+void usage(const char *prog)
+{
+    std::cout << "Usage: " << prog << " [-k <kernels>] [-d <depth>] [-n <node>]\n";
+    std::cout << "  -k <kernels> Comma separated kernels to run side by side, or all (default: "
+              << DEFAULT_KERNELS << "):";
+    for (auto &desc : KernelRegistry::all())
+        std::cout << ' ' << desc.symbol;
+    std::cout << "\n";
+    std::cout << "  -d <depth>   Bound launches in flight per stream\n";
+    std::cout << "  -n <node>    NUMA node for host buffers and worker threads (default: device local node)\n";
 }
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    try {
-        mainworker();
+    int opt;
+    while ((opt = getopt(argc, argv, "k:d:n:h")) != -1) {
+        switch (opt) {
+        case 'k':
+            kernelsOption = optarg;
+            break;
+        case 'd':
+            depth = std::strtoul(optarg, nullptr, 0);
+            break;
+        case 'n': {
+            char *end = nullptr;
+            node = std::strtol(optarg, &end, 0);
+            if ((end == optarg) || *end || (node < 0)) {
+                usage(argv[0]);
+                return 1;
+            }
+            nodeSet = true;
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
 
+    try {
+        return mainworker() ? 1 : 0;
     } catch (std::exception &e) {
+        Logger::instance().stop();
         std::cerr << e.what() << std::endl;
         return 1;
     }
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "hostexec.h"
+#include "registry.h"
+#include "syscalls.h"
+#include "workload.h"
+
+ACCOUNT_IOCTLS()
+
+namespace {
+
+static const size_t LOOP = 1000;
+static const size_t BATCH = 100;
+static const size_t LEN = 0x10000;
+static const size_t WARMUP = 10;
+
+static const char *MODES[] = {"direct", "sync", "graph"};
+
+static std::string kernelOption = "vectoradd";
+static std::string modeOption;
+static size_t loop = LOOP;
+static size_t batch = BATCH;
+static bool breakdown = false;
+
+void header()
+{
+    std::cout << std::setw(10) << "mode" << std::setw(10) << "launches" << std::setw(10) << "ioctls"
+              << std::setw(14) << "ioctls/launch" << std::setw(14) << "waits/launch"
+              << std::setw(12) << "us/launch" << std::endl;
+}
+
+void report(const std::string &mode, const IoctlAccounting::Counts &delta, size_t launches, long long delay)
+{
+    const double ops = std::max<size_t>(launches, 1);
+    std::cout << std::setw(10) << mode << std::setw(10) << launches << std::setw(10) << delta.total()
+              << std::fixed << std::setprecision(3) << std::setw(14) << delta.total() / ops
+              << std::setw(14) << delta.switches / ops << std::setprecision(2)
+              << std::setw(12) << delay / ops << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+    if (breakdown)
+        IoctlAccounting::print(std::cout, delta, launches);
+}
+
+// Driver calls made by loop launches of the workload submitted one way: direct queues
+// them back to back and waits once, sync waits for each launch before the next and
+// graph replays a graph of batch captured launches. Setup such as graph instantiation
+// is done before the interval counted.
+void runmode(const std::string &mode, const KernelWorkload &workload, hipStream_t stream)
+{
+    // Settle lazy runtime initialization of the stream and the kernel
+    for (size_t i = 0; i < WARMUP; i++)
+        workload.launch(stream);
+    hipCheck(hipStreamSynchronize(stream));
+
+    IoctlAccounting &accounting = IoctlAccounting::instance();
+    if (mode == "graph") {
+        hipGraph_t graph = nullptr;
+        hipGraphExec_t exec = nullptr;
+        hipCheck(hipStreamBeginCapture(stream, hipStreamCaptureModeGlobal));
+        for (size_t i = 0; i < batch; i++)
+            workload.launch(stream);
+        hipCheck(hipStreamEndCapture(stream, &graph));
+        hipCheck(hipGraphInstantiate(&exec, graph, nullptr, nullptr, 0));
+        hipCheck(hipGraphLaunch(exec, stream));
+        hipCheck(hipStreamSynchronize(stream));
+
+        const size_t replays = std::max<size_t>(1, loop / batch);
+        const IoctlAccounting::Counts start = accounting.snapshot();
+        Timer timer;
+        for (size_t r = 0; r < replays; r++)
+            hipCheck(hipGraphLaunch(exec, stream));
+        hipCheck(hipStreamSynchronize(stream));
+        const long long delay = timer.stop();
+        report(mode, accounting.snapshot() - start, replays * batch, delay);
+
+        hipCheck(hipGraphExecDestroy(exec));
+        hipCheck(hipGraphDestroy(graph));
+        return;
+    }
+
+    const IoctlAccounting::Counts start = accounting.snapshot();
+    Timer timer;
+    for (size_t i = 0; i < loop; i++) {
+        workload.launch(stream);
+        if (mode == "sync")
+            hipCheck(hipStreamSynchronize(stream));
+    }
+    hipCheck(hipStreamSynchronize(stream));
+    const long long delay = timer.stop();
+    report(mode, accounting.snapshot() - start, loop, delay);
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    IoctlAccounting &accounting = IoctlAccounting::instance();
+    const IoctlAccounting::Counts boot = accounting.snapshot();
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+    const std::vector<int> cpus = nodeCpus(hdevice.numaNode());
+    pinThread(cpus);
+
+    const KernelDesc &desc = KernelRegistry::find(kernelOption);
+    DeviceGenerator generator(hdevice);
+    KernelWorkload workload(hdevice, generator, desc, LEN);
+    hipStream_t stream = nullptr;
+    hipCheck(hipStreamCreateWithFlags(&stream, hipStreamNonBlocking));
+    const IoctlAccounting::Counts setup = accounting.snapshot() - boot;
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    if (!accounting.active()) {
+        std::cout << "No ioctl went through the interposer, the runtime calls the kernel directly" << std::endl;
+        hipCheck(hipStreamDestroy(stream));
+        std::cout << "FAILED" << std::endl;
+        return 1;
+    }
+    std::cout << "Runtime init, module load and allocation: " << setup.total() << " ioctls, "
+              << setup.switches << " waits" << std::endl;
+    if (breakdown)
+        IoctlAccounting::print(std::cout, setup, 1);
+
+    std::cout << "Driver calls of " << desc.symbol << " over " << LEN << " elements, graphs of " << batch
+              << " launches" << std::endl;
+    header();
+    for (auto m : MODES) {
+        if (!modeOption.empty() && (modeOption != m))
+            continue;
+        runmode(m, workload, stream);
+    }
+    hipCheck(hipStreamDestroy(stream));
+
+    const int errors = workload.validate(hdevice, cpus);
+    std::cout << (errors ? "FAILED" : "PASSED") << std::endl;
+    return errors;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "k:n:b:m:vh")) != -1) {
+        switch (opt) {
+        case 'k':
+            kernelOption = optarg;
+            break;
+        case 'n':
+            loop = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'b':
+            batch = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'm':
+            modeOption = optarg;
+            break;
+        case 'v':
+            breakdown = true;
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-k <kernel>] [-n <launches>] [-b <launches>] [-m <mode>] [-v]\n";
+            std::cout << "  -k <kernel>    Registered kernel to launch (default: vectoradd)\n";
+            std::cout << "  -n <launches>  Launches counted per mode (default: " << LOOP << ")\n";
+            std::cout << "  -b <launches>  Launches captured in the replayed graph (default: " << BATCH << ")\n";
+            std::cout << "  -m <mode>      direct, sync or graph (default: all)\n";
+            std::cout << "  -v             Break the counts down by driver command\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "hostexec.h"
+#include "scheduler.h"
+#include "workload.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+static const long long DURATION_MS = 2000;
+static const size_t INFLIGHT = 2;
+static const size_t QUANTUM = 0x100000;
+static const long long INTERVAL_US = 500;
+
+static long long durationMs = DURATION_MS;
+static size_t inflight = INFLIGHT;
+static size_t quantum = QUANTUM;
+static long long intervalUs = INTERVAL_US;
+static std::string policyOption = "all";
+
+// Load offered by one tenant: paced launches every interval us, or with interval 0 a
+// closed loop which keeps outstanding launches admitted at all times
+struct Workload {
+    TenantConfig config;
+    const char *kernel;
+    size_t len;
+    long long interval;
+    size_t outstanding;
+};
+
+// A latency sensitive tenant with small paced launches next to two bulk tenants which
+// would keep the device busy on their own, one with twice the weight of the other
+std::vector<Workload> workloads()
+{
+    return {
+        {{"interactive", 4, true, 4}, "vectoradd", 0x1000, intervalUs, 0},
+        {{"batch", 2, false, 16}, "stream_triad", 0x100000, 0, 8},
+        {{"bulk", 1, false, 16}, "stream_add", 0x400000, 0, 8},
+    };
+}
+
+void offer(TenantScheduler &scheduler, size_t tenant, const Workload &load, const TenantLaunch &launch,
+           Clock::time_point end)
+{
+    if (load.interval) {
+        for (Clock::time_point next = Clock::now(); next < end; next += std::chrono::microseconds(load.interval)) {
+            std::this_thread::sleep_until(next);
+            scheduler.submit(tenant, launch);
+        }
+        return;
+    }
+    while (Clock::now() < end) {
+        if (scheduler.outstanding(tenant) < load.outstanding)
+            scheduler.submit(tenant, launch);
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+}
+
+void report(TenantScheduler &scheduler, long long delay)
+{
+    size_t total = 0;
+    for (size_t t = 0; t < scheduler.tenants(); t++)
+        total += scheduler.stats(t).cost;
+
+    std::cout << std::setw(12) << "tenant" << std::setw(8) << "weight" << std::setw(6) << "prio"
+              << std::setw(10) << "submitted" << std::setw(10) << "rejected" << std::setw(10) << "ops/s"
+              << std::setw(10) << "GB/s" << std::setw(8) << "share" << std::setw(10) << "p50 us"
+              << std::setw(10) << "p99 us" << std::endl;
+    for (size_t t = 0; t < scheduler.tenants(); t++) {
+        const TenantConfig &config = scheduler.config(t);
+        TenantScheduler::TenantStats &stats = scheduler.stats(t);
+        std::cout << std::setw(12) << config.name << std::setw(8) << config.weight
+                  << std::setw(6) << (config.highPriority ? "high" : "low") << std::setw(10) << stats.submitted
+                  << std::setw(10) << stats.rejected << std::fixed << std::setprecision(1)
+                  << std::setw(10) << (stats.completed * 1000000.0)/delay
+                  << std::setw(10) << double(stats.cost)/(delay * 1000.0)
+                  << std::setw(7) << (total ? (100.0 * stats.cost)/total : 0.0) << '%'
+                  << std::setw(10) << percentile(stats.latencies, 50.0)
+                  << std::setw(10) << percentile(stats.latencies, 99.0) << std::endl;
+        std::cout.unsetf(std::ios_base::floatfield);
+    }
+}
+
+int runpolicy(HipDevice &hdevice, TenantScheduler::Policy policy, const std::vector<int> &cpus)
+{
+    const std::vector<Workload> loads = workloads();
+    DeviceGenerator generator(hdevice);
+    std::vector<std::unique_ptr<KernelWorkload>> kernels;
+    TenantScheduler scheduler(policy, inflight, quantum);
+    for (auto &load : loads) {
+        kernels.emplace_back(new KernelWorkload(hdevice, generator, KernelRegistry::find(load.kernel), load.len));
+        scheduler.addTenant(load.config);
+    }
+    hipCheck(hipDeviceSynchronize());
+
+    std::cout << "---------------------------------------------------------------------------------\n";
+    if (policy == TenantScheduler::Policy::Direct)
+        std::cout << "Direct: every tenant launches straight into its own stream" << std::endl;
+    else
+        std::cout << "Deficit round robin, " << inflight << " launches in flight, quantum " << quantum
+                  << " bytes" << std::endl;
+
+    scheduler.start();
+    const Clock::time_point end = Clock::now() + std::chrono::milliseconds(durationMs);
+    std::vector<std::thread> threads;
+    Timer timer;
+    for (size_t t = 0; t < loads.size(); t++) {
+        const KernelWorkload &kernel = *kernels[t];
+        const TenantLaunch launch = {kernel.function(), kernel.geometry(), kernel.config(), kernel.desc().symbol,
+                                     kernel.bytes()};
+        threads.emplace_back([&, t, launch]() {
+            offer(scheduler, t, loads[t], launch, end);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    scheduler.stop();
+    report(scheduler, timer.stop());
+
+    int errors = 0;
+    for (auto &kernel : kernels)
+        errors += kernel->validate(hdevice, cpus);
+    std::cout << (errors ? "FAILED" : "PASSED") << std::endl;
+    return errors;
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+    const std::vector<int> cpus = nodeCpus(hdevice.numaNode());
+    pinThread(cpus);
+
+    int errors = 0;
+    if ((policyOption == "all") || (policyOption == "direct"))
+        errors += runpolicy(hdevice, TenantScheduler::Policy::Direct, cpus);
+    if ((policyOption == "all") || (policyOption == "drr"))
+        errors += runpolicy(hdevice, TenantScheduler::Policy::DeficitRoundRobin, cpus);
+    return errors;
+}
+
+void usage(const char *prog)
+{
+    std::cout << "Usage: " << prog << " [-t <ms>] [-i <launches>] [-Q <bytes>] [-r <us>] [-p <policy>]\n";
+    std::cout << "  -t <ms>        Duration of each run (default: " << DURATION_MS << ")\n";
+    std::cout << "  -i <launches>  Launches the scheduler keeps in flight (default: " << INFLIGHT << ")\n";
+    std::cout << "  -Q <bytes>     Round robin quantum of a tenant of weight 1 (default: " << QUANTUM << ")\n";
+    std::cout << "  -r <us>        Interval between launches of the interactive tenant (default: "
+              << INTERVAL_US << ")\n";
+    std::cout << "  -p <policy>    direct, drr or all (default: all)\n";
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "t:i:Q:r:p:h")) != -1) {
+        switch (opt) {
+        case 't':
+            durationMs = std::max(1LL, std::strtoll(optarg, nullptr, 0));
+            break;
+        case 'i':
+            inflight = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'Q':
+            quantum = std::max(1ul, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'r':
+            intervalUs = std::max(1LL, std::strtoll(optarg, nullptr, 0));
+            break;
+        case 'p':
+            policyOption = optarg;
+            if ((policyOption != "all") && (policyOption != "direct") && (policyOption != "drr")) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
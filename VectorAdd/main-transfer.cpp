@@ -0,0 +1,301 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "hostexec.h"
+#include "hostmem.h"
+#include "registry.h"
+
+namespace {
+
+static const size_t MIN_SIZE = 4;
+static const size_t DEFAULT_MAX_SIZE = size_t(1) << 30;
+// Bytes moved per measurement, bounds the repetitions of large copies
+static const size_t BYTES_PER_MEASUREMENT = size_t(1) << 30;
+static const size_t MAX_REPS = 1000;
+static const size_t MIN_REPS = 3;
+
+static size_t maxSize = DEFAULT_MAX_SIZE;
+static std::string onlyDirection;
+static std::string onlyHost;
+
+enum class HostKind {
+    Pageable,
+    Pinned,
+    Registered
+};
+
+const char *hostKindName(HostKind kind)
+{
+    switch (kind) {
+    case HostKind::Pageable:
+        return "pageable";
+    case HostKind::Pinned:
+        return "pinned";
+    default:
+        return "registered";
+    }
+}
+
+// Host side of a transfer: pageable memory, hipHostMalloc'ed pinned memory or pageable
+// memory pinned afterwards with hipHostRegister. The last two are also mapped for the
+// kernel based copies.
+class HostBuffer {
+    HostKind mKind;
+    size_t mSize;
+    std::unique_ptr<HostBO<char>> mPageable;
+    char *mPinned;
+    void *mMapped;
+
+public:
+    HostBuffer(HostKind kind, size_t size, int node) : mKind(kind), mSize(size), mPinned(nullptr), mMapped(nullptr) {
+        if (kind == HostKind::Pinned) {
+            hipCheck(hipHostMalloc((void **)&mPinned, size, hipHostMallocMapped));
+            std::memset(mPinned, 0, size);
+            hipCheck(hipHostGetDevicePointer(&mMapped, mPinned, 0));
+            return;
+        }
+        mPageable.reset(new HostBO<char>(size, node));
+        std::memset(mPageable->get(), 0, size);
+        if (kind == HostKind::Registered) {
+            hipCheck(hipHostRegister(mPageable->get(), size, hipHostRegisterDefault));
+            hipCheck(hipHostGetDevicePointer(&mMapped, mPageable->get(), 0));
+        }
+    }
+
+    ~HostBuffer() {
+        if (mKind == HostKind::Pinned)
+            (void)hipHostFree(mPinned);
+        else if (mKind == HostKind::Registered)
+            (void)hipHostUnregister(mPageable->get());
+    }
+
+    HostBuffer(const HostBuffer &) = delete;
+    HostBuffer &operator=(const HostBuffer &) = delete;
+
+    char *get() {
+        return mPinned ? mPinned : mPageable->get();
+    }
+
+    // Device address of the buffer, nullptr for pageable memory
+    void *mapped() const {
+        return mMapped;
+    }
+
+    HostKind kind() const {
+        return mKind;
+    }
+};
+
+size_t repetitions(size_t size)
+{
+    return std::min(MAX_REPS, std::max(MIN_REPS, BYTES_PER_MEASUREMENT / size));
+}
+
+void header()
+{
+    std::cout << std::setw(6) << "dir" << std::setw(12) << "host" << std::setw(8) << "method"
+              << std::setw(12) << "bytes" << std::setw(12) << "us" << std::setw(10) << "GB/s" << std::endl;
+}
+
+// Small transfers are about latency and large ones about bandwidth, both are printed
+void report(const char *dir, const char *host, const char *method, size_t size, size_t reps, long long delay,
+            int directions = 1)
+{
+    std::cout << std::setw(6) << dir << std::setw(12) << host << std::setw(8) << method
+              << std::setw(12) << size << std::fixed << std::setprecision(2)
+              << std::setw(12) << double(delay)/reps
+              << std::setw(10) << (double(size) * reps * directions)/(delay * 1000.0) << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
+
+// Time reps calls of copy() after one warm up call, finishing with a sync of every
+// stream the copies are queued on
+template <typename F> long long measure(size_t reps, std::initializer_list<hipStream_t> streams, F copy)
+{
+    copy();
+    for (auto stream : streams)
+        hipCheck(hipStreamSynchronize(stream));
+    Timer timer;
+    for (size_t i = 0; i < reps; i++)
+        copy();
+    for (auto stream : streams)
+        hipCheck(hipStreamSynchronize(stream));
+    return timer.stop();
+}
+
+template <typename F> long long measure(size_t reps, hipStream_t stream, F copy)
+{
+    return measure(reps, {stream}, copy);
+}
+
+class Transfers {
+    hipFunction_t mCopy;
+    const KernelDesc &mCopyDesc;
+    hipStream_t mStream;
+    hipStream_t mReverse;
+    DeviceBO<char> mSrc;
+    DeviceBO<char> mDst;
+
+    long long kernelcopy(void *dst, const void *src, size_t size, size_t reps) {
+        std::vector<void *> slots = {dst, const_cast<void *>(src)};
+        KernelArgs args(mCopyDesc, slots, size / sizeof(float));
+        const LaunchGeometry geometry = mCopyDesc.geometry(size / sizeof(float));
+        return measure(reps, mStream, [&]() {
+            hipCheck(hipModuleLaunchKernel(mCopy,
+                                             geometry.grid, 1, 1,
+                                             geometry.block, 1, 1,
+                                             0, mStream, nullptr, args.config()), "stream_copy");
+        });
+    }
+
+public:
+    Transfers(HipDevice &hdevice) : mCopyDesc(KernelRegistry::find("stream_copy")), mStream(nullptr),
+                                    mReverse(nullptr), mSrc(maxSize), mDst(maxSize) {
+        mCopy = hdevice.getFunction(mCopyDesc.codeObject, mCopyDesc.symbol);
+        hipCheck(hipStreamCreateWithFlags(&mStream, hipStreamNonBlocking));
+        hipCheck(hipStreamCreateWithFlags(&mReverse, hipStreamNonBlocking));
+        hipCheck(hipMemset(mSrc.get(), 0, maxSize));
+        hipCheck(hipMemset(mDst.get(), 0, maxSize));
+    }
+
+    ~Transfers() {
+        (void)hipStreamDestroy(mReverse);
+        (void)hipStreamDestroy(mStream);
+    }
+
+    // H2D or D2H between host and device memory with the copy engines, synchronously
+    // or queued on a stream, and for mapped host memory with a copy kernel
+    void hostdevice(HostBuffer &host, bool toDevice) {
+        const char *dir = toDevice ? "H2D" : "D2H";
+        const char *kind = hostKindName(host.kind());
+        const hipMemcpyKind copyKind = toDevice ? hipMemcpyHostToDevice : hipMemcpyDeviceToHost;
+        void *dst = toDevice ? static_cast<void *>(mDst.get()) : static_cast<void *>(host.get());
+        const void *src = toDevice ? static_cast<const void *>(host.get()) : static_cast<const void *>(mSrc.get());
+
+        for (size_t size = MIN_SIZE; size <= maxSize; size *= 4) {
+            const size_t reps = repetitions(size);
+            report(dir, kind, "sync", size, reps, measure(reps, mStream, [&]() {
+                hipCheck(hipMemcpy(dst, src, size, copyKind));
+            }));
+            report(dir, kind, "async", size, reps, measure(reps, mStream, [&]() {
+                hipCheck(hipMemcpyAsync(dst, src, size, copyKind, mStream));
+            }));
+            if (host.mapped()) {
+                void *kdst = toDevice ? static_cast<void *>(mDst.get()) : host.mapped();
+                const void *ksrc = toDevice ? host.mapped() : static_cast<const void *>(mSrc.get());
+                report(dir, kind, "kernel", size, reps, kernelcopy(kdst, ksrc, size, reps));
+            }
+        }
+    }
+
+    // H2D and D2H at the same time on two streams, GB/s counts both directions
+    void bidirectional(HostBuffer &up, HostBuffer &down) {
+        const char *kind = hostKindName(up.kind());
+        for (size_t size = MIN_SIZE; size <= maxSize; size *= 4) {
+            const size_t reps = repetitions(size);
+            const long long delay = measure(reps, {mStream, mReverse}, [&]() {
+                hipCheck(hipMemcpyAsync(mDst.get(), up.get(), size, hipMemcpyHostToDevice, mStream));
+                hipCheck(hipMemcpyAsync(down.get(), mSrc.get(), size, hipMemcpyDeviceToHost, mReverse));
+            });
+            report("bidir", kind, "async", size, reps, delay, 2);
+        }
+    }
+
+    void devicedevice() {
+        for (size_t size = MIN_SIZE; size <= maxSize; size *= 4) {
+            const size_t reps = repetitions(size);
+            report("D2D", "-", "sync", size, reps, measure(reps, mStream, [&]() {
+                hipCheck(hipMemcpy(mDst.get(), mSrc.get(), size, hipMemcpyDeviceToDevice));
+            }));
+            report("D2D", "-", "async", size, reps, measure(reps, mStream, [&]() {
+                hipCheck(hipMemcpyAsync(mDst.get(), mSrc.get(), size, hipMemcpyDeviceToDevice, mStream));
+            }));
+            report("D2D", "-", "kernel", size, reps, kernelcopy(mDst.get(), mSrc.get(), size, reps));
+        }
+    }
+};
+
+bool selected(const std::string &only, const char *name)
+{
+    return only.empty() || (only == name);
+}
+
+int mainworker() {
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
+
+    const int hostNode = hdevice.numaNode();
+    pinThread(nodeCpus(hostNode));
+    std::cout << "Host buffers and submission thread on NUMA node " << hostNode << ", sizes "
+              << MIN_SIZE << " to " << maxSize << " bytes" << std::endl;
+
+    Transfers transfers(hdevice);
+    std::cout << "---------------------------------------------------------------------------------\n";
+    header();
+    for (auto kind : {HostKind::Pageable, HostKind::Pinned, HostKind::Registered}) {
+        if (!selected(onlyHost, hostKindName(kind)))
+            continue;
+        HostBuffer host(kind, maxSize, hostNode);
+        if (selected(onlyDirection, "H2D"))
+            transfers.hostdevice(host, true);
+        if (selected(onlyDirection, "D2H"))
+            transfers.hostdevice(host, false);
+        if (selected(onlyDirection, "bidir")) {
+            HostBuffer down(kind, maxSize, hostNode);
+            transfers.bidirectional(host, down);
+        }
+    }
+    if (selected(onlyDirection, "D2D"))
+        transfers.devicedevice();
+
+    std::cout << "PASSED" << std::endl;
+    return 0;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "m:d:k:h")) != -1) {
+        switch (opt) {
+        case 'm':
+            maxSize = std::max(MIN_SIZE, std::strtoul(optarg, nullptr, 0));
+            break;
+        case 'd':
+            onlyDirection = optarg;
+            break;
+        case 'k':
+            onlyHost = optarg;
+            break;
+        default:
+            std::cout << "Usage: " << argv[0] << " [-m <bytes>] [-d H2D|D2H|bidir|D2D] [-k pageable|pinned|registered]\n";
+            std::cout << "  -m <bytes>  Largest transfer, sizes grow by 4x from " << MIN_SIZE
+                      << " (default: " << DEFAULT_MAX_SIZE << ")\n";
+            std::cout << "  -d <dir>    Measure only one direction\n";
+            std::cout << "  -k <kind>   Measure only one kind of host memory\n";
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    try {
+        return mainworker() ? 1 : 0;
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -5,8 +5,12 @@
 
 #include <cstring>
 #include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <sstream>
+
+#include <unistd.h>
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
@@ -14,187 +18,506 @@
 #include "hip/hip_runtime_api.h"
 
 #include "common.h"
-
-#define FILENAME "kernel.co"
-#define KERNELNAME "vectoradd"
-
-#define NOP_FILENAME "nop.co"
-#define NOP_KERNELNAME "mynop"
+#include "hostexec.h"
+#include "hostmem.h"
+#include "perf.h"
+#include "generate.h"
+#include "registry.h"
+#include "verify.h"
 
 namespace {
 
 static const int LEN = 0x100000;
 static const int SIZE = LEN * sizeof(float);
-static const int THREADS_PER_BLOCK_X = 32;
 static const int LOOP = 5000;
 
 
-void runkernel(hipFunction_t function, void *args[])
+static const size_t MAX_SWEEP_DEPTH = 1024;
+
+// Maximum number of launches in flight during the throughput loop, 0 means unbounded
+static size_t depth = 0;
+// Chart throughput and tail latency against in-flight depth
+static bool sweep = false;
+// NUMA node for host buffers, submission and init threads; by default the device's node
+static int node = -1;
+static bool nodeSet = false;
+// Compare host mapped runs with buffers on every NUMA node
+static bool compare = false;
+// Page backing of host buffers and whether to populate them before first use
+static PageSize pages = PageSize::Base;
+static bool prefault = false;
+// Seed of the generated inputs
+static uint64_t seed = DEFAULT_SEED;
+// Count cycles, instructions, LLC misses and context switches besides the memory events
+static bool cpuEvents = false;
+
+// One host buffer per argument slot of the registered kernels: slot 0 is the output,
+// slot 1 + k the k-th input (see KernelArgs)
+typedef std::vector<std::unique_ptr<HostBO<float>>> HostSlots;
+
+// Run the throughput loop with at most window.depth() launches outstanding and return
+// the elapsed time in us; per launch latencies are left in the window
+long long runbounded(const KernelDesc &desc, hipFunction_t function, void *config[], LaunchWindow &window)
 {
-    const char *name = hipKernelNameRef(function);
-    std::cout << "Running " << name << ' ' << LOOP << " times...\n";
-    Timer timer;
-
-    const int globalr = std::strcmp(name, NOP_KERNELNAME) ? LEN/THREADS_PER_BLOCK_X : 1;
-    const int localr = std::strcmp(name, NOP_KERNELNAME) ? THREADS_PER_BLOCK_X : 1;
+    const LaunchGeometry geometry = desc.geometry(LEN);
 
+    Timer timer;
     for (int i = 0; i < LOOP; i++) {
+        window.acquire();
         hipCheck(hipModuleLaunchKernel(function,
-                                         globalr, 1, 1,
-                                         localr, 1, 1,
-                                         0, 0, args, nullptr), name);
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         0, 0, nullptr, config), desc.symbol);
+        window.commit();
     }
-    hipCheck(hipDeviceSynchronize());
-    auto delayD = timer.stop();
+    window.drain();
+    return timer.stop();
+}
 
-    std::cout << "Throughput metrics" << std::endl;
-    std::cout << '(' << LOOP << " loops, " << delayD << " us, " << (LOOP * 1000000.0)/delayD
-              << " ops/s, " << delayD/LOOP << " us average pipelined latency)" << std::endl;
+void sweepdepth(const KernelDesc &desc, hipFunction_t function, void *config[])
+{
+    std::cout << "In-flight depth sweep of " << desc.symbol << ' ' << LOOP << " times...\n";
+    std::cout << std::setw(8) << "depth" << std::setw(14) << "ops/s"
+              << std::setw(12) << "avg us" << std::setw(12) << "p99 us" << std::endl;
+
+    std::vector<std::pair<size_t, double>> rates;
+    for (size_t d = 1; d <= MAX_SWEEP_DEPTH && d <= LOOP; d *= 2) {
+        LaunchWindow window(d);
+        auto delayD = runbounded(desc, function, config, window);
+        std::vector<long long> &latency = window.latencies();
+        long long total = 0;
+        for (auto l : latency)
+            total += l;
+        const double rate = (LOOP * 1000000.0)/delayD;
+        std::cout << std::setw(8) << d << std::setw(14) << std::fixed << std::setprecision(0) << rate
+                  << std::setw(12) << total/LOOP << std::setw(12) << percentile(latency, 99.0) << std::endl;
+        rates.push_back(std::make_pair(d, rate));
+    }
+    std::cout.unsetf(std::ios_base::floatfield);
+
+    // Smallest depth which gets within 5% of the best observed throughput
+    double best = 0;
+    for (auto r : rates)
+        best = std::max(best, r.second);
+    for (auto r : rates) {
+        if (r.second >= best * 0.95) {
+            std::cout << "Saturating depth " << r.first << std::endl;
+            break;
+        }
+    }
+}
+
+// Run fn as a phase and return its time in us. With counters their counts are written
+// to report next to it; the counter ioctls are outside the interval timed.
+template<typename F> long long measure(PerfCounters *counters, const char *phase, F fn, std::ostream &report = std::cout)
+{
+    if (counters)
+        counters->start();
+    Timer timer;
+    fn();
+    const long long delay = timer.stop();
+    if (counters) {
+        counters->stop();
+        counters->print(report, phase, delay);
+    }
+    return delay;
+}
+
+// Launches pass pre-packed arguments (KernelArgs::config) so the loops time submission
+// rather than argument marshalling. Returns the elapsed time of the throughput loop in us.
+// With counters the submission and the wait for the device are counted as separate phases,
+// whose counts are printed after the throughput loop so they do not add to its time.
+long long runkernel(const KernelDesc &desc, hipFunction_t function, void *config[], PerfCounters *counters = nullptr)
+{
+    const char *name = desc.symbol;
+    std::cout << "Running " << name << ' ' << LOOP << " times...\n";
+
+    const LaunchGeometry geometry = desc.geometry(LEN);
+
+    std::ostringstream phases;
+    long long delayD;
+    if (depth) {
+        LaunchWindow window(depth);
+        measure(counters, "launch", [&]() {
+            delayD = runbounded(desc, function, config, window);
+        }, phases);
+        std::cout << "Throughput metrics" << std::endl;
+        std::cout << '(' << LOOP << " loops, " << delayD << " us, " << (LOOP * 1000000.0)/delayD
+                  << " ops/s, " << depth << " in-flight depth, " << percentile(window.latencies(), 99.0)
+                  << " us p99 submit-to-retire latency)" << std::endl;
+    }
+    else {
+        delayD = measure(counters, "launch", [&]() {
+            for (int i = 0; i < LOOP; i++) {
+                hipCheck(hipModuleLaunchKernel(function,
+                                                 geometry.grid, 1, 1,
+                                                 geometry.block, 1, 1,
+                                                 0, 0, nullptr, config), name);
+            }
+        }, phases);
+        delayD += measure(counters, "sync", []() {
+            hipCheck(hipDeviceSynchronize());
+        }, phases);
+
+        std::cout << "Throughput metrics" << std::endl;
+        std::cout << '(' << LOOP << " loops, " << delayD << " us, " << (LOOP * 1000000.0)/delayD
+                  << " ops/s, " << delayD/LOOP << " us average pipelined latency)" << std::endl;
+    }
+    std::cout << phases.str();
+    if (desc.bytesPerElement)
+        std::cout << '(' << (desc.bytesPerElement * LEN * LOOP)/(delayD * 1000.0) << " GB/s, "
+                  << (desc.flopsPerElement * LEN * LOOP)/(delayD * 1000.0) << " GFLOP/s)" << std::endl;
 
+    if (sweep)
+        sweepdepth(desc, function, config);
 
-    timer.reset();
+    Timer timer;
     for (int i = 0; i < LOOP; i++) {
         hipCheck(hipModuleLaunchKernel(function,
-                                         globalr, 1, 1,
-                                         localr, 1, 1,
-                                         0, 0, args, nullptr), name);
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         0, 0, nullptr, config), name);
         hipCheck(hipDeviceSynchronize());
     }
 
-    delayD = timer.stop();
+    auto delayL = timer.stop();
 
     std::cout << "Latency metrics" << std::endl;
-    std::cout << '(' << LOOP << " loops, " << delayD << " us, " << (LOOP * 1000000.0)/delayD
-              << " ops/s, " << delayD/LOOP << " us average start-to-finish latency)" << std::endl;
+    std::cout << '(' << LOOP << " loops, " << delayL << " us, " << (LOOP * 1000000.0)/delayL
+              << " ops/s, " << delayL/LOOP << " us average start-to-finish latency)" << std::endl;
 
+    return delayD;
 }
 
-int mainworker() {
+HostSlots makehostslots(int bufferNode)
+{
+    HostSlots slots;
+    for (size_t s = 0; s <= KernelRegistry::maxInputs(); s++)
+        slots.emplace_back(new HostBO<float>(LEN, bufferNode, pages));
+    return slots;
+}
 
-    std::cout << "*********************************************************************************\n";
-    HipDevice hdevice;
-    hdevice.showInfo(std::cout);
+// Initialize input/output vectors from threads pinned to the CPUs of the buffers' node;
+// input k is Philox stream k of the seed and the output zeros
+void initvectors(const std::vector<int> &cpus, const HostSlots &slots)
+{
+    parallelFor(cpus, LEN, [&](size_t begin, size_t end) {
+        for (size_t s = 0; s < slots.size(); s++) {
+            HostBO<float> &slot = *slots[s];
+            if (prefault)
+                slot.prefault(begin * sizeof(float), end * sizeof(float));
+            if (s)
+                fillHost(slot.get() + begin, begin, end - begin, seed, s - 1);
+            else
+                std::fill(slot.get() + begin, slot.get() + end, 0.0f);
+        }
+    });
+}
 
-    hipFunction_t function = hdevice.getFunction(FILENAME, KERNELNAME);
-    hipFunction_t nopfunction = hdevice.getFunction(NOP_FILENAME, NOP_KERNELNAME);
+// Check the output against the kernel's host reference over inputs regenerated from the
+// seed, from threads pinned to cpus, then reset it for the subsequent test
+int validate(const KernelDesc &desc, float *output, const std::vector<int> &cpus)
+{
+    if (!desc.reference)
+        return 0;
+    const VerifyResult result = verifyGenerated(desc, output, seed, LEN, cpus);
+    result.print(std::cout);
+    parallelFor(cpus, LEN, [&](size_t begin, size_t end) {
+        std::fill(output + begin, output + end, 0.0f);
+    });
+    return result.count ? 1 : 0;
+}
 
-    std::unique_ptr<float[]> hostA(new float[LEN]);
-    std::unique_ptr<float[]> hostB(new float[LEN]);
-    std::unique_ptr<float[]> hostC(new float[LEN]);
+void registerslots(const HostSlots &slots)
+{
+    for (auto &slot : slots)
+        hipCheck(hipHostRegister(slot->get(), SIZE, hipHostRegisterDefault));
+}
 
-    // Initialize input/output vectors
-    for (int i = 0; i < LEN; i++) {
-        hostB[i] = i;
-        hostC[i] = i * 2;
-        hostA[i] = 0;
-    }
+void unregisterslots(const HostSlots &slots)
+{
+    for (auto it = slots.rbegin(); it != slots.rend(); ++it)
+        hipCheck(hipHostUnregister((*it)->get()));
+}
 
-    DeviceBO<float> deviceA(LEN);
-    DeviceBO<float> deviceB(LEN);
-    DeviceBO<float> deviceC(LEN);
+// Map the host buffers to device address space so device can access the buffers
+std::vector<void *> mapslots(const HostSlots &slots)
+{
+    std::vector<void *> mapped;
+    for (auto &slot : slots) {
+        void *ptr = nullptr;
+        hipCheck(hipHostGetDevicePointer(&ptr, slot->get(), 0));
+        mapped.push_back(ptr);
+    }
+    return mapped;
+}
 
-    // Sync host buffers to device
-    hipCheck(hipMemcpy(deviceB.get(), hostB.get(), SIZE, hipMemcpyHostToDevice));
-    hipCheck(hipMemcpy(deviceC.get(), hostC.get(), SIZE, hipMemcpyHostToDevice));
+void printbuffers(const char *what, const std::vector<void *> &buffers)
+{
+    std::cout << what << ": ";
+    for (size_t s = 0; s < buffers.size(); s++)
+        std::cout << (s ? ", " : "") << buffers[s];
+    std::cout << std::endl;
+}
 
-    void *argsD[] = {&deviceA.get(), &deviceB.get(), &deviceC.get()};
+std::vector<void *> hostpointers(const HostSlots &slots)
+{
+    std::vector<void *> pointers;
+    for (auto &slot : slots)
+        pointers.push_back(slot->get());
+    return pointers;
+}
 
-    std::cout << "---------------------------------------------------------------------------------\n";
-    std::cout << "Run " << hipKernelNameRef(function) << ' ' << LOOP << " times using device resident memory" << std::endl;
-    std::cout << "Host buffers: " << hostA.get() << ", "
-              << hostB.get() << ", " << hostC.get() << std::endl;
-    std::cout << "Device buffers: " << deviceA.get() << ", "
-              << deviceB.get() << ", " << deviceC.get() << std::endl;
+// Run the kernel over host mapped buffers placed on the given node and return the
+// throughput loop time in us, or -1 if the output does not validate
+long long runhostmapped(const KernelDesc &desc, hipFunction_t function, int bufferNode)
+{
+    HostSlots slots = makehostslots(bufferNode);
+    initvectors(nodeCpus(bufferNode), slots);
+
+    registerslots(slots);
+    KernelArgs argsH(desc, mapslots(slots), LEN);
+    long long delayD = runkernel(desc, function, argsH.config());
+    if (validate(desc, slots[0]->get(), nodeCpus(bufferNode)))
+        delayD = -1;
+    unregisterslots(slots);
+    return delayD;
+}
 
-    runkernel(function, argsD);
-    // Sync device output buffer to host
-    hipCheck(hipMemcpy(hostA.get(), deviceA.get(), SIZE, hipMemcpyDeviceToHost));
+int comparenodes(const KernelDesc &desc, hipFunction_t function, int localNode)
+{
+    std::vector<std::pair<int, long long>> results;
+    for (auto n : numaNodes()) {
+        std::cout << "---------------------------------------------------------------------------------\n";
+        std::cout << "Run " << desc.symbol << ' ' << LOOP << " times using host resident memory on node "
+                  << n << std::endl;
+        results.push_back(std::make_pair(n, runhostmapped(desc, function, n)));
+    }
 
-    // Verify output and then reset it for the subsequent test
     int errors = 0;
-    for (int i = 0; i < LEN; i++) {
-        if (hostA[i] != (hostB[i] + hostC[i])) {
+    std::cout << "---------------------------------------------------------------------------------\n";
+    std::cout << "Host mapped placement comparison of " << desc.symbol << " (device on node " << localNode << ")" << std::endl;
+    for (auto r : results) {
+        std::cout << "node " << r.first << ((r.first == localNode) ? " (local):  " : " (remote): ");
+        if (r.second < 0) {
+            std::cout << "FAILED" << std::endl;
             errors++;
-            break;
+            continue;
         }
-        hostA[i] = 0.0;
+        std::cout << r.second << " us, " << (desc.bytesPerElement * LEN * LOOP)/(r.second * 1000.0) << " GB/s" << std::endl;
     }
+    return errors;
+}
 
-    if (errors)
-        std::cout << "FAILED" << std::endl;
-    else
-        std::cout << "PASSED" << std::endl;
-
-    std::cout << "---------------------------------------------------------------------------------\n";
-
-    std::cout << "Run " << hipKernelNameRef(nopfunction) << ' ' << LOOP << " times using device resident memory" << std::endl;
-    std::cout << "Host buffers: " << hostA.get() << ", "
-              << hostB.get() << ", " << hostC.get() << std::endl;
-    std::cout << "Device buffers: " << deviceA.get() << ", "
-              << deviceB.get() << ", " << deviceC.get() << std::endl;
-
-    runkernel(nopfunction, argsD);
-
-    std::cout << "PASSED" << std::endl;
-
-    // Register our buffer with ROCm so it is pinned and prepare for access by device
-    hipCheck(hipHostRegister(hostA.get(), SIZE, hipHostRegisterDefault));
-    hipCheck(hipHostRegister(hostB.get(), SIZE, hipHostRegisterDefault));
-    hipCheck(hipHostRegister(hostC.get(), SIZE, hipHostRegisterDefault));
-
-    void *tmpA1 = nullptr;
-    void *tmpB1 = nullptr;
-    void *tmpC1 = nullptr;
+int mainworker(const std::string &only) {
 
-    // Map the host buffer to device address space so device can access the buffers
-    hipCheck(hipHostGetDevicePointer(&tmpA1, hostA.get(), 0));
-    hipCheck(hipHostGetDevicePointer(&tmpB1, hostB.get(), 0));
-    hipCheck(hipHostGetDevicePointer(&tmpC1, hostC.get(), 0));
+    std::cout << "*********************************************************************************\n";
+    HipDevice hdevice;
+    hdevice.showInfo(std::cout);
 
-    std::cout << "---------------------------------------------------------------------------------\n";
-    std::cout << "Run " << hipKernelNameRef(function) << ' ' << LOOP << " times using host resident memory" << std::endl;
-    std::cout << "Device mapped host buffers: " << tmpA1 << ", "
-              << tmpB1 << ", " << tmpC1 << std::endl;
+    std::vector<const KernelDesc *> kernels;
+    std::vector<hipFunction_t> functions;
+    for (auto &desc : KernelRegistry::all()) {
+        if (!only.empty() && only != desc.symbol)
+            continue;
+        kernels.push_back(&desc);
+        functions.push_back(hdevice.getFunction(desc.codeObject, desc.symbol));
+    }
+    if (kernels.empty())
+        throw std::invalid_argument("Kernel " + only + " is not registered");
+
+    // Keep the submission thread and host buffers local to the device unless told otherwise
+    const int localNode = hdevice.numaNode();
+    const int hostNode = nodeSet ? node : localNode;
+    const std::vector<int> cpus = nodeCpus(hostNode);
+    pinThread(cpus);
+    std::cout << "Device NUMA node " << localNode << ", host buffers and submission thread on node "
+              << hostNode << std::endl;
+
+    // Page fault and TLB miss counts, optionally core counts, per phase. Threads the
+    // runtime started before this point are not counted.
+    PerfCounters counters;
+    counters.addMemoryEvents();
+    if (cpuEvents)
+        counters.addCpuEvents();
+
+    // Device inputs are generated in place, only the output of kernels without a device
+    // verifier is read back
+    std::vector<std::unique_ptr<DeviceBO<float>>> deviceSlots;
+    std::vector<void *> deviceBuffers;
+    for (size_t s = 0; s <= KernelRegistry::maxInputs(); s++) {
+        deviceSlots.emplace_back(new DeviceBO<float>(LEN));
+        deviceBuffers.push_back(deviceSlots.back()->get());
+    }
 
-    void *argsH[] = {&tmpA1, &tmpB1, &tmpC1};
+    const long long delayG = measure(&counters, "generate", [&]() {
+        DeviceGenerator generator(hdevice);
+        for (size_t s = 1; s < deviceBuffers.size(); s++)
+            generator.fill(static_cast<float *>(deviceBuffers[s]), LEN, seed, s - 1);
+        hipCheck(hipDeviceSynchronize());
+    });
+    std::cout << "Generated device inputs from seed " << seed << " in " << delayG << " us" << std::endl;
 
-    runkernel(function, argsH);
-    errors = 0;
-    // Verify the output
-    for (int i = 0; i < LEN; i++) {
-        if (hostA[i] == (hostB[i] + hostC[i]))
-            continue;
-        errors++;
-        break;
+    std::unique_ptr<HostBO<float>> readback;
+    int errors = 0;
+    for (size_t k = 0; k < kernels.size(); k++) {
+        const KernelDesc &desc = *kernels[k];
+        KernelArgs argsD(desc, deviceBuffers, LEN);
+
+        std::cout << "---------------------------------------------------------------------------------\n";
+        std::cout << "Run " << desc.symbol << ' ' << LOOP << " times using device resident memory" << std::endl;
+        printbuffers("Device buffers", deviceBuffers);
+
+        runkernel(desc, functions[k], argsD.config(), &counters);
+
+        int failed = 0;
+        if (desc.verifier) {
+            // Only the verification summary comes back, not the output
+            VerifyResult result;
+            measure(&counters, "validate", [&]() {
+                result = DeviceVerifier(hdevice, desc).run(desc, deviceBuffers, LEN);
+            });
+            result.print(std::cout);
+            failed = result.count ? 1 : 0;
+        }
+        else if (desc.reference) {
+            if (!readback)
+                readback.reset(new HostBO<float>(LEN, hostNode, pages));
+            measure(&counters, "validate", [&]() {
+                // Sync device output buffer to host
+                hipCheck(hipMemcpy(readback->get(), deviceBuffers[0], SIZE, hipMemcpyDeviceToHost));
+                failed = validate(desc, readback->get(), cpus);
+            });
+        }
+        if (failed)
+            std::cout << "FAILED" << std::endl;
+        else
+            std::cout << "PASSED" << std::endl;
+        errors += failed;
     }
+    readback.reset();
+    deviceSlots.clear();
 
-    if (errors)
-        std::cout << "FAILED" << std::endl;
-    else
-        std::cout << "PASSED" << std::endl;
+    HostSlots hostSlots = makehostslots(hostNode);
+    std::cout << "Host buffers backed by " << pageSizeName(pages) << " pages"
+              << (prefault ? ", prefaulted" : "") << std::endl;
 
-    std::cout << "---------------------------------------------------------------------------------\n";
-    std::cout << "Run " << hipKernelNameRef(nopfunction) << ' ' << LOOP << " times using host resident memory" << std::endl;
-    std::cout << "Device mapped host buffers: " << tmpA1 << ", "
-              << tmpB1 << ", " << tmpC1 << std::endl;
+    measure(&counters, "init", [&]() {
+        initvectors(cpus, hostSlots);
+    });
+    printbuffers("Host buffers", hostpointers(hostSlots));
 
-    runkernel(nopfunction, argsH);
+    // Register our buffer with ROCm so it is pinned and prepare for access by device
+    measure(&counters, "register", [&]() {
+        registerslots(hostSlots);
+    });
+
+    const std::vector<void *> mappedBuffers = mapslots(hostSlots);
+
+    for (size_t k = 0; k < kernels.size(); k++) {
+        const KernelDesc &desc = *kernels[k];
+        KernelArgs argsH(desc, mappedBuffers, LEN);
+
+        std::cout << "---------------------------------------------------------------------------------\n";
+        std::cout << "Run " << desc.symbol << ' ' << LOOP << " times using host resident memory" << std::endl;
+        printbuffers("Device mapped host buffers", mappedBuffers);
+
+        runkernel(desc, functions[k], argsH.config(), &counters);
+
+        int failed = 0;
+        measure(&counters, "validate", [&]() {
+            failed = validate(desc, hostSlots[0]->get(), cpus);
+        });
+        if (failed)
+            std::cout << "FAILED" << std::endl;
+        else
+            std::cout << "PASSED" << std::endl;
+        errors += failed;
+    }
 
     // Unmap the host buffers from device address space
-    hipCheck(hipHostUnregister(hostC.get()));
-    hipCheck(hipHostUnregister(hostB.get()));
-    hipCheck(hipHostUnregister(hostA.get()));
+    unregisterslots(hostSlots);
 
-    std::cout << "PASSED" << std::endl;
+    if (compare) {
+        for (size_t k = 0; k < kernels.size(); k++) {
+            if (kernels[k]->bytesPerElement)
+                errors += comparenodes(*kernels[k], functions[k], localNode);
+        }
+    }
     return errors;
 }
+
+void usage(const char *prog)
+{
+    std::cout << "Usage: " << prog << " [-k <kernel>] [-d <depth>] [-s] [-n <node>] [-c] [-p <pages>] [-f] [-r <seed>] [-P]\n";
+    std::cout << "  -k <kernel> Run only this registered kernel:";
+    for (auto &desc : KernelRegistry::all())
+        std::cout << ' ' << desc.symbol;
+    std::cout << "\n";
+    std::cout << "  -d <depth>  Bound launches in flight during the throughput loop\n";
+    std::cout << "  -s          Sweep in-flight depth and chart throughput and p99 latency\n";
+    std::cout << "  -n <node>   NUMA node for host buffers and threads (default: device local node)\n";
+    std::cout << "  -c          Compare host mapped runs with buffers on each NUMA node\n";
+    std::cout << "  -p <pages>  Host buffer pages: base, thp, 2m or 1g (hugetlbfs pool)\n";
+    std::cout << "  -f          Prefault host buffers before initializing them\n";
+    std::cout << "  -r <seed>   Seed of the generated inputs\n";
+    std::cout << "  -P          Also count cycles, instructions, LLC misses and context switches per phase\n";
+}
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    try {
-        mainworker();
+    std::string only;
+    int opt;
+    while ((opt = getopt(argc, argv, "k:d:sn:cp:fr:Ph")) != -1) {
+        switch (opt) {
+        case 'k':
+            only = optarg;
+            break;
+        case 'd':
+            depth = std::strtoul(optarg, nullptr, 0);
+            break;
+        case 's':
+            sweep = true;
+            break;
+        case 'n': {
+            char *end = nullptr;
+            node = std::strtol(optarg, &end, 0);
+            if ((end == optarg) || *end || (node < 0)) {
+                usage(argv[0]);
+                return 1;
+            }
+            nodeSet = true;
+            break;
+        }
+        case 'c':
+            compare = true;
+            break;
+        case 'p':
+            try {
+                pages = parsePageSize(optarg);
+            } catch (std::exception &e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            break;
+        case 'f':
+            prefault = true;
+            break;
+        case 'r':
+            seed = std::strtoull(optarg, nullptr, 0);
+            break;
+        case 'P':
+            cpuEvents = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
 
+    try {
+        return mainworker(only) ? 1 : 0;
     } catch (std::exception &e) {
         std::cerr << e.what() << std::endl;
         return 1;
@@ -18,3 +18,25 @@ mynop(float* __restrict__ aaa, const float* __restrict__ bbb, const float* __res
 {
 
 }
+
+// Same empty body with 30 arguments, for measuring kernel argument marshalling cost
+#ifdef __cplusplus
+extern "C" {
+#endif
+__global__ void
+mynop30(float *a00, float *a01, float *a02, float *a03, float *a04, float *a05, float *a06, float *a07,
+        float *a08, float *a09, float *a10, float *a11, float *a12, float *a13, float *a14, float *a15,
+        float *a16, float *a17, float *a18, float *a19, float *a20, float *a21, float *a22, float *a23,
+        float *a24, float *a25, float *a26, float *a27, float *a28, float *a29);
+#ifdef __cplusplus
+}
+#endif
+
+__global__ void
+mynop30(float *a00, float *a01, float *a02, float *a03, float *a04, float *a05, float *a06, float *a07,
+        float *a08, float *a09, float *a10, float *a11, float *a12, float *a13, float *a14, float *a15,
+        float *a16, float *a17, float *a18, float *a19, float *a20, float *a21, float *a22, float *a23,
+        float *a24, float *a25, float *a26, float *a27, float *a28, float *a29)
+{
+
+}
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Software and hardware event counters opened with perf_event_open for the calling
+// thread and every thread it creates afterwards. Counts of child threads are folded in
+// when they exit, so join them before stop(). Events the kernel refuses (no PMU in a
+// VM, perf_event_paranoid) are reported as n/a instead of failing the run.
+class PerfCounters {
+    struct Counter {
+        std::string name;
+        int fd;
+        uint64_t value;
+    };
+    std::vector<Counter> mCounters;
+
+public:
+    PerfCounters() {}
+
+    ~PerfCounters() noexcept {
+        for (auto &counter : mCounters) {
+            if (counter.fd >= 0)
+                close(counter.fd);
+        }
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    static uint64_t cacheEvent(uint64_t cache, uint64_t op, uint64_t result) {
+        return cache | (op << 8) | (result << 16);
+    }
+
+    // Page fault and TLB miss events used to characterize host buffer placement
+    void addMemoryEvents() {
+        add("page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+        add("major-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ);
+        add("dTLB-load-misses", PERF_TYPE_HW_CACHE,
+            cacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        add("dTLB-store-misses", PERF_TYPE_HW_CACHE,
+            cacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_WRITE, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    }
+
+    // Core events which explain where host time goes: cycles and instructions, and the
+    // cache misses and rescheduling they stall on
+    void addCpuEvents() {
+        add("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        add("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        add("LLC-load-misses", PERF_TYPE_HW_CACHE,
+            cacheEvent(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+        add("context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+    }
+
+    void add(const std::string &name, uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_hv = 1;
+        const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        mCounters.push_back(Counter{name, fd, 0});
+    }
+
+    void start() {
+        for (auto &counter : mCounters) {
+            if (counter.fd < 0)
+                continue;
+            ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void stop() {
+        for (auto &counter : mCounters) {
+            if (counter.fd < 0)
+                continue;
+            ioctl(counter.fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter.fd, &counter.value, sizeof(counter.value)) != sizeof(counter.value))
+                counter.value = 0;
+        }
+    }
+
+    // Count of the last start()/stop() interval, or -1 if the event is not available
+    long long value(const std::string &name) const {
+        for (auto &counter : mCounters) {
+            if (counter.name == name)
+                return (counter.fd < 0) ? -1 : static_cast<long long>(counter.value);
+        }
+        return -1;
+    }
+
+    // Print the counts of the last start()/stop() interval as one line, after the
+    // phase's wall time if given
+    void print(std::ostream &stream, const std::string &phase, long long us = -1) const {
+        stream << std::setw(10) << std::left << phase << std::right;
+        if (us >= 0)
+            stream << ' ' << us << " us";
+        for (auto &counter : mCounters) {
+            stream << ' ' << counter.name << ' ';
+            if (counter.fd < 0)
+                stream << "n/a";
+            else
+                stream << counter.value;
+        }
+        const long long cycles = value("cycles");
+        const long long instructions = value("instructions");
+        if ((cycles > 0) && (instructions >= 0))
+            stream << " IPC " << std::fixed << std::setprecision(2) << double(instructions)/cycles << std::defaultfloat;
+        stream << std::endl;
+    }
+};
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <cstdint>
+
+// Philox4x32-10 counter based generator (Salmon et al., "Parallel random numbers: as
+// easy as 1, 2, 3", SC'11). Every element is a pure function of (seed, stream, index),
+// so inputs can be produced in parallel anywhere, on the host or in a kernel, and
+// regenerated later for validation instead of being kept around. Shared by host code
+// and kernel.cpp, hence no dependencies.
+
+#if defined(__HIPCC__)
+#define PHILOX_QUALIFIER __host__ __device__ inline
+#else
+#define PHILOX_QUALIFIER inline
+#endif
+
+struct Philox4x32 {
+    uint32_t v[4];
+};
+
+PHILOX_QUALIFIER void philoxMulhilo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo)
+{
+    const uint64_t product = static_cast<uint64_t>(a) * b;
+    hi = static_cast<uint32_t>(product >> 32);
+    lo = static_cast<uint32_t>(product);
+}
+
+PHILOX_QUALIFIER Philox4x32 philox4x32(Philox4x32 counter, uint32_t key0, uint32_t key1)
+{
+    for (int round = 0; round < 10; round++) {
+        uint32_t hi0, lo0, hi1, lo1;
+        philoxMulhilo(0xD2511F53u, counter.v[0], hi0, lo0);
+        philoxMulhilo(0xCD9E8D57u, counter.v[2], hi1, lo1);
+        counter = Philox4x32{{hi1 ^ counter.v[1] ^ key0, lo1, hi0 ^ counter.v[3] ^ key1, lo0}};
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    return counter;
+}
+
+// Uniform float in [0, 1) with 24 random bits, exactly representable so host and device
+// agree bit for bit
+PHILOX_QUALIFIER float philoxFloat(uint32_t bits)
+{
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// The four consecutive elements starting at 4 * block of the given stream
+PHILOX_QUALIFIER Philox4x32 philoxBlock(uint64_t seed, uint32_t stream, uint64_t block)
+{
+    const Philox4x32 counter = {{static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32), stream, 0}};
+    return philox4x32(counter, static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32));
+}
+
+PHILOX_QUALIFIER float philoxUniform(uint64_t seed, uint32_t stream, uint64_t index)
+{
+    return philoxFloat(philoxBlock(seed, stream, index >> 2).v[index & 3]);
+}
@@ -0,0 +1,352 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary recording of the allocations, module loads, launches, copies and syncs a
+// process issues, written by libhiptrace.so with HIPTRACE_RECORD=<file> and re-issued
+// by main-replay. The file is a RecordHeader followed by records appended while the
+// process runs, so a long capture streams to disk and can be mapped as a whole
+// afterwards. Each record is a RecordEntry, whose size covers the record and keeps
+// the next one 8 byte aligned, then its payload and, for modules and launches, the
+// code object or the packed kernel arguments.
+//
+// Every thread writes its own chunks, so the records of different threads are only
+// ordered by time. Handles and addresses are the recording process's own; the buffer
+// contents are not recorded.
+
+static const char RECORD_MAGIC[8] = {'H', 'I', 'P', 'R', 'E', 'C', 'O', 'R'};
+static const uint32_t RECORD_VERSION = 1;
+
+struct RecordHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    // CLOCK_MONOTONIC ns the record times are relative to
+    uint64_t start;
+};
+
+enum class RecordType : uint32_t {
+    Alloc = 1,
+    Free,
+    Map,
+    Module,
+    Function,
+    Launch,
+    Copy,
+    Memset,
+    Sync,
+    EventRecord,
+    GraphLaunch,
+    Types
+};
+
+struct RecordEntry {
+    uint32_t type;
+    uint32_t size;
+    // Start of the call and its duration, ns
+    uint64_t time;
+    uint64_t duration;
+    uint32_t thread;
+    // hipError_t the call returned
+    int32_t status;
+};
+
+enum class MemoryKind : uint32_t {
+    Device,
+    Host,
+    Registered
+};
+
+struct AllocPayload {
+    uint64_t address;
+    uint64_t bytes;
+    uint32_t kind;
+    uint32_t reserved;
+};
+
+struct FreePayload {
+    uint64_t address;
+    uint32_t kind;
+    uint32_t reserved;
+};
+
+// Device address of registered or host allocated memory
+struct MapPayload {
+    uint64_t host;
+    uint64_t device;
+};
+
+// Followed by the code object, bytes long; 0 if it could not be captured
+struct ModulePayload {
+    uint64_t module;
+    uint64_t bytes;
+};
+
+struct FunctionPayload {
+    uint64_t function;
+    uint64_t module;
+    char name[128];
+};
+
+// Followed by argBytes of arguments packed as for HIP_LAUNCH_PARAM_BUFFER_POINTER
+struct LaunchPayload {
+    static const uint32_t ARGS_MISSING = 1;
+
+    uint64_t function;
+    uint64_t stream;
+    uint32_t grid[3];
+    uint32_t block[3];
+    uint32_t shared;
+    uint32_t argBytes;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+enum class CopyCall : uint32_t {
+    Memcpy,
+    Async,
+    WithStream
+};
+
+struct CopyPayload {
+    uint64_t dst;
+    uint64_t src;
+    uint64_t bytes;
+    uint64_t stream;
+    uint32_t kind;
+    uint32_t call;
+};
+
+struct MemsetPayload {
+    uint64_t dst;
+    uint64_t bytes;
+    int32_t value;
+    uint32_t reserved;
+};
+
+enum class SyncKind : uint32_t {
+    Device,
+    Stream,
+    Event
+};
+
+struct SyncPayload {
+    uint64_t object;
+    uint32_t kind;
+    uint32_t reserved;
+};
+
+// EventRecord and GraphLaunch
+struct HandlePayload {
+    uint64_t handle;
+    uint64_t stream;
+};
+
+inline const char *recordTypeName(uint32_t type)
+{
+    static const char *names[] = {"?", "alloc", "free", "map", "module", "function", "launch", "copy", "memset",
+                                  "sync", "event", "graph"};
+    return (type < static_cast<uint32_t>(RecordType::Types)) ? names[type] : names[0];
+}
+
+// Bytes of an ELF image in memory as far as its headers tell, 0 if it is not ELF64
+inline size_t elfSize(const void *image)
+{
+    const Elf64_Ehdr *header = static_cast<const Elf64_Ehdr *>(image);
+    if (std::memcmp(header->e_ident, ELFMAG, SELFMAG) || (header->e_ident[EI_CLASS] != ELFCLASS64))
+        return 0;
+    const size_t sections = header->e_shoff + size_t(header->e_shnum) * header->e_shentsize;
+    const size_t segments = header->e_phoff + size_t(header->e_phnum) * header->e_phentsize;
+    return std::max({sizeof(Elf64_Ehdr), sections, segments});
+}
+
+// Appends records to the file through a buffer per thread. A full buffer is written
+// with one O_APPEND write(), so chunks of concurrent threads never interleave.
+class RecordWriter {
+    static const size_t CHUNK = 0x40000;
+
+    struct ThreadBuffer {
+        std::mutex mutex;
+        std::vector<char> data;
+        uint32_t thread;
+        ThreadBuffer *next;
+    };
+
+    int mFd;
+    uint64_t mStart;
+    std::atomic<ThreadBuffer *> mBuffers;
+    std::atomic<uint32_t> mThreads;
+
+    ThreadBuffer &local() {
+        thread_local ThreadBuffer *buffer = nullptr;
+        if (!buffer) {
+            buffer = new ThreadBuffer();
+            buffer->data.reserve(CHUNK);
+            buffer->thread = mThreads.fetch_add(1);
+            buffer->next = mBuffers.load();
+            while (!mBuffers.compare_exchange_weak(buffer->next, buffer));
+        }
+        return *buffer;
+    }
+
+    void write(const void *data, size_t size) {
+        const char *bytes = static_cast<const char *>(data);
+        while (size) {
+            const ssize_t written = ::write(mFd, bytes, size);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            bytes += written;
+            size -= written;
+        }
+    }
+
+public:
+    RecordWriter(const std::string &path, uint64_t start) : mFd(-1), mStart(start), mBuffers(nullptr), mThreads(0) {
+        mFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (mFd < 0)
+            throw std::system_error(errno, std::generic_category(), path);
+        RecordHeader header;
+        std::memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+        header.version = RECORD_VERSION;
+        header.reserved = 0;
+        header.start = mStart;
+        write(&header, sizeof(header));
+    }
+
+    ~RecordWriter() {
+        flush();
+        close(mFd);
+    }
+
+    RecordWriter(const RecordWriter &) = delete;
+    RecordWriter &operator=(const RecordWriter &) = delete;
+
+    template<typename T> void append(RecordType type, uint64_t start, uint64_t end, int status, const T &payload,
+                                     const void *extra = nullptr, size_t extraBytes = 0) {
+        static_assert(sizeof(T) % 8 == 0, "payloads keep records 8 byte aligned");
+        RecordEntry entry;
+        entry.type = static_cast<uint32_t>(type);
+        entry.size = static_cast<uint32_t>(sizeof(entry) + sizeof(T) + (extraBytes + 7) / 8 * 8);
+        entry.time = (start > mStart) ? start - mStart : 0;
+        entry.duration = end - start;
+        entry.status = status;
+
+        ThreadBuffer &buffer = local();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        entry.thread = buffer.thread;
+        if (buffer.data.size() + entry.size > CHUNK) {
+            write(buffer.data.data(), buffer.data.size());
+            buffer.data.clear();
+        }
+        const size_t offset = buffer.data.size();
+        buffer.data.resize(offset + entry.size, 0);
+        std::memcpy(&buffer.data[offset], &entry, sizeof(entry));
+        std::memcpy(&buffer.data[offset + sizeof(entry)], &payload, sizeof(T));
+        if (extraBytes)
+            std::memcpy(&buffer.data[offset + sizeof(entry) + sizeof(T)], extra, extraBytes);
+        // Records larger than a chunk, code objects mostly, go straight out
+        if (buffer.data.size() > CHUNK) {
+            write(buffer.data.data(), buffer.data.size());
+            buffer.data.clear();
+        }
+    }
+
+    void flush() {
+        for (ThreadBuffer *buffer = mBuffers.load(); buffer; buffer = buffer->next) {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            write(buffer->data.data(), buffer->data.size());
+            buffer->data.clear();
+        }
+    }
+};
+
+// A recording mapped read only, its records indexed in time order
+class RecordFile {
+    void *mMapping;
+    size_t mSize;
+    std::vector<const RecordEntry *> mEntries;
+
+public:
+    RecordFile(const std::string &path) : mMapping(MAP_FAILED), mSize(0) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), path);
+        struct stat info;
+        if (fstat(fd, &info) == 0)
+            mSize = info.st_size;
+        if (mSize >= sizeof(RecordHeader))
+            mMapping = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mMapping == MAP_FAILED)
+            throw std::runtime_error(path + " is not a HIP recording");
+
+        const RecordHeader *header = static_cast<const RecordHeader *>(mMapping);
+        if (std::memcmp(header->magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) || (header->version != RECORD_VERSION)) {
+            munmap(mMapping, mSize);
+            throw std::runtime_error(path + " is not a HIP recording of version " + std::to_string(RECORD_VERSION));
+        }
+
+        // A capture cut short may end in a partial record, which is left out
+        const char *base = static_cast<const char *>(mMapping);
+        for (size_t offset = sizeof(RecordHeader); offset + sizeof(RecordEntry) <= mSize;) {
+            const RecordEntry *entry = reinterpret_cast<const RecordEntry *>(base + offset);
+            if ((entry->size < sizeof(RecordEntry)) || (entry->size % 8) || (offset + entry->size > mSize))
+                break;
+            mEntries.push_back(entry);
+            offset += entry->size;
+        }
+        std::stable_sort(mEntries.begin(), mEntries.end(), [](const RecordEntry *a, const RecordEntry *b) {
+            return a->time < b->time;
+        });
+    }
+
+    ~RecordFile() {
+        munmap(mMapping, mSize);
+    }
+
+    RecordFile(const RecordFile &) = delete;
+    RecordFile &operator=(const RecordFile &) = delete;
+
+    const std::vector<const RecordEntry *> &entries() const {
+        return mEntries;
+    }
+
+    size_t bytes() const {
+        return mSize;
+    }
+
+    // Payload of the record, nullptr if the record is too short for a T
+    template<typename T> static const T *payload(const RecordEntry *entry) {
+        if (entry->size < sizeof(RecordEntry) + sizeof(T))
+            return nullptr;
+        return reinterpret_cast<const T *>(entry + 1);
+    }
+
+    // What follows the payload, extraBytes long
+    template<typename T> static const char *extra(const RecordEntry *entry, size_t extraBytes) {
+        if (entry->size < sizeof(RecordEntry) + sizeof(T) + extraBytes)
+            return nullptr;
+        return reinterpret_cast<const char *>(entry + 1) + sizeof(T);
+    }
+};
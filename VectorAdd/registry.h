@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "launch.h"
+
+// Registry of benchmarkable kernels. Each kernel declares where it lives, how its
+// arguments are laid out, how to size its launch and how much memory traffic and math
+// it does per element, so harnesses can run any of them without knowing them by name.
+// New kernels are added with REGISTER_KERNEL in kernels.cpp (or any linked source).
+
+// Buffers are float vectors of the problem length; Length passes the length itself as
+// unsigned and Scalar the kernel's float scalar
+enum class ArgKind {
+    Output,
+    Input,
+    Length,
+    Scalar
+};
+
+struct KernelDesc {
+    const char *codeObject;
+    const char *symbol;
+    std::vector<ArgKind> args;
+    LaunchGeometry (*geometry)(size_t len);
+    double bytesPerElement;
+    double flopsPerElement;
+    // Host reference computing the output from the inputs, nullptr if there is nothing
+    // to validate
+    void (*reference)(float *out, const float *const *in, size_t len);
+    // Kernel in the same code object checking the output on the device, see verify.h;
+    // nullptr to check on the host against reference
+    const char *verifier = nullptr;
+    // Value passed for ArgKind::Scalar
+    float scalar = 0;
+
+    size_t count(ArgKind kind) const {
+        return std::count(args.begin(), args.end(), kind);
+    }
+};
+
+class KernelRegistry {
+    static std::vector<KernelDesc> &table() {
+        static std::vector<KernelDesc> kernels;
+        return kernels;
+    }
+
+public:
+    struct Registrar {
+        Registrar(const KernelDesc &desc) {
+            table().push_back(desc);
+        }
+    };
+
+    // Kernels in registration order
+    static const std::vector<KernelDesc> &all() {
+        return table();
+    }
+
+    static const KernelDesc &find(const std::string &symbol) {
+        for (auto &desc : table()) {
+            if (symbol == desc.symbol)
+                return desc;
+        }
+        throw std::invalid_argument("Kernel " + symbol + " is not registered");
+    }
+
+    // Most input buffers any registered kernel takes
+    static size_t maxInputs() {
+        size_t inputs = 0;
+        for (auto &desc : table())
+            inputs = std::max(inputs, desc.count(ArgKind::Input));
+        return inputs;
+    }
+};
+
+#define REGISTER_KERNEL(id, ...) static KernelRegistry::Registrar registered_##id(KernelDesc __VA_ARGS__)
+
+// Arguments for hipModuleLaunchKernel built from a kernel's layout, both as the
+// kernelParams array (get) and pre-packed for the extra parameter (config). Buffers are
+// given as slots: slot 0 is the output and slot 1 + k the k-th input.
+class KernelArgs {
+    std::vector<void *> mValues;
+    unsigned mLen;
+    float mScalar;
+    std::vector<void *> mArgs;
+    PackedArgs mPacked;
+
+public:
+    KernelArgs(const KernelDesc &desc, const std::vector<void *> &slots, size_t len) : mLen(len), mScalar(desc.scalar) {
+        mValues.reserve(desc.args.size());
+        size_t input = 0;
+        for (auto kind : desc.args) {
+            switch (kind) {
+            case ArgKind::Output:
+                mValues.push_back(slots.at(0));
+                mArgs.push_back(&mValues.back());
+                mPacked.push(mValues.back());
+                break;
+            case ArgKind::Input:
+                mValues.push_back(slots.at(1 + input++));
+                mArgs.push_back(&mValues.back());
+                mPacked.push(mValues.back());
+                break;
+            case ArgKind::Length:
+                mArgs.push_back(&mLen);
+                mPacked.push(mLen);
+                break;
+            case ArgKind::Scalar:
+                mArgs.push_back(&mScalar);
+                mPacked.push(mScalar);
+                break;
+            }
+        }
+    }
+
+    KernelArgs(const KernelArgs &) = delete;
+    KernelArgs &operator=(const KernelArgs &) = delete;
+
+    void **get() {
+        return mArgs.data();
+    }
+
+    void **config() {
+        return mPacked.config();
+    }
+};
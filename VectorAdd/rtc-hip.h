@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "hip/hiprtc.h"
+
+#include "rtc.h"
+
+inline void hiprtcCheck(hiprtcResult status, const std::string &note = "") {
+    if (status != HIPRTC_SUCCESS)
+        throw std::runtime_error(note + ": " + hiprtcGetErrorString(status));
+}
+
+// Compiles kernel source into a device code object with hiprtc
+class HiprtcCompiler : public RtcCompiler {
+    std::string mArch;
+    std::string mTarget;
+
+public:
+    HiprtcCompiler(const std::string &arch) : mArch(arch) {
+        int major = 0;
+        int minor = 0;
+        hiprtcCheck(hiprtcVersion(&major, &minor), "hiprtcVersion");
+        mTarget = "hiprtc:" + std::to_string(major) + '.' + std::to_string(minor) + ':' + arch;
+    }
+
+    std::string target() const override {
+        return mTarget;
+    }
+
+    std::vector<char> compile(const std::string &src, const std::string &name,
+                              const std::vector<std::string> &options) override {
+        hiprtcProgram prog;
+        hiprtcCheck(hiprtcCreateProgram(&prog, src.c_str(), name.c_str(), 0, nullptr, nullptr), "hiprtcCreateProgram");
+        std::vector<std::string> all(options);
+        all.push_back("--gpu-architecture=" + mArch);
+        std::vector<const char *> argv;
+        for (auto &option : all)
+            argv.push_back(option.c_str());
+
+        hiprtcResult result = hiprtcCompileProgram(prog, argv.size(), argv.data());
+        if (result != HIPRTC_SUCCESS) {
+            size_t logSize = 0;
+            hiprtcGetProgramLogSize(prog, &logSize);
+            std::string log(logSize, '\0');
+            if (logSize)
+                hiprtcGetProgramLog(prog, &log[0]);
+            hiprtcDestroyProgram(&prog);
+            hiprtcCheck(result, "hiprtcCompileProgram " + name + '\n' + log);
+        }
+        size_t codeSize = 0;
+        hiprtcCheck(hiprtcGetCodeSize(prog, &codeSize), "hiprtcGetCodeSize");
+        std::vector<char> code(codeSize);
+        hiprtcCheck(hiprtcGetCode(prog, code.data()), "hiprtcGetCode");
+        hiprtcCheck(hiprtcDestroyProgram(&prog), "hiprtcDestroyProgram");
+        return code;
+    }
+};
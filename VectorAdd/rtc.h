@@ -0,0 +1,365 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Runtime compilation of kernel source with a persistent, content addressed cache of
+// the resulting binaries. Any number of processes may share a cache directory.
+
+// 128-bit FNV-1a over length prefixed fields, used to address cache entries by content
+class Fnv128 {
+    unsigned __int128 mState;
+
+public:
+    Fnv128() : mState((static_cast<unsigned __int128>(0x6c62272e07bb0142ULL) << 64) | 0x62b821756295c58dULL) {}
+
+    Fnv128 &update(const void *data, size_t size) {
+        const unsigned __int128 prime = (static_cast<unsigned __int128>(1) << 88) | 0x13b;
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            mState ^= bytes[i];
+            mState *= prime;
+        }
+        return *this;
+    }
+
+    Fnv128 &update(const std::string &field) {
+        const uint64_t size = field.size();
+        update(&size, sizeof(size));
+        return update(field.data(), field.size());
+    }
+
+    std::string hex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string str;
+        for (int shift = 124; shift >= 0; shift -= 4)
+            str += digits[static_cast<unsigned>(mState >> shift) & 0xf];
+        return str;
+    }
+};
+
+class RtcCompiler {
+public:
+    virtual ~RtcCompiler() {}
+    // Identifies the toolchain and target the binaries are built for; part of the cache key
+    virtual std::string target() const = 0;
+    virtual std::vector<char> compile(const std::string &src, const std::string &name,
+                                      const std::vector<std::string> &options) = 0;
+};
+
+// Compiles C++ source into a host shared object with the system compiler ($CXX or c++).
+// Stands in for the device compiler so the cache can be exercised without a GPU.
+class HostCompiler : public RtcCompiler {
+    std::string mCompiler;
+    std::string mTarget;
+
+    static std::string run(const std::string &cmd) {
+        FILE *pipe = popen(cmd.c_str(), "r");
+        if (!pipe)
+            throw std::system_error(errno, std::system_category(), cmd);
+        std::string out;
+        char buf[256];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0)
+            out.append(buf, n);
+        if (pclose(pipe))
+            throw std::runtime_error(cmd + " failed\n" + out);
+        return out;
+    }
+
+public:
+    HostCompiler() : mCompiler(std::getenv("CXX") ? std::getenv("CXX") : "c++") {
+        mTarget = "host:" + mCompiler + ':' + run(mCompiler + " -dumpmachine") + ':' + run(mCompiler + " -dumpversion");
+        mTarget.erase(std::remove(mTarget.begin(), mTarget.end(), '\n'), mTarget.end());
+    }
+
+    std::string target() const override {
+        return mTarget;
+    }
+
+    std::vector<char> compile(const std::string &src, const std::string &name,
+                              const std::vector<std::string> &options) override {
+        char dir[] = "/tmp/rtcXXXXXX";
+        if (!mkdtemp(dir))
+            throw std::system_error(errno, std::system_category(), "mkdtemp");
+        const std::string srcPath = std::string(dir) + '/' + name;
+        const std::string soPath = std::string(dir) + "/out.so";
+        std::ofstream(srcPath) << src;
+
+        std::string cmd = mCompiler + " -shared -fPIC -O2";
+        for (auto &option : options)
+            cmd += ' ' + option;
+        cmd += " -x c++ " + srcPath + " -o " + soPath + " 2>&1";
+        std::string log;
+        try {
+            log = run(cmd);
+        } catch (...) {
+            unlink(srcPath.c_str());
+            rmdir(dir);
+            throw;
+        }
+
+        std::ifstream so(soPath, std::ios::binary);
+        std::vector<char> image((std::istreambuf_iterator<char>(so)), std::istreambuf_iterator<char>());
+        unlink(srcPath.c_str());
+        unlink(soPath.c_str());
+        rmdir(dir);
+        return image;
+    }
+};
+
+// Host shared object loaded from memory, the counterpart of hipModuleLoadData
+class HostModule {
+    void *mHandle;
+
+public:
+    HostModule(const std::vector<char> &image) : mHandle(nullptr) {
+        const int fd = memfd_create("rtc", MFD_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), "memfd_create");
+        if (write(fd, image.data(), image.size()) != static_cast<ssize_t>(image.size())) {
+            close(fd);
+            throw std::system_error(errno, std::system_category(), "write");
+        }
+        mHandle = dlopen(("/proc/self/fd/" + std::to_string(fd)).c_str(), RTLD_NOW | RTLD_LOCAL);
+        close(fd);
+        if (!mHandle)
+            throw std::runtime_error(dlerror());
+    }
+
+    ~HostModule() noexcept {
+        dlclose(mHandle);
+    }
+
+    HostModule(const HostModule &) = delete;
+    HostModule &operator=(const HostModule &) = delete;
+
+    template<typename F> F symbol(const char *name) const {
+        void *sym = dlsym(mHandle, name);
+        if (!sym)
+            throw std::runtime_error(std::string("Symbol ") + name + " not found");
+        return reinterpret_cast<F>(sym);
+    }
+};
+
+// Directory of binaries named by the hash of (target, options, source). Entries are
+// written to a temporary file and renamed into place so readers never see partial
+// files; a per entry lock keeps concurrent processes from compiling the same source
+// twice. Once the directory grows past its budget the least recently used entries,
+// by modification time which every hit refreshes, are removed. The empty lock files
+// stay: unlinking one another process holds would let a third lock a fresh inode.
+class CodeObjectCache {
+    std::string mDir;
+    size_t mMaxBytes;
+    size_t mHits;
+    size_t mMisses;
+
+    static void makeDirs(const std::string &path) {
+        for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+            const std::string dir = path.substr(0, pos);
+            if (mkdir(dir.c_str(), 0755) && (errno != EEXIST))
+                throw std::system_error(errno, std::system_category(), "mkdir " + dir);
+            if (pos == std::string::npos)
+                break;
+        }
+    }
+
+    // Read a whole entry and mark it recently used, false if it does not exist
+    static bool read(const std::string &path, std::vector<char> &image) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st)) {
+            close(fd);
+            return false;
+        }
+        image.resize(st.st_size);
+        const bool ok = (::read(fd, image.data(), image.size()) == st.st_size);
+        futimens(fd, nullptr);
+        close(fd);
+        return ok;
+    }
+
+    void write(const std::string &path, const std::vector<char> &image) const {
+        std::string temp = path + ".XXXXXX";
+        const int fd = mkstemp(&temp[0]);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), "mkstemp " + temp);
+        const bool ok = (::write(fd, image.data(), image.size()) == static_cast<ssize_t>(image.size()));
+        close(fd);
+        if (!ok || rename(temp.c_str(), path.c_str())) {
+            const int ec = errno;
+            unlink(temp.c_str());
+            throw std::system_error(ec, std::system_category(), "write " + path);
+        }
+    }
+
+public:
+    static const size_t DEFAULT_MAX_BYTES = 256 * 0x100000;
+
+    CodeObjectCache(const std::string &dir = defaultDir(), size_t maxBytes = DEFAULT_MAX_BYTES)
+        : mDir(dir), mMaxBytes(maxBytes), mHits(0), mMisses(0) {
+        makeDirs(mDir);
+    }
+
+    // $ROCMEXP_CACHE_DIR, else $XDG_CACHE_HOME/rocmexp, else ~/.cache/rocmexp
+    static std::string defaultDir() {
+        if (const char *dir = std::getenv("ROCMEXP_CACHE_DIR"))
+            return dir;
+        if (const char *dir = std::getenv("XDG_CACHE_HOME"))
+            return std::string(dir) + "/rocmexp";
+        const char *home = std::getenv("HOME");
+        return std::string(home ? home : "/tmp") + "/.cache/rocmexp";
+    }
+
+    static std::string key(const RtcCompiler &compiler, const std::string &src,
+                           const std::vector<std::string> &options) {
+        Fnv128 hash;
+        hash.update(compiler.target());
+        for (auto &option : options)
+            hash.update(option);
+        hash.update(src);
+        return hash.hex();
+    }
+
+    // Binary for the source, compiled only if no process has cached it yet
+    std::vector<char> get(RtcCompiler &compiler, const std::string &src, const std::string &name,
+                          const std::vector<std::string> &options, bool *hit = nullptr) {
+        const std::string k = key(compiler, src, options);
+        const std::string path = mDir + '/' + k + ".co";
+        std::vector<char> image;
+        if (read(path, image)) {
+            mHits++;
+            if (hit)
+                *hit = true;
+            return image;
+        }
+
+        const std::string lockPath = mDir + '/' + k + ".lock";
+        const int lock = open(lockPath.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+        if (lock < 0)
+            throw std::system_error(errno, std::system_category(), "open " + lockPath);
+        flock(lock, LOCK_EX);
+        const bool raced = read(path, image);
+        if (!raced) {
+            try {
+                image = compiler.compile(src, name, options);
+                write(path, image);
+            } catch (...) {
+                close(lock);
+                throw;
+            }
+        }
+        close(lock);
+
+        if (raced)
+            mHits++;
+        else
+            mMisses++;
+        if (hit)
+            *hit = raced;
+        if (!raced)
+            evict();
+        return image;
+    }
+
+    // Remove least recently used entries until the cache fits its budget. Only one
+    // process evicts at a time, others skip it.
+    void evict() {
+        const int lock = open((mDir + "/evict.lock").c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+        if (lock < 0)
+            return;
+        if (flock(lock, LOCK_EX | LOCK_NB)) {
+            close(lock);
+            return;
+        }
+
+        struct Entry {
+            std::string key;
+            size_t size;
+            struct timespec used;
+        };
+        std::vector<Entry> entries;
+        size_t total = 0;
+        if (DIR *dir = opendir(mDir.c_str())) {
+            while (struct dirent *ent = readdir(dir)) {
+                const std::string name = ent->d_name;
+                if ((name.size() < 4) || (name.compare(name.size() - 3, 3, ".co") != 0))
+                    continue;
+                struct stat st;
+                if (stat((mDir + '/' + name).c_str(), &st))
+                    continue;
+                entries.push_back(Entry{name.substr(0, name.size() - 3), static_cast<size_t>(st.st_size), st.st_mtim});
+                total += st.st_size;
+            }
+            closedir(dir);
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+            return (a.used.tv_sec != b.used.tv_sec) ? (a.used.tv_sec < b.used.tv_sec) : (a.used.tv_nsec < b.used.tv_nsec);
+        });
+        for (auto &entry : entries) {
+            if (total <= mMaxBytes)
+                break;
+            unlink((mDir + '/' + entry.key + ".co").c_str());
+            total -= entry.size;
+        }
+        close(lock);
+    }
+
+    // Number of entries and their total size in bytes
+    size_t usage(size_t *bytes = nullptr) const {
+        size_t count = 0;
+        size_t total = 0;
+        if (DIR *dir = opendir(mDir.c_str())) {
+            while (struct dirent *ent = readdir(dir)) {
+                const std::string name = ent->d_name;
+                if ((name.size() < 4) || (name.compare(name.size() - 3, 3, ".co") != 0))
+                    continue;
+                struct stat st;
+                if (stat((mDir + '/' + name).c_str(), &st))
+                    continue;
+                count++;
+                total += st.st_size;
+            }
+            closedir(dir);
+        }
+        if (bytes)
+            *bytes = total;
+        return count;
+    }
+
+    const std::string &dir() const {
+        return mDir;
+    }
+
+    size_t hits() const {
+        return mHits;
+    }
+
+    size_t misses() const {
+        return mMisses;
+    }
+};
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <cstdint>
+
+// Descriptor of one message in a coalesced transfer: bytes at offset in the staging
+// buffer go to dst. Shared by coalesce.h and the scatter_copy kernel in kernel.cpp.
+struct ScatterEntry {
+    uint64_t dst;
+    uint32_t offset;
+    uint32_t bytes;
+};
@@ -0,0 +1,298 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "launch.h"
+
+// One kernel launch of a tenant. cost is the tenant's own measure of the work (say
+// elements touched) and is what weights share out; config must outlive the launch.
+struct TenantLaunch {
+    hipFunction_t function;
+    LaunchGeometry geometry;
+    void **config;
+    const char *name;
+    size_t cost;
+};
+
+struct TenantConfig {
+    std::string name;
+    // Share of the device relative to the other tenants
+    unsigned weight;
+    // Higher runs on a higher priority stream
+    bool highPriority;
+    // Admission control: launches queued beyond this are turned away
+    size_t queueLimit;
+};
+
+// Submission scheduler in front of the device. Every tenant has its own stream and
+// queue; a dispatcher thread keeps at most inflight launches on the device and picks the
+// next one by deficit round robin over the tenant queues, so a tenant which always has
+// work queued gets a weight proportional share of the cost and cannot push the launches
+// of a light tenant behind a deep backlog. With Direct the queues are bypassed and
+// tenants launch straight into their streams, racing for the device as separate threads
+// would.
+class TenantScheduler {
+public:
+    enum class Policy {
+        Direct,
+        DeficitRoundRobin
+    };
+
+    struct TenantStats {
+        size_t submitted;
+        size_t rejected;
+        size_t completed;
+        size_t cost;
+        // Submit to completion in microseconds
+        std::vector<long long> latencies;
+    };
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Queued {
+        TenantLaunch launch;
+        Clock::time_point submitted;
+    };
+
+    struct InFlight {
+        size_t tenant;
+        hipEvent_t event;
+        size_t cost;
+        Clock::time_point submitted;
+    };
+
+    struct Tenant {
+        TenantConfig config;
+        hipStream_t stream;
+        std::deque<Queued> queue;
+        size_t deficit;
+        TenantStats stats;
+    };
+
+    const Policy mPolicy;
+    const size_t mInflightLimit;
+    const size_t mQuantum;
+    std::vector<Tenant> mTenants;
+    std::mutex mMutex;
+    std::condition_variable mWork;
+    std::deque<InFlight> mInflight;
+    std::vector<hipEvent_t> mEvents;
+    size_t mCurrent;
+    // Whether the current tenant already had its quantum this round
+    bool mCredited;
+    bool mStopping;
+    std::thread mDispatcher;
+
+    hipEvent_t takeEvent() {
+        if (mEvents.empty()) {
+            hipEvent_t event;
+            hipCheck(hipEventCreateWithFlags(&event, hipEventDisableTiming));
+            return event;
+        }
+        hipEvent_t event = mEvents.back();
+        mEvents.pop_back();
+        return event;
+    }
+
+    // Launch on the tenant's stream and track it, called with the lock held
+    void launch(size_t tenant, const TenantLaunch &launch, Clock::time_point submitted) {
+        const LaunchGeometry &geometry = launch.geometry;
+        hipCheck(hipModuleLaunchKernel(launch.function,
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         0, mTenants[tenant].stream, nullptr, launch.config), launch.name);
+        const hipEvent_t event = takeEvent();
+        hipCheck(hipEventRecord(event, mTenants[tenant].stream));
+        mInflight.push_back(InFlight{tenant, event, launch.cost, submitted});
+    }
+
+    // Account every launch which finished, called with the lock held
+    bool retire() {
+        bool retired = false;
+        const Clock::time_point now = Clock::now();
+        for (auto it = mInflight.begin(); it != mInflight.end();) {
+            const hipError_t status = hipEventQuery(it->event);
+            if (status == hipErrorNotReady) {
+                ++it;
+                continue;
+            }
+            hipCheck(status, "hipEventQuery");
+            TenantStats &stats = mTenants[it->tenant].stats;
+            stats.completed++;
+            stats.cost += it->cost;
+            stats.latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - it->submitted).count());
+            mEvents.push_back(it->event);
+            it = mInflight.erase(it);
+            retired = true;
+        }
+        return retired;
+    }
+
+    // Next launch by deficit round robin, called with the lock held: the tenant in turn
+    // is credited its quantum once per round and sends launches while its deficit covers
+    // them; an idle tenant keeps no credit
+    bool dispatch() {
+        if (mTenants.empty())
+            return false;
+        for (size_t visited = 0; visited <= mTenants.size(); visited++) {
+            Tenant &tenant = mTenants[mCurrent];
+            if (!tenant.queue.empty()) {
+                if (!mCredited) {
+                    tenant.deficit += mQuantum * tenant.config.weight;
+                    mCredited = true;
+                }
+                const Queued &head = tenant.queue.front();
+                if (head.launch.cost <= tenant.deficit) {
+                    tenant.deficit -= head.launch.cost;
+                    launch(mCurrent, head.launch, head.submitted);
+                    tenant.queue.pop_front();
+                    if (tenant.queue.empty())
+                        tenant.deficit = 0;
+                    return true;
+                }
+            }
+            else {
+                tenant.deficit = 0;
+            }
+            mCurrent = (mCurrent + 1) % mTenants.size();
+            mCredited = false;
+        }
+        return false;
+    }
+
+    bool queued() const {
+        for (auto &tenant : mTenants) {
+            if (!tenant.queue.empty())
+                return true;
+        }
+        return false;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopping || !mInflight.empty() || queued()) {
+            retire();
+            bool progress = false;
+            while ((mInflight.size() < mInflightLimit) && dispatch())
+                progress = true;
+            if (progress)
+                continue;
+            if (mInflight.empty() && !queued()) {
+                mWork.wait(lock);
+                continue;
+            }
+            // Launches are in flight, poll their events without holding up submitters
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+    }
+
+public:
+    // quantum is the cost a tenant of weight 1 may send per round. Well below the
+    // largest launch it keeps rounds short, so that a light tenant's launch waits for
+    // little more than the launches already in flight.
+    TenantScheduler(Policy policy, size_t inflight, size_t quantum) : mPolicy(policy),
+                                                                       mInflightLimit(std::max<size_t>(1, inflight)),
+                                                                       mQuantum(std::max<size_t>(1, quantum)),
+                                                                       mCurrent(0), mCredited(false),
+                                                                       mStopping(false) {}
+
+    ~TenantScheduler() {
+        stop();
+        for (auto &tenant : mTenants)
+            (void)hipStreamDestroy(tenant.stream);
+        for (auto event : mEvents)
+            (void)hipEventDestroy(event);
+    }
+
+    TenantScheduler(const TenantScheduler &) = delete;
+    TenantScheduler &operator=(const TenantScheduler &) = delete;
+
+    // Add tenants before start()
+    size_t addTenant(const TenantConfig &config) {
+        int least = 0;
+        int greatest = 0;
+        hipCheck(hipDeviceGetStreamPriorityRange(&least, &greatest));
+        hipStream_t stream;
+        hipCheck(hipStreamCreateWithPriority(&stream, hipStreamNonBlocking, config.highPriority ? greatest : least));
+        mTenants.push_back(Tenant{config, stream, {}, 0, TenantStats{0, 0, 0, 0, {}}});
+        return mTenants.size() - 1;
+    }
+
+    void start() {
+        mDispatcher = std::thread([this]() {
+            run();
+        });
+    }
+
+    // Let everything submitted so far finish and stop the dispatcher
+    void stop() {
+        if (!mDispatcher.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWork.notify_one();
+        mDispatcher.join();
+    }
+
+    // Queue a launch for the tenant; false if admission control turned it away
+    bool submit(size_t tenant, const TenantLaunch &launch) {
+        const Clock::time_point now = Clock::now();
+        std::lock_guard<std::mutex> lock(mMutex);
+        Tenant &target = mTenants.at(tenant);
+        target.stats.submitted++;
+        if (mPolicy == Policy::Direct) {
+            this->launch(tenant, launch, now);
+            mWork.notify_one();
+            return true;
+        }
+        if (target.queue.size() >= target.config.queueLimit) {
+            target.stats.rejected++;
+            return false;
+        }
+        target.queue.push_back(Queued{launch, now});
+        mWork.notify_one();
+        return true;
+    }
+
+    // Launches of the tenant admitted but not finished yet
+    size_t outstanding(size_t tenant) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const TenantStats &stats = mTenants.at(tenant).stats;
+        return stats.submitted - stats.rejected - stats.completed;
+    }
+
+    const TenantConfig &config(size_t tenant) const {
+        return mTenants.at(tenant).config;
+    }
+
+    hipStream_t stream(size_t tenant) const {
+        return mTenants.at(tenant).stream;
+    }
+
+    size_t tenants() const {
+        return mTenants.size();
+    }
+
+    // Only stable once stopped
+    TenantStats &stats(size_t tenant) {
+        return mTenants.at(tenant).stats;
+    }
+};
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "expr.h"
+#include "hostexec.h"
+#include "launch.h"
+#include "segments.h"
+
+// Ragged batch of independent vector additions: segment s adds lengths[s] elements at
+// its own three addresses. The offset table (exclusive prefix sum of the lengths) lets
+// both the device kernel and the host split the flattened element range evenly no
+// matter how skewed the lengths are.
+class RaggedBatch {
+    std::vector<Segment> mSegments;
+    std::vector<unsigned> mOffsets;
+
+public:
+    // The kernel indexes the flattened elements with 32 bits and may run a tile past the
+    // end of the batch
+    static const unsigned MAX_TOTAL = UINT_MAX - 0x10000;
+
+    RaggedBatch() : mOffsets(1, 0) {}
+
+    void add(float *aaa, const float *bbb, const float *ccc, unsigned len) {
+        if (len > MAX_TOTAL - mOffsets.back())
+            throw std::length_error("Ragged batch of more than " + std::to_string(MAX_TOTAL) + " elements");
+        mSegments.push_back(Segment{reinterpret_cast<uint64_t>(aaa), reinterpret_cast<uint64_t>(bbb),
+                                    reinterpret_cast<uint64_t>(ccc)});
+        mOffsets.push_back(mOffsets.back() + len);
+    }
+
+    const std::vector<Segment> &segments() const {
+        return mSegments;
+    }
+
+    const std::vector<unsigned> &offsets() const {
+        return mOffsets;
+    }
+
+    size_t count() const {
+        return mSegments.size();
+    }
+
+    unsigned total() const {
+        return mOffsets.back();
+    }
+
+    unsigned length(size_t s) const {
+        return mOffsets[s + 1] - mOffsets[s];
+    }
+};
+
+// Launches vectoradd_segmented from kernel.co over a batch of device pointers
+class DeviceRaggedAdd {
+    static const unsigned THREADS_PER_BLOCK_X = 256;
+    static_assert(THREADS_PER_BLOCK_X * SEGMENT_ITEMS <= UINT_MAX - RaggedBatch::MAX_TOTAL,
+                  "a tile past the end of the largest batch must not wrap around");
+
+    hipFunction_t mFunction;
+    std::unique_ptr<DeviceBO<Segment>> mSegments;
+    std::unique_ptr<DeviceBO<unsigned>> mOffsets;
+    PackedArgs mArgs;
+    unsigned mTotal;
+
+public:
+    DeviceRaggedAdd(HipDevice &device) : mFunction(device.getFunction("kernel.co", "vectoradd_segmented")), mTotal(0) {}
+
+    // Upload the segment and offset tables, they stay valid for every launch until the
+    // next upload
+    void upload(const RaggedBatch &batch, hipStream_t stream = 0) {
+        mSegments.reset(new DeviceBO<Segment>(batch.count()));
+        mOffsets.reset(new DeviceBO<unsigned>(batch.count() + 1));
+        hipCheck(hipMemcpyWithStream(mSegments->get(), batch.segments().data(), batch.count() * sizeof(Segment),
+                                     hipMemcpyHostToDevice, stream));
+        hipCheck(hipMemcpyWithStream(mOffsets->get(), batch.offsets().data(), (batch.count() + 1) * sizeof(unsigned),
+                                     hipMemcpyHostToDevice, stream));
+        mTotal = batch.total();
+        mArgs.clear();
+        mArgs.push(mSegments->get());
+        mArgs.push(mOffsets->get());
+        mArgs.push(static_cast<unsigned>(batch.count()));
+        mArgs.push(mTotal);
+    }
+
+    // An empty batch launches nothing
+    void launch(hipStream_t stream = 0) {
+        if (!mTotal)
+            return;
+        const unsigned tile = THREADS_PER_BLOCK_X * SEGMENT_ITEMS;
+        hipCheck(hipModuleLaunchKernel(mFunction,
+                                         (mTotal + tile - 1) / tile, 1, 1,
+                                         THREADS_PER_BLOCK_X, 1, 1,
+                                         0, stream, nullptr, mArgs.config()), "vectoradd_segmented");
+    }
+};
+
+// SIMD vector addition of one run of elements, unaligned at either end
+inline void hostSimdAdd(float *aaa, const float *bbb, const float *ccc, size_t len)
+{
+    size_t i = 0;
+    for (; i + expr::LANES <= len; i += expr::LANES) {
+        expr::vfloat b, c;
+        std::memcpy(&b, bbb + i, sizeof(b));
+        std::memcpy(&c, ccc + i, sizeof(c));
+        const expr::vfloat a = b + c;
+        std::memcpy(aaa + i, &a, sizeof(a));
+    }
+    for (; i < len; i++)
+        aaa[i] = bbb[i] + ccc[i];
+}
+
+// Host equivalent of vectoradd_segmented: every pinned thread of the pool takes an equal
+// share of the flattened elements, finds the segment its share starts in and walks forward
+inline void hostRaggedAdd(const RaggedBatch &batch, WorkerPool &pool)
+{
+    if (!batch.total())
+        return;
+    const std::vector<unsigned> &offsets = batch.offsets();
+    pool.run(batch.total(), [&](size_t begin, size_t end) {
+        size_t s = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+        for (size_t i = begin; i < end; s++) {
+            const size_t stop = std::min<size_t>(end, offsets[s + 1]);
+            if (stop <= i)
+                continue;
+            const Segment &segment = batch.segments()[s];
+            const size_t k = i - offsets[s];
+            hostSimdAdd(reinterpret_cast<float *>(segment.aaa) + k, reinterpret_cast<const float *>(segment.bbb) + k,
+                        reinterpret_cast<const float *>(segment.ccc) + k, stop - i);
+            i = stop;
+        }
+    });
+}
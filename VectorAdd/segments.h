@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <cstdint>
+
+// One vector addition of a ragged batch, aaa = bbb + ccc with the length given by the
+// batch's offset table. Shared by segmented.h and the vectoradd_segmented kernel in
+// kernel.cpp.
+struct Segment {
+    uint64_t aaa;
+    uint64_t bbb;
+    uint64_t ccc;
+};
+
+// Elements of the batch each thread of vectoradd_segmented handles
+#define SEGMENT_ITEMS 4
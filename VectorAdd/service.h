@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Protocol of the vector add service (main-daemon, main-loadgen). Clients talk to the
+// daemon over a SOCK_SEQPACKET Unix socket, one fixed size message per request or
+// response. Data never goes through the socket: a client maps a shared memory file
+// (memfd) into the daemon once by passing its descriptor with Map and then refers to
+// regions of it by byte offset in Add requests; results are written back in place.
+// The daemon only maps files sealed against shrinking, which could otherwise fault it.
+
+static const uint32_t SERVICE_MAGIC = 0x56414444;
+
+enum class ServiceOp : uint32_t {
+    Map = 1,
+    Add = 2,
+    Unmap = 3
+};
+
+struct ServiceRequest {
+    uint32_t magic;
+    ServiceOp op;
+    uint64_t id;
+    // Map: size of the passed file; Add, Unmap: handle returned by Map
+    uint64_t handle;
+    uint64_t size;
+    // Add: aaa = bbb + ccc over len floats at these byte offsets of the mapping
+    uint64_t aaa;
+    uint64_t bbb;
+    uint64_t ccc;
+    uint32_t len;
+    uint32_t reserved;
+};
+
+struct ServiceResponse {
+    uint64_t id;
+    // 0 or a negative errno
+    int32_t status;
+    // Requests in the launch which served this one
+    uint32_t batch;
+    uint64_t handle;
+    // Time from arrival to the start of the batch and time the batch took
+    uint64_t queueUs;
+    uint64_t serviceUs;
+};
+
+inline std::string defaultSocketPath()
+{
+    const char *dir = std::getenv("XDG_RUNTIME_DIR");
+    return std::string((dir && *dir) ? dir : "/tmp") + "/rocmexp-vadd.sock";
+}
+
+inline sockaddr_un socketAddress(const std::string &path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument("Socket path " + path + " is too long");
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+inline int listenSocket(const std::string &path)
+{
+    const sockaddr_un address = socketAddress(path);
+    const int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        throw std::system_error(errno, std::generic_category(), "socket");
+    unlink(path.c_str());
+    if (bind(sock, (const sockaddr *)&address, sizeof(address)) || listen(sock, SOMAXCONN)) {
+        const int error = errno;
+        close(sock);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    return sock;
+}
+
+inline int connectSocket(const std::string &path)
+{
+    const sockaddr_un address = socketAddress(path);
+    const int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        throw std::system_error(errno, std::generic_category(), "socket");
+    if (connect(sock, (const sockaddr *)&address, sizeof(address))) {
+        const int error = errno;
+        close(sock);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    return sock;
+}
+
+// Send one message, with a descriptor attached unless fd is -1
+inline void sendMessage(int sock, const void *message, size_t size, int fd = -1)
+{
+    iovec iov = {const_cast<void *>(message), size};
+    msghdr header;
+    std::memset(&header, 0, sizeof(header));
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0) {
+        std::memset(control, 0, sizeof(control));
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&header);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    if (sendmsg(sock, &header, MSG_NOSIGNAL) != static_cast<ssize_t>(size))
+        throw std::system_error(errno, std::generic_category(), "sendmsg");
+}
+
+// Receive one message of exactly size bytes and the descriptor attached to it, if any,
+// into fd. Returns 1 for a message, 0 at end of stream and -1 if flags included
+// MSG_DONTWAIT and nothing was pending.
+inline int receiveMessage(int sock, void *message, size_t size, int *fd, int flags = 0)
+{
+    iovec iov = {message, size};
+    msghdr header;
+    std::memset(&header, 0, sizeof(header));
+    header.msg_iov = &iov;
+    header.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))];
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+    const ssize_t received = recvmsg(sock, &header, flags | MSG_CMSG_CLOEXEC);
+    if (received < 0) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            return -1;
+        throw std::system_error(errno, std::generic_category(), "recvmsg");
+    }
+    if (fd)
+        *fd = -1;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+            int received_fd;
+            std::memcpy(&received_fd, CMSG_DATA(cmsg), sizeof(int));
+            if (fd)
+                *fd = received_fd;
+            else
+                close(received_fd);
+        }
+    }
+    if (received == 0)
+        return 0;
+    if (static_cast<size_t>(received) != size)
+        throw std::runtime_error("Truncated service message");
+    return 1;
+}
+
+// Shared mapping of a whole memfd or other shareable file
+class SharedMapping {
+    void *mData;
+    size_t mSize;
+
+public:
+    SharedMapping(int fd, size_t size) : mData(nullptr), mSize(size) {
+        mData = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mData == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+
+    ~SharedMapping() {
+        munmap(mData, mSize);
+    }
+
+    SharedMapping(const SharedMapping &) = delete;
+    SharedMapping &operator=(const SharedMapping &) = delete;
+
+    char *get() const {
+        return static_cast<char *>(mData);
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+    // Whether len floats at the byte offset lie inside the mapping
+    bool contains(uint64_t offset, uint64_t len) const {
+        return (offset % sizeof(float) == 0) && (offset <= mSize) && (len * sizeof(float) <= mSize - offset);
+    }
+};
+
+// Memory file of size bytes, sealed so that no process it is passed to can shrink it
+inline int createMemfd(const char *name, size_t size)
+{
+    const int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "memfd_create");
+    if (ftruncate(fd, size)) {
+        const int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "ftruncate");
+    }
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+        const int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "fcntl F_ADD_SEALS");
+    }
+    return fd;
+}
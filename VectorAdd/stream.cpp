@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+// STREAM kernels (McCalpin, https://www.cs.virginia.edu/stream/) in the argument order of
+// the kernel registry: output first, then inputs, the scalar and the length
+
+#include "hip/hip_runtime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+__global__ void
+stream_copy(float* __restrict__ aaa, const float* __restrict__ bbb, unsigned len);
+__global__ void
+stream_scale(float* __restrict__ aaa, const float* __restrict__ bbb, float scalar, unsigned len);
+__global__ void
+stream_add(float* __restrict__ aaa, const float* __restrict__ bbb, const float* __restrict__ ccc, unsigned len);
+__global__ void
+stream_triad(float* __restrict__ aaa, const float* __restrict__ bbb, const float* __restrict__ ccc,
+             float scalar, unsigned len);
+#ifdef __cplusplus
+}
+#endif
+
+__global__ void
+stream_copy(float* __restrict__ aaa, const float* __restrict__ bbb, unsigned len)
+{
+    unsigned i = hipBlockDim_x * hipBlockIdx_x + hipThreadIdx_x;
+    if (i < len)
+        aaa[i] = bbb[i];
+}
+
+__global__ void
+stream_scale(float* __restrict__ aaa, const float* __restrict__ bbb, float scalar, unsigned len)
+{
+    unsigned i = hipBlockDim_x * hipBlockIdx_x + hipThreadIdx_x;
+    if (i < len)
+        aaa[i] = scalar * bbb[i];
+}
+
+__global__ void
+stream_add(float* __restrict__ aaa, const float* __restrict__ bbb, const float* __restrict__ ccc, unsigned len)
+{
+    unsigned i = hipBlockDim_x * hipBlockIdx_x + hipThreadIdx_x;
+    if (i < len)
+        aaa[i] = bbb[i] + ccc[i];
+}
+
+// Explicitly fused so the result does not depend on the compiler's contraction choice
+// and matches the host reference bit for bit
+__global__ void
+stream_triad(float* __restrict__ aaa, const float* __restrict__ bbb, const float* __restrict__ ccc,
+             float scalar, unsigned len)
+{
+    unsigned i = hipBlockDim_x * hipBlockIdx_x + hipThreadIdx_x;
+    if (i < len)
+        aaa[i] = fmaf(scalar, ccc[i], bbb[i]);
+}
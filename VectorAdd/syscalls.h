@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dlfcn.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+// In-process accounting of the driver round trips the runtime makes. The executable
+// defines ioctl() itself (ACCOUNT_IOCTLS() in exactly one source, linked with -rdynamic)
+// so the calls the HIP runtime and the thunk make through the PLT land here first, are
+// counted by driver and command number, and are forwarded to the C library.
+//
+// Calls the runtime makes with syscall(SYS_ioctl, ...) or from code linked with
+// -Bsymbolic bypass the interposer; IoctlAccounting::active() tells whether any call
+// was seen at all.
+
+class IoctlAccounting {
+public:
+    enum Driver {
+        KFD,
+        DRM,
+        OTHER,
+        DRIVERS
+    };
+
+    // Counts of every driver command, indexed by Driver * 256 + command number
+    struct Counts {
+        std::vector<uint64_t> calls;
+        // Voluntary context switches of the calling thread, its blocking waits; the
+        // runtime's own threads are not counted
+        long switches;
+
+        Counts() : calls(DRIVERS * 256, 0), switches(0) {}
+
+        uint64_t total() const {
+            uint64_t sum = 0;
+            for (auto count : calls)
+                sum += count;
+            return sum;
+        }
+
+        Counts operator-(const Counts &start) const {
+            Counts delta;
+            for (size_t i = 0; i < calls.size(); i++)
+                delta.calls[i] = calls[i] - start.calls[i];
+            delta.switches = switches - start.switches;
+            return delta;
+        }
+    };
+
+private:
+    std::atomic<uint64_t> mCalls[DRIVERS * 256];
+
+    IoctlAccounting() {
+        for (auto &count : mCalls)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+public:
+    static IoctlAccounting &instance() {
+        static IoctlAccounting accounting;
+        return accounting;
+    }
+
+    static Driver driver(unsigned long request) {
+        // AMDKFD_IOCTL_BASE is 'K', DRM_IOCTL_BASE is 'd'
+        switch (_IOC_TYPE(request)) {
+        case 'K':
+            return KFD;
+        case 'd':
+            return DRM;
+        default:
+            return OTHER;
+        }
+    }
+
+    void count(unsigned long request) {
+        mCalls[driver(request) * 256 + _IOC_NR(request)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool active() const {
+        for (auto &count : mCalls) {
+            if (count.load(std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+
+    Counts snapshot() const {
+        Counts counts;
+        for (size_t i = 0; i < counts.calls.size(); i++)
+            counts.calls[i] = mCalls[i].load(std::memory_order_relaxed);
+        rusage usage;
+        if (getrusage(RUSAGE_THREAD, &usage) == 0)
+            counts.switches = usage.ru_nvcsw;
+        return counts;
+    }
+
+    // Name of a command as strace prints it, from kfd_ioctl.h for the KFD commands
+    static std::string name(size_t index) {
+        static const char *kfd[] = {
+            nullptr, "GET_VERSION", "CREATE_QUEUE", "DESTROY_QUEUE", "SET_MEMORY_POLICY",
+            "GET_CLOCK_COUNTERS", "GET_PROCESS_APERTURES", "UPDATE_QUEUE", "CREATE_EVENT",
+            "DESTROY_EVENT", "SET_EVENT", "RESET_EVENT", "WAIT_EVENTS", "DBG_REGISTER",
+            "DBG_UNREGISTER", "DBG_ADDRESS_WATCH", "DBG_WAVE_CONTROL", "SET_SCRATCH_BACKING_VA",
+            "GET_TILE_CONFIG", "SET_TRAP_HANDLER", "GET_PROCESS_APERTURES_NEW", "ACQUIRE_VM",
+            "ALLOC_MEMORY_OF_GPU", "FREE_MEMORY_OF_GPU", "MAP_MEMORY_TO_GPU", "UNMAP_MEMORY_FROM_GPU",
+            "SET_CU_MASK", "GET_QUEUE_WAVE_STATE", "GET_DMABUF_INFO", "IMPORT_DMABUF",
+            "ALLOC_QUEUE_GWS", "SMI_EVENTS", "SVM", "SET_XNACK_MODE", "CRIU_OP", "AVAILABLE_MEMORY",
+            "EXPORT_DMABUF", "RUNTIME_ENABLE", "DBG_TRAP"
+        };
+        const size_t nr = index % 256;
+        std::ostringstream text;
+        switch (index / 256) {
+        case KFD:
+            if ((nr < sizeof(kfd) / sizeof(kfd[0])) && kfd[nr])
+                return std::string("AMDKFD_IOC_") + kfd[nr];
+            text << "AMDKFD_IOC_0x" << std::hex << nr;
+            break;
+        case DRM:
+            text << "DRM_IOC_0x" << std::hex << nr;
+            break;
+        default:
+            text << "ioctl_0x" << std::hex << nr;
+            break;
+        }
+        return text.str();
+    }
+
+    // One line per command issued during the interval, busiest first, as calls per op
+    static void print(std::ostream &stream, const Counts &delta, size_t ops) {
+        std::vector<std::pair<uint64_t, size_t>> busiest;
+        for (size_t i = 0; i < delta.calls.size(); i++) {
+            if (delta.calls[i])
+                busiest.emplace_back(delta.calls[i], i);
+        }
+        std::sort(busiest.begin(), busiest.end(), std::greater<std::pair<uint64_t, size_t>>());
+        for (auto &command : busiest) {
+            stream << "    " << std::setw(36) << std::left << name(command.second) << std::right
+                   << std::setw(10) << command.first << std::fixed << std::setprecision(3)
+                   << std::setw(12) << double(command.first) / std::max<size_t>(ops, 1) << std::endl;
+            stream.unsetf(std::ios_base::floatfield);
+        }
+    }
+};
+
+// Defines the interposing ioctl(); use once per executable, at namespace scope
+#define ACCOUNT_IOCTLS()                                                \
+    extern "C" int ioctl(int fd, unsigned long request, ...) noexcept   \
+    {                                                                   \
+        typedef int (*Ioctl)(int, unsigned long, ...);                  \
+        static const Ioctl next = reinterpret_cast<Ioctl>(dlsym(RTLD_NEXT, "ioctl")); \
+        va_list args;                                                   \
+        va_start(args, request);                                        \
+        void *argument = va_arg(args, void *);                          \
+        va_end(args);                                                   \
+        IoctlAccounting::instance().count(request);                     \
+        return next(fd, request, argument);                             \
+    }
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "hostexec.h"
+#include "launch.h"
+#include "registry.h"
+
+// Output verification which only moves a summary: the number of mismatching elements,
+// the first mismatching index and a few sampled ones. Kernels registering a verifier
+// symbol are checked on the device, everything else is checked in place on the host by
+// recomputing the reference in cache sized chunks, so neither needs a full copy of the
+// output nor a full expected vector.
+
+// Must match the result layout written by the verifier kernels (see kernel.cpp)
+static const unsigned VERIFY_SAMPLES = 8;
+
+struct VerifyResult {
+    unsigned count;
+    unsigned first;
+    unsigned samples[VERIFY_SAMPLES];
+
+    VerifyResult() : count(0), first(UINT_MAX) {
+        std::fill(samples, samples + VERIFY_SAMPLES, UINT_MAX);
+    }
+
+    void print(std::ostream &stream) const {
+        if (!count) {
+            stream << "No mismatches" << std::endl;
+            return;
+        }
+        stream << count << " mismatches, first at " << first << ", sampled at";
+        for (unsigned i = 0; i < std::min(count, VERIFY_SAMPLES); i++)
+            stream << ' ' << samples[i];
+        stream << std::endl;
+    }
+};
+
+// Runs desc.verifier, which takes the kernel's output and inputs followed by the length
+// and a VerifyResult to update
+class DeviceVerifier {
+    hipFunction_t mFunction;
+    DeviceBO<VerifyResult> mResult;
+    const char *mName;
+
+public:
+    DeviceVerifier(HipDevice &device, const KernelDesc &desc) : mFunction(device.getFunction(desc.codeObject, desc.verifier)),
+                                                                mResult(1), mName(desc.verifier) {}
+
+    // Buffers are given as KernelArgs slots
+    VerifyResult run(const KernelDesc &desc, const std::vector<void *> &slots, size_t len, hipStream_t stream = 0) {
+        VerifyResult result;
+        hipCheck(hipMemcpyWithStream(mResult.get(), &result, sizeof(result), hipMemcpyHostToDevice, stream));
+
+        PackedArgs args;
+        args.push(slots.at(0));
+        for (size_t k = 0; k < desc.count(ArgKind::Input); k++)
+            args.push(slots.at(1 + k));
+        args.push(static_cast<unsigned>(len));
+        args.push(mResult.get());
+
+        static const unsigned THREADS_PER_BLOCK_X = 256;
+        hipCheck(hipModuleLaunchKernel(mFunction,
+                                         (len + THREADS_PER_BLOCK_X - 1)/THREADS_PER_BLOCK_X, 1, 1,
+                                         THREADS_PER_BLOCK_X, 1, 1,
+                                         0, stream, nullptr, args.config()), mName);
+        hipCheck(hipMemcpyWithStream(&result, mResult.get(), sizeof(result), hipMemcpyDeviceToHost, stream));
+        return result;
+    }
+};
+
+// Compare out with desc.reference from threads pinned to cpus, one chunk at a time;
+// inputs(k, chunk, count, scratch) returns input k over [chunk, chunk + count)
+template <typename F>
+VerifyResult verifyChunked(const KernelDesc &desc, const float *out, size_t len, const std::vector<int> &cpus,
+                           F inputs)
+{
+    static const size_t CHUNK = 0x1000;
+    const size_t count = desc.count(ArgKind::Input);
+    VerifyResult result;
+    std::mutex mutex;
+    parallelFor(cpus, len, [&](size_t begin, size_t end) {
+        std::vector<float> expected(CHUNK);
+        std::vector<std::vector<float>> scratch(count, std::vector<float>(CHUNK));
+        std::vector<const float *> in(count);
+        for (size_t chunk = begin; chunk < end; chunk += CHUNK) {
+            const size_t length = std::min(CHUNK, end - chunk);
+            for (size_t k = 0; k < count; k++)
+                in[k] = inputs(k, chunk, length, scratch[k].data());
+            desc.reference(expected.data(), in.data(), length);
+            for (size_t i = 0; i < length; i++) {
+                if (out[chunk + i] == expected[i])
+                    continue;
+                const unsigned index = chunk + i;
+                std::lock_guard<std::mutex> lock(mutex);
+                if (result.count < VERIFY_SAMPLES)
+                    result.samples[result.count] = index;
+                result.count++;
+                result.first = std::min(result.first, index);
+            }
+        }
+    });
+    return result;
+}
+
+// Check out against the reference over inputs regenerated from the seed (see
+// generate.h), so the inputs need not be kept on, or copied to, the host
+inline VerifyResult verifyGenerated(const KernelDesc &desc, const float *out, uint64_t seed, size_t len,
+                                    const std::vector<int> &cpus)
+{
+    return verifyChunked(desc, out, len, cpus, [&](size_t k, size_t chunk, size_t length, float *scratch) {
+        fillHost(scratch, chunk, length, seed, k);
+        return const_cast<const float *>(scratch);
+    });
+}
@@ -0,0 +1,139 @@
+/* SPDX-License-Identifier: Apache License 2.0 */
+/* Copyright (C) 2023 Advanced Micro Devices, Inc. */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "hip/hip_runtime_api.h"
+
+#include "common.h"
+#include "generate.h"
+#include "hostmem.h"
+#include "registry.h"
+#include "verify.h"
+
+// A registered kernel with its own buffers ready to launch over and over, as used by the
+// drivers which run several kernels side by side. Slot 0 is the output, slot 1 + k the
+// k-th input generated as Philox stream k. Buffers live in device memory or in host
+// memory registered and mapped into the device.
+class KernelWorkload {
+public:
+    enum class Placement {
+        Device,
+        Mapped
+    };
+
+private:
+    const KernelDesc &mDesc;
+    hipFunction_t mFunction;
+    size_t mLen;
+    Placement mPlacement;
+    std::vector<std::unique_ptr<DeviceBO<float>>> mDeviceSlots;
+    std::vector<std::unique_ptr<HostBO<float>>> mHostSlots;
+    // What the kernel is given: device buffers or device pointers of the host buffers
+    std::vector<void *> mBuffers;
+    std::unique_ptr<KernelArgs> mArgs;
+
+public:
+    KernelWorkload(HipDevice &hdevice, DeviceGenerator &generator, const KernelDesc &desc, size_t len,
+                   Placement placement = Placement::Device, int hostNode = -1) :
+        mDesc(desc), mFunction(hdevice.getFunction(desc.codeObject, desc.symbol)), mLen(len), mPlacement(placement) {
+        const size_t count = 1 + mDesc.count(ArgKind::Input);
+        for (size_t s = 0; s < count; s++) {
+            if (mPlacement == Placement::Device) {
+                mDeviceSlots.emplace_back(new DeviceBO<float>(mLen));
+                float *buffer = mDeviceSlots.back()->get();
+                if (s)
+                    generator.fill(buffer, mLen, DEFAULT_SEED, s - 1);
+                else
+                    hipCheck(hipMemset(buffer, 0, mLen * sizeof(float)));
+                mBuffers.push_back(buffer);
+            }
+            else {
+                mHostSlots.emplace_back(new HostBO<float>(mLen, hostNode));
+                float *buffer = mHostSlots.back()->get();
+                if (s)
+                    fillHost(buffer, 0, mLen, DEFAULT_SEED, s - 1);
+                else
+                    std::fill(buffer, buffer + mLen, 0.0f);
+                hipCheck(hipHostRegister(buffer, mLen * sizeof(float), hipHostRegisterDefault));
+                void *mapped = nullptr;
+                hipCheck(hipHostGetDevicePointer(&mapped, buffer, 0));
+                mBuffers.push_back(mapped);
+            }
+        }
+        mArgs.reset(new KernelArgs(mDesc, mBuffers, mLen));
+        hipCheck(hipDeviceSynchronize());
+    }
+
+    ~KernelWorkload() {
+        for (auto &slot : mHostSlots)
+            (void)hipHostUnregister(slot->get());
+    }
+
+    KernelWorkload(const KernelWorkload &) = delete;
+    KernelWorkload &operator=(const KernelWorkload &) = delete;
+
+    const KernelDesc &desc() const {
+        return mDesc;
+    }
+
+    hipFunction_t function() const {
+        return mFunction;
+    }
+
+    size_t len() const {
+        return mLen;
+    }
+
+    Placement placement() const {
+        return mPlacement;
+    }
+
+    LaunchGeometry geometry() const {
+        return mDesc.geometry(mLen);
+    }
+
+    void **config() const {
+        return mArgs->config();
+    }
+
+    // Bytes moved by one launch
+    size_t bytes() const {
+        return static_cast<size_t>(mDesc.bytesPerElement * mLen);
+    }
+
+    void launch(hipStream_t stream) const {
+        const LaunchGeometry geometry = mDesc.geometry(mLen);
+        hipCheck(hipModuleLaunchKernel(mFunction,
+                                         geometry.grid, 1, 1,
+                                         geometry.block, 1, 1,
+                                         0, stream, nullptr, mArgs->config()), mDesc.symbol);
+    }
+
+    // Check the output of the finished launches and clear it for the next run; kernels
+    // without a verifier or host reference always pass
+    int validate(HipDevice &hdevice, const std::vector<int> &cpus) {
+        int errors = 0;
+        if (mPlacement == Placement::Mapped) {
+            float *output = mHostSlots[0]->get();
+            if (mDesc.reference)
+                errors = verifyGenerated(mDesc, output, DEFAULT_SEED, mLen, cpus).count ? 1 : 0;
+            std::fill(output, output + mLen, 0.0f);
+            return errors;
+        }
+        if (mDesc.verifier) {
+            errors = DeviceVerifier(hdevice, mDesc).run(mDesc, mBuffers, mLen).count ? 1 : 0;
+        }
+        else if (mDesc.reference) {
+            std::vector<float> output(mLen);
+            hipCheck(hipMemcpy(output.data(), mBuffers[0], mLen * sizeof(float), hipMemcpyDeviceToHost));
+            errors = verifyGenerated(mDesc, output.data(), DEFAULT_SEED, mLen, cpus).count ? 1 : 0;
+        }
+        hipCheck(hipMemset(mBuffers[0], 0, mLen * sizeof(float)));
+        return errors;
+    }
+};